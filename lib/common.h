@@ -62,6 +62,13 @@ int getrlimit(int resource, struct rlimit *rlimits);
 // sys/auxv.h
 unsigned long int getauxval(unsigned long int __type);
 
+// vDSO functions of the host, NULL if not available
+extern int (*vdso_clock_gettime)(int clk_id, struct timespec *tp);
+
+extern int (*vdso_gettimeofday)(struct timeval *tv, struct timezone *tz);
+
+void init_vdso(void);
+
 // sys/mman.h
 void *mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset);
 
@@ -69,6 +76,31 @@ int munmap(void *addr, size_t length);
 
 int mprotect(void *addr, size_t len, int prot);
 
+// signal.h (kernel interface)
+#ifndef SIGSEGV
+#define SIGSEGV 11
+#endif
+#ifndef SA_SIGINFO
+#define SA_SIGINFO 0x00000004
+#endif
+#ifndef SA_RESTORER
+#define SA_RESTORER 0x04000000
+#endif
+#ifndef SIG_DFL
+#define SIG_DFL ((void *) 0)
+#endif
+
+struct kernel_sigaction {
+    void *handler;
+    unsigned long flags;
+    void *restorer;
+    uint64_t mask;
+};
+
+void __minilibc_restore_rt(void);
+
+int rt_sigaction(int signum, const struct kernel_sigaction *act, struct kernel_sigaction *oldact);
+
 // stdio.h
 int vsnprintf(char *str, size_t size, const char *restrict format, va_list args);
 
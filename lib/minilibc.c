@@ -12,10 +12,18 @@ void __start_main(const size_t* initial_stack, const size_t* dynv);
 
 #if UINTPTR_MAX == 0xffffffff
 #define ELF_R_TYPE ELF32_R_TYPE
+#define ELF_ST_TYPE ELF32_ST_TYPE
+#define Elf_Ehdr Elf32_Ehdr
 #define Elf_Phdr Elf32_Phdr
+#define Elf_Dyn Elf32_Dyn
+#define Elf_Sym Elf32_Sym
 #else
 #define ELF_R_TYPE ELF64_R_TYPE
+#define ELF_ST_TYPE ELF64_ST_TYPE
+#define Elf_Ehdr Elf64_Ehdr
 #define Elf_Phdr Elf64_Phdr
+#define Elf_Dyn Elf64_Dyn
+#define Elf_Sym Elf64_Sym
 #endif
 
 #if defined(__x86_64__)
@@ -70,6 +78,19 @@ __clone:
 #endif
 //@formatter:on
 
+//@formatter:off
+// Return trampoline for signal handlers, the kernel requires SA_RESTORER on x86-64.
+ASM_BLOCK(
+    .intel_syntax noprefix;
+    .global __minilibc_restore_rt;
+    .type   __minilibc_restore_rt, @function;
+__minilibc_restore_rt:
+    mov eax, 15; // __NR_rt_sigreturn
+    syscall;
+    .att_syntax;
+);
+//@formatter:on
+
 //@formatter:off
 static size_t syscall0(int syscall_number) {
     size_t retval = syscall_number;
@@ -343,7 +364,20 @@ int munmap(void* addr, size_t length) {
     return syscall2(__NR_munmap, (size_t) addr, length);
 }
 
+int rt_sigaction(int signum, const struct kernel_sigaction* act, struct kernel_sigaction* oldact) {
+    struct kernel_sigaction copy;
+    if (act) {
+        copy = *act;
+        copy.flags |= SA_RESTORER;
+        copy.restorer = (void*) (uintptr_t) __minilibc_restore_rt;
+        act = &copy;
+    }
+    return syscall4(__NR_rt_sigaction, signum, (size_t) act, (size_t) oldact, sizeof(act->mask));
+}
+
 int clock_gettime(int clk_id, struct timespec* tp) {
+    if (vdso_clock_gettime != NULL)
+        return vdso_clock_gettime(clk_id, tp);
     return syscall2(__NR_clock_gettime, clk_id, (size_t) tp);
 }
 
@@ -713,6 +747,70 @@ unsigned long getauxval(unsigned long type) {
     return 0;
 }
 
+int (*vdso_clock_gettime)(int clk_id, struct timespec* tp) = NULL;
+int (*vdso_gettimeofday)(struct timeval* tv, struct timezone* tz) = NULL;
+
+/**
+ * Look up a function exported by the vDSO the kernel maps into the process (AT_SYSINFO_EHDR).
+ * @param name the symbol name
+ * @return the address of the function, or 0 if there is no vDSO or it does not export the function
+ */
+static uintptr_t vdso_lookup(const char* name) {
+    const Elf_Ehdr* ehdr = (const void*) getauxval(AT_SYSINFO_EHDR);
+    if (ehdr == NULL)
+        return 0;
+
+    // The vDSO is mapped as a whole, the load bias follows from its (first) PT_LOAD.
+    uintptr_t base = (uintptr_t) ehdr;
+    uintptr_t bias = 0;
+    bool loaded = false;
+    const Elf_Dyn* dyn = NULL;
+    const Elf_Phdr* phdr = (const void*) (base + ehdr->e_phoff);
+    for (unsigned i = 0; i != ehdr->e_phnum; i++) {
+        if (phdr[i].p_type == PT_LOAD && !loaded) {
+            bias = base + phdr[i].p_offset - phdr[i].p_vaddr;
+            loaded = true;
+        } else if (phdr[i].p_type == PT_DYNAMIC) {
+            dyn = (const void*) (base + phdr[i].p_offset);
+        }
+    }
+    if (!loaded || dyn == NULL)
+        return 0;
+
+    const Elf_Sym* symtab = NULL;
+    const char* strtab = NULL;
+    const uint32_t* hash = NULL;
+    for (; dyn->d_tag != DT_NULL; dyn++) {
+        switch (dyn->d_tag) {
+        case DT_SYMTAB: symtab = (const void*) (bias + dyn->d_un.d_ptr); break;
+        case DT_STRTAB: strtab = (const void*) (bias + dyn->d_un.d_ptr); break;
+        case DT_HASH: hash = (const void*) (bias + dyn->d_un.d_ptr); break;
+        default: break;
+        }
+    }
+    if (symtab == NULL || strtab == NULL || hash == NULL)
+        return 0;
+
+    // The chain count of the hash table is the number of symbols.
+    for (uint32_t i = 0; i != hash[1]; i++) {
+        const Elf_Sym* sym = &symtab[i];
+        if (ELF_ST_TYPE(sym->st_info) != STT_FUNC || sym->st_shndx == SHN_UNDEF)
+            continue;
+        if (strcmp(strtab + sym->st_name, name) == 0)
+            return bias + sym->st_value;
+    }
+    return 0;
+}
+
+/**
+ * Resolve the vDSO functions, which serve the time syscalls without entering the kernel.
+ * Must be called once the auxiliary vector is known.
+ */
+void init_vdso(void) {
+    vdso_clock_gettime = (int (*)(int, struct timespec*)) vdso_lookup("__vdso_clock_gettime");
+    vdso_gettimeofday = (int (*)(struct timeval*, struct timezone*)) vdso_lookup("__vdso_gettimeofday");
+}
+
 __attribute__((externally_visible))
 __attribute__((optimize("-fno-tree-loop-distribute-patterns")))
 void* memset(void* s, int c, size_t n) {
@@ -795,6 +893,7 @@ __start_main(const size_t* initial_stack, const size_t* dynv)
 
     __asm__ volatile("" ::: "memory"); // memory barrier for compiler
     environ = local_environ;
+    init_vdso();
 
     int retval = main(initial_stack[0], (char**) (initial_stack + 1));
     _exit(retval);
@@ -26,13 +26,9 @@
 #include <env/opt.h>
 #include <env/exit.h>
 #include <util/tools/profile.h>
+#include <cache/chain.h>
 
 #define INITIAL_SIZE 8192
-#define SMALLTLB 0x20
-
-///position where direct jump to next block can be inserted
-volatile uint8_t *chain_end = NULL;
-volatile uint32_t chain_type = 0;
 
 //cache table
 t_cache_entry *cache_table = NULL;
@@ -177,6 +173,7 @@ void set_cache_entry(t_risc_addr risc_addr, t_cache_loc cache_loc) {
         //update value in table
         cache_table[index].cache_loc = cache_loc;
         set_tlb(risc_addr, cache_loc);
+        link_exits(risc_addr, cache_loc);
         return;
     }
 
@@ -187,12 +184,46 @@ void set_cache_entry(t_risc_addr risc_addr, t_cache_loc cache_loc) {
 
     set_tlb(risc_addr, cache_loc);
 
+    //chain all exits waiting for this block
+    link_exits(risc_addr, cache_loc);
+
     //print entries
     if (flag_log_cache) {
         print_values();
     }
 }
 
+/**
+ * Remove the entry of a RISC-V address from the cache table and the tlb,
+ * so the block gets translated again on its next lookup.
+ * @param risc_addr the RISC-V address of the block
+ */
+void remove_cache_entry(t_risc_addr risc_addr) {
+    size_t smallHash = smallhash(risc_addr);
+    if (tlb[smallHash].risc_addr == risc_addr) {
+        tlb[smallHash] = (t_cache_entry) {0, UNSEEN_CODE};
+    }
+
+    size_t index = find_lin_slot(risc_addr);
+    if (cache_table[index].cache_loc == 0) return;
+
+    ///shift following entries back into the hole, so no probe sequence is interrupted
+    size_t next = index;
+    while (true) {
+        next = (next + 1) & (table_size - 1);
+        if (cache_table[next].cache_loc == 0) break;
+
+        //the entry can only move if its home slot is not (cyclically) between the hole and its current slot
+        size_t home = hash(cache_table[next].risc_addr);
+        if (((next - home) & (table_size - 1)) >= ((next - index) & (table_size - 1))) {
+            cache_table[index] = cache_table[next];
+            index = next;
+        }
+    }
+    cache_table[index] = (t_cache_entry) {0, UNSEEN_CODE};
+    count_entries--;
+}
+
 /**
  * Print out the hash table contents.
  */
@@ -218,3 +249,24 @@ void print_values(void) {
 size_t get_cache_entry_count(void) {
     return count_entries;
 }
+
+/**
+ * Remove all entries from the cache table and the tlb.
+ * Used when flushing the code cache, the table keeps its current size.
+ * Also forgets the exits of the flushed blocks.
+ */
+void clear_cache_table(void) {
+    memset(cache_table, 0, table_size * sizeof(t_cache_entry));
+    memset(tlb, 0, tlb_size * sizeof(t_cache_entry));
+    count_entries = 0;
+    clear_exit_table();
+    log_cache("Cache table cleared.\n");
+}
+
+size_t get_cache_table_size(void) {
+    return table_size;
+}
+
+const t_cache_entry *get_cache_table(void) {
+    return cache_table;
+}
@@ -6,7 +6,9 @@
 #define DYNAMICBINARYTRANSLATORRISCV64_X86_64_CACHE_H
 
 #define UNSEEN_CODE (void*) 0
-#define TRANSLATION_STARTED (void*) 1
+
+//size of the fast lookup table, must be a power of two
+#define SMALLTLB 0x20
 
 #include <util/log.h>
 
@@ -16,9 +18,6 @@ extern "C" {
 
 typedef void *t_cache_loc;
 
-extern volatile uint8_t *chain_end;
-extern volatile uint32_t chain_type;
-
 //cache entries for translated code segments
 typedef struct {
     //the full RISC-V pc address
@@ -27,6 +26,13 @@ typedef struct {
     t_cache_loc cache_loc;
 } t_cache_entry;
 
+//fast lookup table, also probed inline by the generated code of indirect jumps
+extern t_cache_entry *tlb;
+
+//hash table of all translated blocks, also probed by the native dispatcher
+extern t_cache_entry *cache_table;
+extern size_t table_size;
+
 void init_hash_table(void);
 
 size_t hash(t_risc_addr risc_addr);
@@ -40,10 +46,18 @@ t_cache_loc lookup_cache_entry(t_risc_addr risc_addr);
 void set_cache_entry(t_risc_addr risc_addr, t_cache_loc cache_loc);
 void set_tlb(t_risc_addr risc_addr, t_cache_loc cacheLoc);
 
+void remove_cache_entry(t_risc_addr risc_addr);
+
 void print_values(void);
 
+void clear_cache_table(void);
+
 size_t get_cache_entry_count(void);
 
+size_t get_cache_table_size(void);
+
+const t_cache_entry *get_cache_table(void);
+
 #ifdef __cplusplus
 }
 #endif
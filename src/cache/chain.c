@@ -0,0 +1,163 @@
+/**
+ * Table of the chainable exits of all translated blocks.
+ * Every exit towards a statically known RISC-V address ends in its own patchable jump (see emit_exit()),
+ * which initially leads to a fallback that sets pc and returns to the dispatcher.
+ * The exits are recorded here, bucketed by their target address, and as soon as the target gets translated
+ * (set_cache_entry()) all exits leading to it are patched to jump there directly,
+ * independently of which of them is actually taken first.
+ */
+
+#include "chain.h"
+#include <common.h>
+#include <linux/mman.h>
+#include <fadec/fadec-enc.h>
+#include <util/log.h>
+#include <env/exit.h>
+
+#define EXIT_BUCKETS 4096
+#define INITIAL_EXITS 8192
+
+static t_block_exit *exits = NULL;
+static size_t exits_size = INITIAL_EXITS;
+static size_t count_exits = 0;
+static size_t count_linked = 0;
+
+//index + 1 of the first exit per bucket, 0 for none
+static uint32_t *exit_buckets = NULL;
+
+static inline size_t exit_hash(t_risc_addr target) {
+    return (target >> 2u) & (EXIT_BUCKETS - 1);
+}
+
+/**
+ * Initializes the exit table.
+ */
+void init_exit_table(void) {
+    exits_size = INITIAL_EXITS;
+    count_exits = 0;
+    count_linked = 0;
+
+    exits = mmap(NULL, exits_size * sizeof(t_block_exit), PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE,
+                 -1, 0);
+    exit_buckets = mmap(NULL, EXIT_BUCKETS * sizeof(uint32_t), PROT_READ | PROT_WRITE,
+                        MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+
+    if (BAD_ADDR(exits) || BAD_ADDR(exit_buckets)) {
+        dprintf(2, "Bad. Exit table memory allocation failed.");
+        panic(FAIL_HEAP_ALLOC);
+    }
+}
+
+/**
+ * Patch the jump of the passed exit to the passed location.
+ */
+static void patch_exit(t_block_exit *exit, t_cache_loc cache_loc) {
+    uint8_t *site = exit->site;
+    if (fe_enc64(&site, exit->type | FE_JMPL, (intptr_t) cache_loc) != 0) {
+        dprintf(2, "Assembly error in chain, exiting...\n");
+        panic(FAIL_ASSEMBLY_ERR);
+    }
+}
+
+/**
+ * Record a new block exit.
+ * @param target the RISC-V address the exit leads to
+ * @param site the patchable jump instruction of the exit, encoded with FE_JMPL
+ * @param fallback the destination of the jump while unlinked
+ * @param type the mnemonic of the jump at site
+ * @param linked whether the jump already leads to the target's block
+ */
+void register_exit(t_risc_addr target, uint8_t *site, uint8_t *fallback, uint64_t type, bool linked) {
+    if (exits == NULL) {
+        init_exit_table();
+    }
+
+    if (count_exits == exits_size) {
+        ///double the table size
+        t_block_exit *copy_buf = mmap(NULL, 2 * exits_size * sizeof(t_block_exit), PROT_READ | PROT_WRITE,
+                                      MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+        if (BAD_ADDR(copy_buf)) {
+            dprintf(2, "Bad. Memory allocation failed.\n");
+            panic(FAIL_HEAP_ALLOC);
+        }
+        memcpy(copy_buf, exits, exits_size * sizeof(t_block_exit));
+        munmap(exits, exits_size * sizeof(t_block_exit));
+        exits = copy_buf;
+        exits_size <<= 1u;
+    }
+
+    size_t bucket = exit_hash(target);
+    exits[count_exits] = (t_block_exit) {
+            .target = target,
+            .site = site,
+            .fallback = fallback,
+            .type = type,
+            .linked = linked,
+            .next = exit_buckets[bucket]
+    };
+    exit_buckets[bucket] = ++count_exits;
+
+    if (linked) count_linked++;
+}
+
+/**
+ * Link all exits leading to the passed RISC-V address to its newly translated block.
+ * Exits that are linked already are redirected as well, as the block may replace an older one (e.g. a trace).
+ * @param target the RISC-V address
+ * @param cache_loc the cache location of its block
+ */
+void link_exits(t_risc_addr target, t_cache_loc cache_loc) {
+    if (exits == NULL || cache_loc == UNSEEN_CODE) return;
+
+    for (uint32_t i = exit_buckets[exit_hash(target)]; i != 0; i = exits[i - 1].next) {
+        t_block_exit *exit = &exits[i - 1];
+        if (exit->target == target) {
+            log_cache("Chaining exit at %p to %p (riscv %p)\n", exit->site, cache_loc, (void *) target);
+            patch_exit(exit, cache_loc);
+            if (!exit->linked) {
+                exit->linked = true;
+                count_linked++;
+            }
+        }
+    }
+}
+
+/**
+ * Unlink all exits leading to the passed RISC-V address, e.g. because its block was invalidated.
+ * The exits lead to their fallbacks again until the address is translated anew.
+ * @param target the RISC-V address
+ */
+void unlink_exits(t_risc_addr target) {
+    if (exits == NULL) return;
+
+    for (uint32_t i = exit_buckets[exit_hash(target)]; i != 0; i = exits[i - 1].next) {
+        t_block_exit *exit = &exits[i - 1];
+        if (exit->target == target && exit->linked) {
+            patch_exit(exit, exit->fallback);
+            exit->linked = false;
+            count_linked--;
+        }
+    }
+}
+
+/**
+ * Forget all exits, e.g. because the code containing them was flushed.
+ */
+void clear_exit_table(void) {
+    if (exits == NULL) return;
+    memset(exit_buckets, 0, EXIT_BUCKETS * sizeof(uint32_t));
+    count_exits = 0;
+    count_linked = 0;
+}
+
+size_t get_exit_count(void) {
+    return count_exits;
+}
+
+size_t get_linked_exit_count(void) {
+    return count_linked;
+}
+
+const t_block_exit *get_exit_table(void) {
+    return exits;
+}
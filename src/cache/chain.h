@@ -0,0 +1,47 @@
+#ifndef DYNAMICBINARYTRANSLATORRISCV64_X86_64_CHAIN_H
+#define DYNAMICBINARYTRANSLATORRISCV64_X86_64_CHAIN_H
+
+#include <util/typedefs.h>
+#include <cache/cache.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//exit of a translated block towards a statically known RISC-V address
+typedef struct {
+    //the RISC-V address the exit leads to
+    t_risc_addr target;
+    //the patchable jmp/jcc rel32 instruction
+    uint8_t *site;
+    //where the jump leads to while the exit is unlinked: sets pc and returns to the dispatcher
+    uint8_t *fallback;
+    //mnemonic of the jump at site
+    uint64_t type;
+    //whether site currently jumps directly to the target's block
+    bool linked;
+    //index + 1 of the next exit in the same bucket, 0 for none
+    uint32_t next;
+} t_block_exit;
+
+void init_exit_table(void);
+
+void register_exit(t_risc_addr target, uint8_t *site, uint8_t *fallback, uint64_t type, bool linked);
+
+void link_exits(t_risc_addr target, t_cache_loc cache_loc);
+
+void unlink_exits(t_risc_addr target);
+
+void clear_exit_table(void);
+
+size_t get_exit_count(void);
+
+size_t get_linked_exit_count(void);
+
+const t_block_exit *get_exit_table(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //DYNAMICBINARYTRANSLATORRISCV64_X86_64_CHAIN_H
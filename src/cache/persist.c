@@ -0,0 +1,259 @@
+/**
+ * Persistent on-disk code cache.
+ * On exit, the translated blocks and the cache_table contents are written to a file in the persist_cache_dir,
+ * named after a hash of the guest ELF. On startup, that file is mapped back to the same location in the
+ * instruction memory, so warm runs can start executing without translating.
+ *
+ * The generated code is not relocatable: it contains absolute addresses of other blocks and of the translator's
+ * own data (register files, chaining state, ...). Instead of relocating, the file therefore stores a fingerprint of
+ * the translator version, the translation flags and the relevant addresses, and is only used if all of them match.
+ * The chain links themselves live inside the translated code and are restored together with it,
+ * the exit table is stored as well so exits still unlinked can be chained in later runs.
+ * The same goes for the execution counters of the blocks, which the code references as well.
+ */
+
+#include "persist.h"
+#include <common.h>
+#include <linux/mman.h>
+#include <linux/fs.h>
+#include <util/log.h>
+#include <env/flags.h>
+#include <env/opt.h>
+#include <env/exit.h>
+#include <gen/translate.h>
+#include <runtime/emulateEcall.h>
+#include <cache/chain.h>
+#include <cache/return_stack.h>
+#include <gen/trace.h>
+
+///magic "RIAJITPC"
+#define PERSIST_MAGIC 0x4350544a41495252lu
+#define PERSIST_PAGE_SIZE 4096lu
+
+typedef struct {
+    uint64_t magic;
+    //hash of the translator version string
+    uint64_t version_hash;
+    //hash of the guest ELF file contents
+    uint64_t elf_hash;
+    //hash of the translation flags and translator addresses baked into the generated code
+    uint64_t layout_hash;
+    //address the code was generated at
+    uint64_t code_start;
+    //size of the code in bytes
+    uint64_t code_size;
+    //number of t_cache_entry structs following the header
+    uint64_t entry_count;
+    //number of t_block_exit structs following the cache entries
+    uint64_t exit_count;
+    //number of t_block_counter structs following the exits
+    uint64_t counter_count;
+} t_persist_header;
+
+/**
+ * Key of the current run, computed in init_persistent_cache().
+ */
+static t_persist_header persist_key;
+
+/**
+ * End of the code loaded from the cache file, used to skip writing the file back when nothing was added.
+ */
+static void *persist_loaded_end = NULL;
+
+static char persist_path[512];
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t length) {
+    const uint8_t *bytes = data;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3lu;
+    }
+    return hash;
+}
+
+#define FNV_OFFSET 0xcbf29ce484222325lu
+#define FNV_VALUE(hash, value) hash = fnv1a(hash, &(value), sizeof(value))
+
+static uint64_t hash_elf_file(const char *file_path) {
+    int fd = open(file_path, O_RDONLY, 0);
+    if (fd < 0) {
+        return 0;
+    }
+    off_t size = lseek(fd, 0, SEEK_END);
+    if (size <= 0) {
+        close(fd);
+        return 0;
+    }
+    void *contents = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (BAD_ADDR(contents)) {
+        return 0;
+    }
+    uint64_t hash = fnv1a(FNV_OFFSET, contents, size);
+    munmap(contents, size);
+    return hash;
+}
+
+static uint64_t hash_layout(const context_info *c_info, bool floatBinary) {
+    uint64_t hash = FNV_OFFSET;
+    bool flags[] = {
+            flag_translate_opt_ras, flag_translate_opt_chain, flag_translate_opt_jump, flag_translate_opt_fusion,
+            flag_translate_opt_ibl, flag_translate_opt_trace, flag_translate_opt_regalloc, flag_translate_opt_liveness,
+            flag_translate_opt_propagate, flag_translate_opt_forward, flag_translate_opt_ecall, flag_host_ras,
+            flag_log_syscall, flag_single_step, flag_do_profile, flag_verbose_disassembly, floatBinary,
+            //the fast time syscalls only call through the vDSO pointers if the vDSO was found
+            vdso_clock_gettime != NULL, vdso_gettimeofday != NULL
+    };
+    uintptr_t addresses[] = {
+            (uintptr_t) c_info->load_execute_save_context, (uintptr_t) c_info->save_context,
+            (uintptr_t) c_info->r_info->base, (uintptr_t) &emulate_ecall, (uintptr_t) blockMemStart,
+            (uintptr_t) get_block_counters(), (uintptr_t) &trace_requested,
+            (uintptr_t) c_info->load_fp_context, (uintptr_t) &fp_context_loaded, (uintptr_t) c_info->fast_ecall,
+            (uintptr_t) &vdso_clock_gettime, (uintptr_t) &vdso_gettimeofday, (uintptr_t) &rs_shadow_sp
+    };
+    FNV_VALUE(hash, flags);
+    FNV_VALUE(hash, addresses);
+    //the return stack mask is baked into the code (--ras-depth)
+    FNV_VALUE(hash, ras_depth);
+    //the static register mapping may differ between runs (--register-map)
+    hash = fnv1a(hash, c_info->r_info->gp_map, N_REG * sizeof(FeReg));
+    hash = fnv1a(hash, c_info->r_info->gp_mapped, N_REG * sizeof(bool));
+    hash = fnv1a(hash, c_info->r_info->fp_map, N_FP_REG * sizeof(FeReg));
+    hash = fnv1a(hash, c_info->r_info->fp_mapped, N_FP_REG * sizeof(bool));
+    return hash;
+}
+
+static size_t metadata_size(const t_persist_header *header) {
+    return sizeof(t_persist_header) + header->entry_count * sizeof(t_cache_entry) +
+            header->exit_count * sizeof(t_block_exit) + header->counter_count * sizeof(t_block_counter);
+}
+
+static size_t code_offset(const t_persist_header *header) {
+    return (metadata_size(header) + PERSIST_PAGE_SIZE - 1) & ~(PERSIST_PAGE_SIZE - 1);
+}
+
+/**
+ * Load the persistent cache file for the passed guest binary, if there is a matching one.
+ * Must be called after setupBlockMem() and before any block is translated.
+ * @param file_path path of the guest ELF
+ * @param c_info the context info of this run
+ * @param floatBinary whether the guest uses the F/D extension
+ */
+void init_persistent_cache(const char *file_path, const context_info *c_info, bool floatBinary) {
+    //translations of self-modifying code would have to be verified against the guest memory of the next run
+    if (persist_cache_dir == NULL || flag_smc) return;
+
+    persist_key = (t_persist_header) {
+            .magic = PERSIST_MAGIC,
+            .version_hash = fnv1a(FNV_OFFSET, translator_version, strlen(translator_version)),
+            .elf_hash = hash_elf_file(file_path),
+            .layout_hash = hash_layout(c_info, floatBinary),
+            .code_start = (uintptr_t) blockMemStart
+    };
+    snprintf(persist_path, sizeof(persist_path), "%s/ria-jit-%016lx.cache", persist_cache_dir, persist_key.elf_hash);
+
+    int fd = open(persist_path, O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0) {
+        log_cache("No persistent cache at %s.\n", persist_path);
+        return;
+    }
+
+    t_persist_header header;
+    if (read_full(fd, &header, sizeof(header)) != sizeof(header) || header.magic != persist_key.magic ||
+            header.version_hash != persist_key.version_hash || header.elf_hash != persist_key.elf_hash ||
+            header.layout_hash != persist_key.layout_hash || header.code_start != persist_key.code_start) {
+        log_cache("Persistent cache %s does not match, ignoring it.\n", persist_path);
+        close(fd);
+        return;
+    }
+
+    size_t offset = code_offset(&header);
+    if (lseek(fd, 0, SEEK_END) < (off_t) (offset + header.code_size)) {
+        log_cache("Persistent cache %s is truncated, ignoring it.\n", persist_path);
+        close(fd);
+        return;
+    }
+
+    uint8_t *metadata = mmap(NULL, metadata_size(&header), PROT_READ, MAP_PRIVATE, fd, 0);
+    if (BAD_ADDR(metadata)) {
+        close(fd);
+        return;
+    }
+
+    ///map the code copy-on-write, so chaining in this run does not touch the file
+    if (header.code_size != 0) {
+        void *code = mmap(blockMemStart, header.code_size, PROT_READ | PROT_WRITE | PROT_EXEC,
+                          MAP_FIXED | MAP_PRIVATE, fd, offset);
+        if (code != blockMemStart) {
+            dprintf(2, "Bad. Mapping the persistent cache failed.\n");
+            panic(FAIL_HEAP_ALLOC);
+        }
+    }
+    close(fd);
+
+    const t_cache_entry *entries = (const t_cache_entry *) (metadata + sizeof(header));
+    const t_block_exit *exits = (const t_block_exit *) (entries + header.entry_count);
+    for (size_t i = 0; i < header.exit_count; i++) {
+        register_exit(exits[i].target, exits[i].site, exits[i].fallback, exits[i].type, exits[i].linked);
+    }
+    restore_block_counters((const t_block_counter *) (exits + header.exit_count), header.counter_count);
+    for (size_t i = 0; i < header.entry_count; i++) {
+        set_cache_entry(entries[i].risc_addr, entries[i].cache_loc);
+    }
+    munmap(metadata, metadata_size(&header));
+
+    currentPos = (uint8_t *) blockMemStart + header.code_size;
+    persist_loaded_end = currentPos;
+    log_cache("Loaded %lu blocks (%lu bytes) from persistent cache %s.\n", header.entry_count, header.code_size,
+              persist_path);
+}
+
+/**
+ * Write the translated blocks of this run to the persistent cache file.
+ * The file is written under a temporary name first and then renamed, so concurrent runs never see partial files.
+ */
+void save_persistent_cache(void) {
+    if (persist_cache_dir == NULL || flag_smc || currentPos == persist_loaded_end) return;
+
+    t_persist_header header = persist_key;
+    header.code_size = (uint8_t *) currentPos - (uint8_t *) blockMemStart;
+
+    header.exit_count = get_exit_count();
+    header.counter_count = get_block_counter_count();
+
+    size_t table_entries = get_cache_table_size();
+    const t_cache_entry *table = get_cache_table();
+    for (size_t i = 0; i < table_entries; i++) {
+        if (table[i].cache_loc != UNSEEN_CODE) {
+            header.entry_count++;
+        }
+    }
+
+    char tmp_path[sizeof(persist_path) + 16];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%d", persist_path, getpid());
+    int fd = open(tmp_path, O_CREAT | O_TRUNC | O_WRONLY | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        dprintf(2, "Could not write persistent cache %s, error %i\n", tmp_path, -fd);
+        return;
+    }
+
+    bool failed = write_full(fd, &header, sizeof(header)) < 0;
+    for (size_t i = 0; i < table_entries && !failed; i++) {
+        if (table[i].cache_loc != UNSEEN_CODE) {
+            failed |= write_full(fd, &table[i], sizeof(t_cache_entry)) < 0;
+        }
+    }
+    failed |= !failed && write_full(fd, get_exit_table(), header.exit_count * sizeof(t_block_exit)) < 0;
+    failed |= !failed && write_full(fd, get_block_counters(), header.counter_count * sizeof(t_block_counter)) < 0;
+    failed |= lseek(fd, code_offset(&header), SEEK_SET) < 0;
+    failed |= !failed && write_full(fd, blockMemStart, header.code_size) < 0;
+    close(fd);
+
+    if (failed || syscall(__NR_rename, (long) tmp_path, (long) persist_path, 0, 0, 0, 0) < 0) {
+        dprintf(2, "Could not write persistent cache %s\n", persist_path);
+        syscall(__NR_unlink, (long) tmp_path, 0, 0, 0, 0, 0);
+        return;
+    }
+    log_cache("Saved %lu blocks (%lu bytes) to persistent cache %s.\n", header.entry_count, header.code_size,
+              persist_path);
+}
@@ -0,0 +1,19 @@
+#ifndef DYNAMICBINARYTRANSLATORRISCV64_X86_64_PERSIST_H
+#define DYNAMICBINARYTRANSLATORRISCV64_X86_64_PERSIST_H
+
+#include <util/typedefs.h>
+#include <main/context.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void init_persistent_cache(const char *file_path, const context_info *c_info, bool floatBinary);
+
+void save_persistent_cache(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //DYNAMICBINARYTRANSLATORRISCV64_X86_64_PERSIST_H
@@ -10,12 +10,47 @@
 #include <gen/translate.h>
 #include <util/util.h>
 #include <env/exit.h>
+#include <env/flags.h>
+#include <env/opt.h>
+#include <util/tools/profile.h>
 
 rs_entry *r_stack;
 volatile uint32_t rs_front; //= front * 16:   (2 * 8) = struct entry size
 
+//most entries of the return stack (--ras-depth)
+#define MAX_RAS_DEPTH (1lu << 20)
+
+//entries of the return stack, a power of two
+static size_t rs_entries = 64;
+//front mask: (entries - 1) * 16
+static uint32_t rs_mask = 0x3f0;
+//number of valid entries, only maintained when profiling to detect overflows
+static uint64_t rs_used = 0;
+
+/*
+ * Shadow stack for --host-ras.
+ * A guest call is translated to a host call on the shadow stack, so the host's own return address prediction
+ * handles the matching guest return. Each entry is a pair of the host return address pushed by the call,
+ * which leads to the code continuing at the guest return address, and the guest return address itself
+ * (see rs_emit_host_call()). The guest return validates its target against the latter before returning
+ * (see rs_emit_host_return_RAX()).
+ * The slot at the top holds a sentinel entry that never matches, so an empty stack needs no special case.
+ * If the stack is full, a call simply drops all entries.
+ */
+#define SHADOW_STACK_ENTRIES 4096
+
+uintptr_t rs_shadow_sp;
+static uintptr_t rs_shadow_top;
+static uintptr_t rs_shadow_limit;
+
 void init_return_stack(void) {
-    r_stack = mmap(NULL, 64 * sizeof(rs_entry), PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    rs_entries = 1;
+    while (rs_entries < ras_depth && rs_entries < MAX_RAS_DEPTH) {
+        rs_entries <<= 1;
+    }
+    rs_mask = (rs_entries - 1) * sizeof(rs_entry);
+
+    r_stack = mmap(NULL, rs_entries * sizeof(rs_entry), PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
 
     if (BAD_ADDR(r_stack)) {
         dprintf(2, "Bad. Return Stack memory allocation failed.");
@@ -23,6 +58,30 @@ void init_return_stack(void) {
     }
 
     rs_front = 0;
+
+    if (flag_host_ras) {
+        size_t size = (SHADOW_STACK_ENTRIES + 1) * sizeof(rs_entry);
+        void *shadow_stack = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+
+        if (BAD_ADDR(shadow_stack)) {
+            dprintf(2, "Bad. Shadow stack memory allocation failed.");
+            panic(FAIL_HEAP_ALLOC);
+        }
+
+        rs_shadow_top = (uintptr_t) shadow_stack + size - sizeof(rs_entry);
+        rs_shadow_limit = (uintptr_t) shadow_stack + sizeof(rs_entry);
+        rs_shadow_sp = rs_shadow_top;
+    }
+}
+
+/**
+ * Drop all entries of the return stack, e.g. because the code they point to was flushed.
+ */
+void clear_return_stack(void) {
+    memset(r_stack, 0, rs_entries * sizeof(rs_entry));
+    rs_front = 0;
+    rs_used = 0;
+    rs_shadow_sp = rs_shadow_top;
 }
 
 void rs_emit_push(const t_risc_instr *instr, const register_info *r_info, bool save_rax) {
@@ -34,13 +93,9 @@ void rs_emit_push(const t_risc_instr *instr, const register_info *r_info, bool s
     t_cache_loc cache_loc;
 
     if ((cache_loc = lookup_cache_entry(ret_target)) == UNSEEN_CODE) {
-        log_asm_out("rs_emit_push: flag_translate_op is enabled, but return target is not in cache RISC-V: %p\n",
-               (void *) instr->addr);
-    }
-
-    if (cache_loc == TRANSLATION_STARTED){
-        log_asm_out("Return stack return target still in translation. RISC-V: 0x%lx\n", instr->addr);
-        goto NOT_CACHED;
+        ///not translated yet: return through a stub that gets linked once it is
+        log_asm_out("Return stack return target not translated yet, using entry stub. RISC-V: 0x%lx\n", instr->addr);
+        cache_loc = emit_entry_stub(ret_target);
     }
 
     /* //old
@@ -73,20 +128,31 @@ void rs_emit_push(const t_risc_instr *instr, const register_info *r_info, bool s
     err |= fe_enc64(&current, FE_MOV64rm, FE_DX, FE_MEM_ADDR((intptr_t) &r_stack));     //get base
     err |= fe_enc64(&current, FE_MOV64ri, FE_CX, instr->addr + 4);                      //risc return addr
     err |= fe_enc64(&current, FE_ADD32ri, FE_AX, 0x10);                                 //increment front by "1" (=16)
-    err |= fe_enc64(&current, FE_AND32ri, FE_AX, 0x3f0);                                //mod 64 (*16..)
+    err |= fe_enc64(&current, FE_AND32ri, FE_AX, rs_mask);                              //mod entries (*16..)
     err |= fe_enc64(&current, FE_MOV32mr, FE_MEM_ADDR((uint64_t) &rs_front), FE_AX);    //save front
     err |= fe_enc64(&current, FE_ADD64rr, FE_AX, FE_DX);                                //base + front
     err |= fe_enc64(&current, FE_MOV64ri, FE_DX, (uintptr_t) cache_loc);                //x86 addr
     err |= fe_enc64(&current, FE_MOV64mr, FE_MEM(FE_AX, 0, 0, 0), FE_CX);               //save risc ret addr
     err |= fe_enc64(&current, FE_MOV64mr, FE_MEM(FE_AX, 0, 0, 8), FE_DX);               //save x86 addr
 
+    if (flag_do_profile) {
+        ///count pushes overwriting a valid entry
+        err |= fe_enc64(&current, FE_CMP64mi, FE_MEM_ADDR((intptr_t) &rs_used), rs_entries);
+        uint8_t *jmpNotFull = current;
+        err |= fe_enc64(&current, FE_JC, (intptr_t) current);                           //dummy
+        err |= fe_enc64(&current, FE_INC64m, FE_MEM_ADDR((intptr_t) get_ras_overflow_counter()));
+        uint8_t *jmpFull = current;
+        err |= fe_enc64(&current, FE_JMP, (intptr_t) current);                          //dummy
+        err |= fe_enc64(&jmpNotFull, FE_JC, (intptr_t) current);                        //replace dummy
+        err |= fe_enc64(&current, FE_INC64m, FE_MEM_ADDR((intptr_t) &rs_used));
+        err |= fe_enc64(&jmpFull, FE_JMP, (intptr_t) current);                          //replace dummy
+    }
+
     if(save_rax) {
         err |= fe_enc64(&current, FE_POPr, FE_AX);
     }
 
     //*/
-
-    NOT_CACHED:;
 }
 
 void rs_emit_pop_RAX(bool jump_or_push, const register_info *r_info) {   //true -> jump
@@ -143,9 +209,17 @@ void rs_emit_pop_RAX(bool jump_or_push, const register_info *r_info) {   //true
 
     uint8_t *nullJMPmiss = current;
     err |= fe_enc64(&current, FE_JNZ, (intptr_t) current);                              //dummy: miss jump
+    if (flag_do_profile) {
+        err |= fe_enc64(&current, FE_INC64m, FE_MEM_ADDR((intptr_t) get_ras_hit_counter()));
+        err |= fe_enc64(&current, FE_CMP64mi, FE_MEM_ADDR((intptr_t) &rs_used), 0);
+        uint8_t *jmpEmpty = current;
+        err |= fe_enc64(&current, FE_JZ, (intptr_t) current);                           //dummy
+        err |= fe_enc64(&current, FE_DEC64m, FE_MEM_ADDR((intptr_t) &rs_used));
+        err |= fe_enc64(&jmpEmpty, FE_JZ, (intptr_t) current);                          //replace dummy
+    }
     err |= fe_enc64(&current, FE_MOV32rm, FE_CX, FE_MEM_ADDR((intptr_t) &rs_front));    //reload front      ????optimize, load only once????
-    err |= fe_enc64(&current, FE_ADD64ri, FE_CX, 1023);                                 //-1 mod 64 (*16...)
-    err |= fe_enc64(&current, FE_AND64ri, FE_CX, 0x3f0);                                //-1 mod 64 (*16...)
+    err |= fe_enc64(&current, FE_ADD64ri, FE_CX, rs_mask + sizeof(rs_entry) - 1);     //-1 mod entries (*16...)
+    err |= fe_enc64(&current, FE_AND64ri, FE_CX, rs_mask);                              //-1 mod entries (*16...)
     err |= fe_enc64(&current, FE_MOV64mr, FE_MEM_ADDR((intptr_t) &rs_front), FE_CX);    //save rs_front
     err |= fe_enc64(&current, FE_MOV64rm, FE_CX, FE_MEM(FE_DX, 0, 0, 8));               // load x86 target
 
@@ -161,6 +235,10 @@ void rs_emit_pop_RAX(bool jump_or_push, const register_info *r_info) {   //true
     //replace miss dummy
     err |= fe_enc64(&nullJMPmiss, FE_JNZ, (intptr_t) current);
 
+    if (flag_do_profile) {
+        err |= fe_enc64(&current, FE_INC64m, FE_MEM_ADDR((intptr_t) get_ras_miss_counter()));
+    }
+
     if (!jump_or_push) {
         err |= fe_enc64(&current, FE_MOV64ri, FE_CX, 0);            //save target null: miss
         err |= fe_enc64(&current, FE_PUSHr, FE_CX);
@@ -181,3 +259,74 @@ void rs_jump_stack(const register_info *r_info) {
     err |= fe_enc64(&current, FE_JMPr, FE_CX);                  //jmp to next block
     err |= fe_enc64(&noJump, FE_JZ, (intptr_t) current);
 }
+
+/**
+ * Emit a guest call as host call on the shadow stack.
+ * The emitted code switches to the shadow stack, pushes the guest return address and calls the code emitted after
+ * this function, which switches back to the host stack. The caller then emits the jump to the call target there.
+ * The host return address pushed by the call leads to code placed in between, which is reached by the matching
+ * guest return: it pops the entry, switches back to the host stack and exits to the guest return address.
+ * Clobbers RCX and RDX, so RAX may hold the call target.
+ * @param ret_target the guest return address
+ * @param r_info the register mapping info
+ */
+void rs_emit_host_call(t_risc_addr ret_target, const register_info *r_info) {
+    invalidateAllReplacements(r_info);
+
+    ///switch to the shadow stack, RCX keeps the host stack pointer
+    err |= fe_enc64(&current, FE_MOV64rr, FE_CX, FE_SP);
+    err |= fe_enc64(&current, FE_MOV64rm, FE_SP, FE_MEM_ADDR((intptr_t) &rs_shadow_sp));
+    err |= fe_enc64(&current, FE_CMP64rm, FE_SP, FE_MEM_ADDR((intptr_t) &rs_shadow_limit));
+    uint8_t *jmpRoom = current;
+    err |= fe_enc64(&current, FE_JA, (intptr_t) current);                               //dummy
+    err |= fe_enc64(&current, FE_MOV64rm, FE_SP, FE_MEM_ADDR((intptr_t) &rs_shadow_top));   //full: drop all
+    if (flag_do_profile) {
+        err |= fe_enc64(&current, FE_INC64m, FE_MEM_ADDR((intptr_t) get_ras_overflow_counter()));
+    }
+    err |= fe_enc64(&jmpRoom, FE_JA, (intptr_t) current);                               //replace dummy
+
+    ///push the entry: guest return address, then the host return address by the call
+    err |= fe_enc64(&current, FE_MOV64ri, FE_DX, ret_target);
+    err |= fe_enc64(&current, FE_PUSHr, FE_DX);
+    uint8_t *call = current;
+    err |= fe_enc64(&current, FE_CALL, (intptr_t) current);                             //dummy
+
+    ///return: reached by the host ret of the guest return, with RCX holding the host stack pointer
+    err |= fe_enc64(&current, FE_ADD64ri, FE_SP, 8);                                    //pop guest return address
+    err |= fe_enc64(&current, FE_MOV64mr, FE_MEM_ADDR((intptr_t) &rs_shadow_sp), FE_SP);
+    err |= fe_enc64(&current, FE_MOV64rr, FE_SP, FE_CX);
+    emit_exit(ret_target, r_info);
+    err |= fe_enc64(&current, FE_RET);
+
+    ///call: switch back to the host stack
+    err |= fe_enc64(&call, FE_CALL, (intptr_t) current);                                //replace dummy
+    err |= fe_enc64(&current, FE_MOV64mr, FE_MEM_ADDR((intptr_t) &rs_shadow_sp), FE_SP);
+    err |= fe_enc64(&current, FE_MOV64rr, FE_SP, FE_CX);
+}
+
+/**
+ * Emit a guest return as host ret on the shadow stack, if the guest return address in RAX matches the top entry.
+ * Otherwise the emitted code falls through, leaving the shadow stack as is.
+ * Clobbers RCX.
+ * @param r_info the register mapping info
+ */
+void rs_emit_host_return_RAX(const register_info *r_info) {
+    invalidateAllReplacements(r_info);
+
+    err |= fe_enc64(&current, FE_MOV64rr, FE_CX, FE_SP);
+    err |= fe_enc64(&current, FE_MOV64rm, FE_SP, FE_MEM_ADDR((intptr_t) &rs_shadow_sp));
+    err |= fe_enc64(&current, FE_CMP64rm, FE_AX, FE_MEM(FE_SP, 0, 0, 8));
+    uint8_t *jmpMiss = current;
+    err |= fe_enc64(&current, FE_JNZ, (intptr_t) current);                              //dummy
+    if (flag_do_profile) {
+        err |= fe_enc64(&current, FE_INC64m, FE_MEM_ADDR((intptr_t) get_ras_hit_counter()));
+    }
+    err |= fe_enc64(&current, FE_RET);
+
+    ///miss: back to the host stack
+    err |= fe_enc64(&jmpMiss, FE_JNZ, (intptr_t) current);                              //replace dummy
+    if (flag_do_profile) {
+        err |= fe_enc64(&current, FE_INC64m, FE_MEM_ADDR((intptr_t) get_ras_miss_counter()));
+    }
+    err |= fe_enc64(&current, FE_MOV64rr, FE_SP, FE_CX);
+}
@@ -14,13 +14,20 @@ typedef struct {
 
 void init_return_stack(void);
 
+void clear_return_stack(void);
+
 void rs_emit_push(const t_risc_instr *instr, const register_info *r_info, bool save_rax);
 
 void rs_emit_pop_RAX(bool jump_or_push, const register_info *r_info);
 
 void rs_jump_stack(const register_info *r_info);
 
+void rs_emit_host_call(t_risc_addr ret_target, const register_info *r_info);
+
+void rs_emit_host_return_RAX(const register_info *r_info);
+
 extern rs_entry *r_stack;
 extern volatile uint32_t rs_front;
+extern uintptr_t rs_shadow_sp;
 
 #endif //DYNAMICBINARYTRANSLATORRISCV64_X86_64_RETURN_STACK_H
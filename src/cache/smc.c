@@ -0,0 +1,325 @@
+/**
+ * Detection of self-modifying code (--smc).
+ * Every guest page that contains translated instructions is write-protected. A write to such a page raises a
+ * SIGSEGV, whose handler invalidates all blocks translated from the page and restores the protection the page had
+ * before, before the faulting write is repeated. The blocks are translated again lazily on their next lookup,
+ * which also protects the page again.
+ *
+ * An invalidated block is removed from the cache table and tlb, and the exits chained to it are unlinked.
+ * Its code stays in place, as it may currently be executing (most likely, it contains the faulting write).
+ * Instead, its entry is redirected to a stub returning to the dispatcher, which catches the references
+ * that are not tracked (return stack entries, ...).
+ */
+
+#include "smc.h"
+#include <common.h>
+#include <linux/mman.h>
+#include <fadec/fadec-enc.h>
+#include <cache/cache.h>
+#include <cache/chain.h>
+#include <gen/translate.h>
+#include <env/flags.h>
+#include <env/exit.h>
+#include <util/log.h>
+#include <util/tools/profile.h>
+
+#define SMC_PAGE_SIZE 4096lu
+#define SMC_BUCKETS 1024
+#define INITIAL_RECORDS 4096
+
+//a block that was (partially) translated from a guest page
+typedef struct {
+    t_risc_addr page;
+    t_risc_addr block;
+    t_cache_loc cache_loc;
+    //protection of the page before it was write-protected
+    int prot;
+    //index + 1 of the next record in the same bucket, 0 for none
+    uint32_t next;
+} t_smc_record;
+
+static t_smc_record *records = NULL;
+static size_t records_size = INITIAL_RECORDS;
+static size_t count_records = 0;
+
+//index + 1 of the first record per bucket, 0 for none
+static uint32_t *record_buckets = NULL;
+
+static const register_info *smc_r_info = NULL;
+
+static inline size_t page_hash(t_risc_addr page) {
+    return (page / SMC_PAGE_SIZE) & (SMC_BUCKETS - 1);
+}
+
+static void smc_signal_handler(int signum, void *info, void *ucontext);
+
+/**
+ * Initialize the bookkeeping and install the SIGSEGV handler.
+ * @param c_info the context info, used for emitting the dispatcher stubs
+ */
+void init_smc(const context_info *c_info) {
+    smc_r_info = c_info->r_info;
+
+    records = mmap(NULL, records_size * sizeof(t_smc_record), PROT_READ | PROT_WRITE,
+                   MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    record_buckets = mmap(NULL, SMC_BUCKETS * sizeof(uint32_t), PROT_READ | PROT_WRITE,
+                          MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (BAD_ADDR(records) || BAD_ADDR(record_buckets)) {
+        dprintf(2, "Bad. SMC table memory allocation failed.");
+        panic(FAIL_HEAP_ALLOC);
+    }
+
+    struct kernel_sigaction action = {
+            .handler = (void *) (uintptr_t) &smc_signal_handler,
+            .flags = SA_SIGINFO
+    };
+    if (rt_sigaction(SIGSEGV, &action, NULL) != 0) {
+        dprintf(2, "Bad. Installing the SIGSEGV handler failed.");
+        panic(FAIL_INVALID_STATE);
+    }
+}
+
+static const t_smc_record *find_record(t_risc_addr page) {
+    for (uint32_t i = record_buckets[page_hash(page)]; i != 0; i = records[i - 1].next) {
+        if (records[i - 1].page == page) return &records[i - 1];
+    }
+    return NULL;
+}
+
+static inline int hex_digit(char c) {
+    return c <= '9' ? c - '0' : c - 'a' + 10;
+}
+
+/**
+ * Get the current protection of a guest page from /proc/self/maps.
+ * It was set by the ELF loader or the guest's mmap and mprotect, so it is not known otherwise.
+ * @param page the page address
+ * @return the protection, PROT_READ | PROT_WRITE if the page could not be found
+ */
+static int query_protection(t_risc_addr page) {
+    int prot = PROT_READ | PROT_WRITE;
+    int fd = open("/proc/self/maps", O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0) {
+        return prot;
+    }
+
+    ///lines start with "start-end perms", both addresses in hex
+    char buf[1024];
+    t_risc_addr start = 0;
+    t_risc_addr end = 0;
+    int field = 0;
+    int count_perms = 0;
+    int line_prot = 0;
+    bool found = false;
+    ssize_t count;
+    while (!found && (count = read(fd, buf, sizeof(buf))) > 0) {
+        for (ssize_t i = 0; i < count && !found; i++) {
+            char c = buf[i];
+            if (c == '\n') {
+                start = end = 0;
+                field = count_perms = line_prot = 0;
+                continue;
+            }
+            switch (field) {
+                case 0:
+                    if (c == '-') field = 1;
+                    else start = start * 16 + hex_digit(c);
+                    break;
+                case 1:
+                    if (c == ' ') field = 2;
+                    else end = end * 16 + hex_digit(c);
+                    break;
+                case 2:
+                    if (c == 'r') line_prot |= PROT_READ;
+                    if (c == 'w') line_prot |= PROT_WRITE;
+                    if (c == 'x') line_prot |= PROT_EXEC;
+                    if (++count_perms == 4) {
+                        field = 3;
+                        found = page >= start && page < end;
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+    close(fd);
+    return found ? line_prot : prot;
+}
+
+static void add_record(t_risc_addr page, t_risc_addr block, t_cache_loc cache_loc) {
+    const t_smc_record *existing = find_record(page);
+    int prot;
+    if (existing != NULL) {
+        prot = existing->prot;
+    } else {
+        ///pages that are not writable anyway keep their protection, guest stores to them must still fault
+        prot = query_protection(page);
+        if (prot & PROT_WRITE) {
+            log_cache("Write protecting guest page %p\n", (void *) page);
+            mprotect((void *) page, SMC_PAGE_SIZE, prot & ~PROT_WRITE);
+        }
+    }
+
+    if (count_records == records_size) {
+        ///double the table size
+        t_smc_record *copy_buf = mmap(NULL, 2 * records_size * sizeof(t_smc_record), PROT_READ | PROT_WRITE,
+                                      MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+        if (BAD_ADDR(copy_buf)) {
+            dprintf(2, "Bad. Memory allocation failed.\n");
+            panic(FAIL_HEAP_ALLOC);
+        }
+        memcpy(copy_buf, records, records_size * sizeof(t_smc_record));
+        munmap(records, records_size * sizeof(t_smc_record));
+        records = copy_buf;
+        records_size <<= 1u;
+    }
+
+    size_t bucket = page_hash(page);
+    records[count_records] = (t_smc_record) {page, block, cache_loc, prot, record_buckets[bucket]};
+    record_buckets[bucket] = ++count_records;
+}
+
+/**
+ * Record the guest pages a newly translated block was translated from and write-protect them.
+ * @param risc_addr the RISC-V address of the block
+ * @param cache_loc the cache location of the block
+ * @param instrs the parsed instructions of the block
+ * @param count the number of instructions
+ */
+void smc_register_block(t_risc_addr risc_addr, t_cache_loc cache_loc, const t_risc_instr *instrs, int count) {
+    t_risc_addr last_page = 1; //never a page address
+    for (int i = 0; i < count; i++) {
+        if (instrs[i].mnem == PC_NEXT_INST) continue;
+
+        t_risc_addr page = ALIGN_DOWN(instrs[i].addr, SMC_PAGE_SIZE);
+        if (page != last_page) {
+            add_record(page, risc_addr, cache_loc);
+            last_page = page;
+        }
+    }
+}
+
+/**
+ * Invalidate a block translated from a modified page, if it has not been invalidated yet.
+ */
+static void invalidate_block(t_risc_addr risc_addr, t_cache_loc cache_loc) {
+    if (lookup_cache_entry(risc_addr) != cache_loc) return;
+
+    log_cache("Invalidating block (riscv)%p at %p\n", (void *) risc_addr, cache_loc);
+    if (flag_do_profile) profile_smc_invalidation();
+
+    remove_cache_entry(risc_addr);
+    unlink_exits(risc_addr);
+
+    ///emit a stub that sets pc and returns to the dispatcher
+    int smc_err = 0;
+    uint8_t *saved_current = current;
+    current = currentPos;
+    uint8_t *stub = current;
+    if (smc_r_info->gp_mapped[pc]) {
+        smc_err |= fe_enc64(&current, FE_MOV64ri, smc_r_info->gp_map[pc], risc_addr);
+    } else {
+        smc_err |= fe_enc64(&current, FE_MOV64mi, FE_MEM_ADDR(smc_r_info->base + 8 * pc), risc_addr);
+    }
+    smc_err |= fe_enc64(&current, FE_RET);
+    currentPos = (void *) ALIGN_UP((uintptr_t) current, 16lu);
+    current = saved_current;
+
+    ///redirect the entry of the stale block to it
+    uint8_t *entry = cache_loc;
+    smc_err |= fe_enc64(&entry, FE_JMP | FE_JMPL, (intptr_t) stub);
+
+    if (smc_err != 0) {
+        dprintf(2, "Assembly error while invalidating a block.\n");
+        panic(FAIL_ASSEMBLY_ERR);
+    }
+}
+
+/**
+ * Redirect the entry of a block that got replaced, e.g. by a trace, to its replacement.
+ * Stale references to the block then follow the replacement if it gets invalidated.
+ * @param cache_loc the replaced block
+ * @param replacement the block replacing it
+ */
+void smc_redirect_block(t_cache_loc cache_loc, t_cache_loc replacement) {
+    uint8_t *entry = cache_loc;
+    if (fe_enc64(&entry, FE_JMP | FE_JMPL, (intptr_t) replacement) != 0) {
+        dprintf(2, "Assembly error while redirecting a block.\n");
+        panic(FAIL_ASSEMBLY_ERR);
+    }
+}
+
+/**
+ * Invalidate all blocks translated from the passed page and restore its protection.
+ * @param page the page address
+ * @return whether the page was write-protected by us, otherwise a write to it faults anyway
+ */
+static bool invalidate_page(t_risc_addr page) {
+    //stays 0 if the page has no records
+    int prot = 0;
+
+    uint32_t *link = &record_buckets[page_hash(page)];
+    while (*link != 0) {
+        t_smc_record *record = &records[*link - 1];
+        if (record->page == page) {
+            invalidate_block(record->block, record->cache_loc);
+            *link = record->next;
+            prot = record->prot;
+        } else {
+            link = &record->next;
+        }
+    }
+
+    if (!(prot & PROT_WRITE)) {
+        return false;
+    }
+    mprotect((void *) page, SMC_PAGE_SIZE, prot);
+    return true;
+}
+
+/**
+ * Invalidate the translations of a guest memory range that is about to be modified other than by a store,
+ * e.g. by a syscall or by remapping it.
+ * @param start the start of the range
+ * @param length the length of the range in bytes
+ */
+void smc_invalidate_range(t_risc_addr start, size_t length) {
+    if (records == NULL || length == 0) return;
+
+    for (t_risc_addr page = ALIGN_DOWN(start, SMC_PAGE_SIZE); page < start + length; page += SMC_PAGE_SIZE) {
+        invalidate_page(page);
+    }
+}
+
+/**
+ * Forget all records and restore the protection of the pages, e.g. because the code cache was flushed.
+ */
+void smc_reset(void) {
+    if (records == NULL) return;
+
+    for (size_t i = 0; i < SMC_BUCKETS; i++) {
+        for (uint32_t j = record_buckets[i]; j != 0; j = records[j - 1].next) {
+            if (records[j - 1].prot & PROT_WRITE) {
+                mprotect((void *) records[j - 1].page, SMC_PAGE_SIZE, records[j - 1].prot);
+            }
+        }
+    }
+    memset(record_buckets, 0, SMC_BUCKETS * sizeof(uint32_t));
+    count_records = 0;
+}
+
+static void
+smc_signal_handler(__attribute__((unused)) int signum, void *info, __attribute__((unused)) void *ucontext) {
+    //si_addr is the first field after the int si_signo, si_errno, si_code (and padding)
+    t_risc_addr fault_addr = (t_risc_addr) ((void **) info)[2];
+
+    if (flag_do_profile) profile_smc_fault();
+
+    if (!invalidate_page(ALIGN_DOWN(fault_addr, SMC_PAGE_SIZE))) {
+        ///not caused by our protection: restore the default action, so the repeated access terminates the process
+        dprintf(2, "Segmentation fault at %p.\n", (void *) fault_addr);
+        struct kernel_sigaction action = {.handler = SIG_DFL};
+        rt_sigaction(SIGSEGV, &action, NULL);
+    }
+}
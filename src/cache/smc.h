@@ -0,0 +1,28 @@
+#ifndef DYNAMICBINARYTRANSLATORRISCV64_X86_64_SMC_H
+#define DYNAMICBINARYTRANSLATORRISCV64_X86_64_SMC_H
+
+#include <util/typedefs.h>
+#include <main/context.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//size of the patchable entry of every block when self-modifying code detection is active
+#define SMC_ENTRY_SIZE 5
+
+void init_smc(const context_info *c_info);
+
+void smc_register_block(t_risc_addr risc_addr, t_cache_loc cache_loc, const t_risc_instr *instrs, int count);
+
+void smc_invalidate_range(t_risc_addr start, size_t length);
+
+void smc_redirect_block(t_cache_loc cache_loc, t_cache_loc replacement);
+
+void smc_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //DYNAMICBINARYTRANSLATORRISCV64_X86_64_SMC_H
@@ -8,6 +8,7 @@
 #include <linux/mman.h>
 #include <linux/fs.h>
 #include <env/exit.h>
+#include <util/arena.h>
 #include "loadElf.h"
 
 //Apparently not included in the headers on my version.
@@ -245,6 +246,63 @@ t_risc_elf_map_result mapIntoMemory(const char *filePath) {
             floatBinary};
 }
 
+t_risc_addr *readFunctionSymbols(const char *filePath, size_t *count) {
+    *count = 0;
+
+    int fd = open(filePath, O_RDONLY, 0);
+    if (fd <= 0) {
+        dprintf(2, "Could not open file, error %i\n", -fd);
+        return NULL;
+    }
+
+    Elf64_Ehdr header;
+    ssize_t bytes = read_full(fd, (void *) &header, sizeof(Elf64_Ehdr));
+    off_t offsetSh = bytes > 0 ? lseek(fd, header.e_shoff, SEEK_SET) : -1;
+    if (offsetSh < 0) {
+        dprintf(2, "Could not read section headers\n");
+        close(fd);
+        return NULL;
+    }
+
+    Elf64_Shdr symtab = {.sh_size = 0};
+    for (int i = 0; i < header.e_shnum; i++) {
+        Elf64_Shdr section;
+        ssize_t sectionBytes = read_full(fd, (void *) &section, sizeof(Elf64_Shdr));
+        if (sectionBytes <= 0) {
+            dprintf(2, "Could not read header for segment %i, error %li", i, -sectionBytes);
+            close(fd);
+            return NULL;
+        }
+        if (section.sh_type == SHT_SYMTAB) {
+            symtab = section;
+        }
+    }
+
+    //Stripped binaries have no symbol table.
+    size_t symbolCount = symtab.sh_size / sizeof(Elf64_Sym);
+    if (symbolCount == 0 || lseek(fd, symtab.sh_offset, SEEK_SET) < 0) {
+        close(fd);
+        return NULL;
+    }
+
+    Elf64_Sym *symbols = arena_alloc(&scratch_arena, symbolCount * sizeof(Elf64_Sym));
+    bytes = read_full(fd, (void *) symbols, symbolCount * sizeof(Elf64_Sym));
+    close(fd);
+    if (bytes <= 0) {
+        dprintf(2, "Could not read symbol table, error %li\n", -bytes);
+        return NULL;
+    }
+
+    t_risc_addr *addresses = arena_alloc(&scratch_arena, symbolCount * sizeof(t_risc_addr));
+    for (size_t i = 0; i < symbolCount; i++) {
+        if (ELF64_ST_TYPE(symbols[i].st_info) == STT_FUNC && symbols[i].st_value != 0) {
+            addresses[(*count)++] = symbols[i].st_value;
+        }
+    }
+
+    return addresses;
+}
+
 t_risc_addr allocateStack() {
 
     struct rlimit rlimit;
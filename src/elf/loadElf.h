@@ -43,6 +43,14 @@ typedef struct {
  */
 t_risc_elf_map_result mapIntoMemory(const char *filePath);
 
+/**
+ * Reads the addresses of the functions in the symbol table of the ELF file at the given path.
+ * @param filePath the path to the ELF file.
+ * @param count returns the number of addresses.
+ * @return the addresses, allocated from the scratch arena, or NULL if the file has no symbol table.
+ */
+t_risc_addr *readFunctionSymbols(const char *filePath, size_t *count);
+
 /**
  * Maps a stack for the program into memory and copies argc, argv, envp, and auxv onto it.
  * @param guestArgc the number of arguments passed on to the guest program.
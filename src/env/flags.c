@@ -19,8 +19,20 @@ bool flag_translate_opt_ras = true;
 bool flag_translate_opt_chain = true;
 bool flag_translate_opt_jump = true;
 bool flag_translate_opt_fusion = true;
+bool flag_translate_opt_ibl = true;
+bool flag_translate_opt_trace = true;
+bool flag_translate_opt_regalloc = true;
+bool flag_translate_opt_liveness = true;
+bool flag_translate_opt_propagate = true;
+bool flag_translate_opt_forward = true;
+bool flag_translate_opt_dispatch = true;
+bool flag_translate_opt_ecall = true;
+bool flag_translate_opt_decode_cache = true;
+bool flag_host_ras = false;
+bool flag_aot = false;
 bool flag_do_benchmark = false;
 bool flag_do_analyze_mnem = false;
 bool flag_do_analyze_reg = false;
 bool flag_do_analyze_pattern = false;
 bool flag_do_profile = false;
+bool flag_smc = false;
@@ -23,10 +23,22 @@ extern bool flag_translate_opt_ras;
 extern bool flag_translate_opt_chain;
 extern bool flag_translate_opt_jump;
 extern bool flag_translate_opt_fusion;
+extern bool flag_translate_opt_ibl;
+extern bool flag_translate_opt_trace;
+extern bool flag_translate_opt_regalloc;
+extern bool flag_translate_opt_liveness;
+extern bool flag_translate_opt_propagate;
+extern bool flag_translate_opt_forward;
+extern bool flag_translate_opt_dispatch;
+extern bool flag_translate_opt_ecall;
+extern bool flag_translate_opt_decode_cache;
+extern bool flag_host_ras;
+extern bool flag_aot;
 extern bool flag_do_benchmark;
 extern bool flag_do_analyze_mnem;
 extern bool flag_do_analyze_reg;
 extern bool flag_do_analyze_pattern;
 extern bool flag_do_profile;
+extern bool flag_smc;
 
 #endif //DYNAMICBINARYTRANSLATORRISCV64_X86_64_FLAGS_H
@@ -9,6 +9,14 @@
 #include <env/flags.h>
 
 int perfFd = -1;
+const char *persist_cache_dir = NULL;
+size_t code_cache_limit = 0;
+size_t tier_threshold = 1000;
+size_t ras_depth = 64;
+size_t block_length = 64;
+size_t trace_length = 512;
+size_t translate_ahead = 64;
+const char *register_map_path = NULL;
 
 static int open_perfmap(void) {
     int pid = getpid();
@@ -19,6 +27,19 @@ static int open_perfmap(void) {
     return open(filename, O_CREAT | O_TRUNC | O_NOFOLLOW | O_WRONLY | O_CLOEXEC, 0600);
 }
 
+/**
+ * Parse the decimal number at the start of the passed string.
+ * @param string the option value
+ * @return the parsed number, 0 if the string does not start with a digit
+ */
+static size_t parse_number(const char *string) {
+    size_t value = 0;
+    while (*string >= '0' && *string <= '9') {
+        value = value * 10 + (*string++ - '0');
+    }
+    return value;
+}
+
 t_opt_parse_result parse_cmd_arguments(int argc, char **argv) {
     char opt_char;
     int optind = 1;
@@ -108,6 +129,33 @@ t_opt_parse_result parse_cmd_arguments(int argc, char **argv) {
                             } else if (strncmp(option_string, "no-fusion", 9) == 0) {
                                 option_string += 9;
                                 flag_translate_opt_fusion = false;
+                            } else if (strncmp(option_string, "no-ibl", 6) == 0) {
+                                option_string += 6;
+                                flag_translate_opt_ibl = false;
+                            } else if (strncmp(option_string, "no-trace", 8) == 0) {
+                                option_string += 8;
+                                flag_translate_opt_trace = false;
+                            } else if (strncmp(option_string, "no-regalloc", 11) == 0) {
+                                option_string += 11;
+                                flag_translate_opt_regalloc = false;
+                            } else if (strncmp(option_string, "no-liveness", 11) == 0) {
+                                option_string += 11;
+                                flag_translate_opt_liveness = false;
+                            } else if (strncmp(option_string, "no-propagate", 12) == 0) {
+                                option_string += 12;
+                                flag_translate_opt_propagate = false;
+                            } else if (strncmp(option_string, "no-forward", 10) == 0) {
+                                option_string += 10;
+                                flag_translate_opt_forward = false;
+                            } else if (strncmp(option_string, "no-dispatch", 11) == 0) {
+                                option_string += 11;
+                                flag_translate_opt_dispatch = false;
+                            } else if (strncmp(option_string, "no-ecall", 8) == 0) {
+                                option_string += 8;
+                                flag_translate_opt_ecall = false;
+                            } else if (strncmp(option_string, "no-decode-cache", 15) == 0) {
+                                option_string += 15;
+                                flag_translate_opt_decode_cache = false;
                             } else if (strncmp(option_string, "singlestep", 10) == 0) {
                                 option_string += 10;
                                 flag_single_step = true;
@@ -117,6 +165,15 @@ t_opt_parse_result parse_cmd_arguments(int argc, char **argv) {
                                 flag_translate_opt_chain = false;
                                 flag_translate_opt_jump = false;
                                 flag_translate_opt_fusion = false;
+                                flag_translate_opt_ibl = false;
+                                flag_translate_opt_trace = false;
+                                flag_translate_opt_regalloc = false;
+                                flag_translate_opt_liveness = false;
+                                flag_translate_opt_propagate = false;
+                                flag_translate_opt_forward = false;
+                                flag_translate_opt_dispatch = false;
+                                flag_translate_opt_ecall = false;
+                                flag_translate_opt_decode_cache = false;
                             } else {
                                 if (strncmp(option_string, "help", 4) != 0) {
                                     dprintf(2, "Warning: Unknown optimization option %s...\n", option_string);
@@ -124,8 +181,17 @@ t_opt_parse_result parse_cmd_arguments(int argc, char **argv) {
                                 printf("Optimization options: --optimize=...\n"
                                        "\tno-ras\t\t\tDisable return address stack.\n"
                                        "\tno-chain\t\tDisable block chaining.\n"
-                                       "\tno-jump\t\t\tDisable recursive translation of jump targets.\n"
+                                       "\tno-jump\t\t\tDisable translating jump targets ahead.\n"
                                        "\tno-fusion\t\tDisable macro opcode fusion/conversion\n"
+                                       "\tno-ibl\t\t\tDisable inline indirect branch lookup.\n"
+                                       "\tno-trace\t\tDisable retranslating hot blocks as optimized traces.\n"
+                                       "\tno-regalloc\t\tDisable promoting registers per region in optimized traces.\n"
+                                       "\tno-liveness\t\tDisable skipping write-backs of dead registers.\n"
+                                       "\tno-propagate\tDisable constant/copy propagation and dead code elimination.\n"
+                                       "\tno-forward\t\tDisable redundant load/store elimination in optimized traces.\n"
+                                       "\tno-dispatch\t\tDisable the native dispatcher, return to the main loop after every block.\n"
+                                       "\tno-ecall\t\tDisable issuing frequent syscalls without a context switch.\n"
+                                       "\tno-decode-cache\tDisable reusing decoded RISC-V instructions.\n"
                                        "\tnone\t\t\tAll of the above.\n"
                                        "\tsinglestep\t\tEnable single stepping mode.\n"
                                        "\t\t\t\t\tTranslates each RISC-V instruction into its own block.\n");
@@ -133,6 +199,22 @@ t_opt_parse_result parse_cmd_arguments(int argc, char **argv) {
                                 return parse_result;
                             }
                         } while (*(option_string++) == ',');
+                    } else if (strncmp(option_string, "persist-cache=", 14) == 0) {
+                        persist_cache_dir = option_string + 14;
+                    } else if (strncmp(option_string, "cache-size=", 11) == 0) {
+                        code_cache_limit = parse_number(option_string + 11) << 20u;
+                    } else if (strncmp(option_string, "tier-threshold=", 15) == 0) {
+                        tier_threshold = parse_number(option_string + 15);
+                    } else if (strncmp(option_string, "block-length=", 13) == 0) {
+                        block_length = parse_number(option_string + 13);
+                    } else if (strncmp(option_string, "trace-length=", 13) == 0) {
+                        trace_length = parse_number(option_string + 13);
+                    } else if (strncmp(option_string, "translate-ahead=", 16) == 0) {
+                        translate_ahead = parse_number(option_string + 16);
+                    } else if (strncmp(option_string, "ras-depth=", 10) == 0) {
+                        ras_depth = parse_number(option_string + 10);
+                    } else if (strncmp(option_string, "register-map=", 13) == 0) {
+                        register_map_path = option_string + 13;
                     } else if (strncmp(option_string, "perf", 4) == 0) {
                         perfFd = open_perfmap();
                     } else if (strncmp(option_string, "help", 4) == 0) {
@@ -145,6 +227,12 @@ t_opt_parse_result parse_cmd_arguments(int argc, char **argv) {
                         flag_do_benchmark = true;
                     } else if (strncmp(option_string, "profile", 7) == 0) {
                         flag_do_profile = true;
+                    } else if (strncmp(option_string, "smc", 3) == 0) {
+                        flag_smc = true;
+                    } else if (strncmp(option_string, "host-ras", 8) == 0) {
+                        flag_host_ras = true;
+                    } else if (strncmp(option_string, "aot", 3) == 0) {
+                        flag_aot = true;
                     } else if (strncmp(option_string, "fail-silently", 13) == 0) {
                         flag_fail_silently = true;
                     } else if (strncmp(option_string, "analyze-all", 11) == 0) {
@@ -201,6 +289,15 @@ t_opt_parse_result parse_cmd_arguments(int argc, char **argv) {
                     flag_translate_opt_chain = false;
                     flag_translate_opt_ras = false;
                     flag_translate_opt_fusion = false;
+                    flag_translate_opt_ibl = false;
+                    flag_translate_opt_trace = false;
+                    flag_translate_opt_regalloc = false;
+                    flag_translate_opt_liveness = false;
+                    flag_translate_opt_propagate = false;
+                    flag_translate_opt_forward = false;
+                    flag_translate_opt_dispatch = false;
+                    flag_translate_opt_ecall = false;
+                    flag_translate_opt_decode_cache = false;
                     break;
                 case 'b':
                     flag_do_benchmark = true;
@@ -233,6 +330,39 @@ t_opt_parse_result parse_cmd_arguments(int argc, char **argv) {
                             "\t--perf\n"
                             "\t\tLog the generated blocks to /tmp/perf-<pid>.map for externally profiling\n"
                             "\t\tthe execution in perf.\n"
+                            "\t--persist-cache=<directory>\n"
+                            "\t\tStore the translated code in the given directory and reuse it\n"
+                            "\t\tin later runs of the same binary.\n"
+                            "\t--cache-size=<MiB>\n"
+                            "\t\tLimit the size of the translated code. The code cache is flushed\n"
+                            "\t\tcompletely when the limit is reached.\n"
+                            "\t--tier-threshold=<executions>\n"
+                            "\t\tRetranslate blocks with the optimizing tier after this many\n"
+                            "\t\texecutions (default 1000, 0 never retranslates).\n"
+                            "\t--block-length=<instructions>\n"
+                            "\t\tSplit blocks translated by the baseline tier after this many\n"
+                            "\t\tinstructions (default 64).\n"
+                            "\t--trace-length=<instructions>\n"
+                            "\t\tMaximum number of instructions of the traces the optimizing tier forms\n"
+                            "\t\tfrom hot blocks (default 512).\n"
+                            "\t--translate-ahead=<blocks>\n"
+                            "\t\tWhen translating a block, also translate up to this many of the blocks\n"
+                            "\t\tfound to follow it (default 64, 0 only translates blocks when reached).\n"
+                            "\t--ras-depth=<entries>\n"
+                            "\t\tNumber of entries of the return address stack, rounded up to a power of two\n"
+                            "\t\t(default 64).\n"
+                            "\t--register-map=<file>\n"
+                            "\t\tMap the guest registers to host registers as ranked in the given file.\n"
+                            "\t\tWith --profile, the file is (re)written with the profiled ranking.\n"
+                            "\t--smc\n"
+                            "\t\tDetect self-modifying code. Write-protects translated guest code\n"
+                            "\t\tand retranslates it after it was modified.\n"
+                            "\t--host-ras\n"
+                            "\t\tTranslate guest calls and returns to host calls and returns on a shadow stack,\n"
+                            "\t\tso they are predicted by the host. Replaces the return address stack.\n"
+                            "\t--aot\n"
+                            "\t\tTranslate all code reachable from the entry point and the function symbols\n"
+                            "\t\tbefore running the guest, so it runs without translation stalls.\n"
                             "\t-s, --fail-silently\n"
                             "\t\tFail silently for some error conditions.\n"
                             "\t\tAllows continued execution, but the client "
@@ -271,11 +401,24 @@ t_opt_parse_result parse_cmd_arguments(int argc, char **argv) {
                 flag_log_cache_contents, flag_log_syscall, flag_verbose_disassembly, flag_log_context);
     log_general("Fail silently: %d\n", flag_fail_silently);
     log_general("Single stepping: %d\n", flag_single_step);
-    log_general("Translate opt: ras %d, chaining %d, recurse jumps %d, fusion %d,singlestep %d\n",
-                flag_translate_opt_ras, flag_translate_opt_chain, flag_translate_opt_jump, flag_translate_opt_fusion, flag_single_step);
+    log_general("Translate opt: ras %d, chaining %d, recurse jumps %d, fusion %d, ibl %d, trace %d, regalloc %d, liveness %d, propagate %d, forward %d, dispatch %d, ecall %d, decode-cache %d, singlestep %d\n",
+                flag_translate_opt_ras, flag_translate_opt_chain, flag_translate_opt_jump, flag_translate_opt_fusion,
+                flag_translate_opt_ibl, flag_translate_opt_trace, flag_translate_opt_regalloc, flag_translate_opt_liveness,
+                flag_translate_opt_propagate, flag_translate_opt_forward, flag_translate_opt_dispatch,
+                flag_translate_opt_ecall, flag_translate_opt_decode_cache, flag_single_step);
     log_general("Do analyze: mnem %d, reg %d, pattern %d\n", flag_do_analyze_mnem, flag_do_analyze_reg, flag_do_analyze_pattern);
     log_general("Do benchmarking: %d\n", flag_do_benchmark);
     log_general("Do profiling: %d\n", flag_do_profile);
+    log_general("Persistent cache directory: %s\n", persist_cache_dir == NULL ? "none" : persist_cache_dir);
+    log_general("Code cache limit: %lu bytes\n", code_cache_limit);
+    log_general("Tier-up threshold: %lu executions\n", tier_threshold);
+    log_general("Block length limit: %lu instructions, in traces %lu\n", block_length, trace_length);
+    log_general("Translate ahead: %lu blocks\n", translate_ahead);
+    log_general("Return address stack depth: %lu entries\n", ras_depth);
+    log_general("Register mapping file: %s\n", register_map_path == NULL ? "none" : register_map_path);
+    log_general("Self-modifying code detection: %d\n", flag_smc);
+    log_general("Host return address stack: %d\n", flag_host_ras);
+    log_general("Ahead-of-time translation: %d\n", flag_aot);
     log_general("File path: %s\n", file_path);
 
     if (file_path == NULL) {
@@ -5,6 +5,14 @@
 #ifndef DYNAMICBINARYTRANSLATORRISCV64_X86_64_OPT_H
 #define DYNAMICBINARYTRANSLATORRISCV64_X86_64_OPT_H
 extern int perfFd;
+extern const char *persist_cache_dir;
+extern size_t code_cache_limit;
+extern size_t tier_threshold;
+extern size_t ras_depth;
+extern size_t block_length;
+extern size_t trace_length;
+extern size_t translate_ahead;
+extern const char *register_map_path;
 
 typedef struct {
     int status;
@@ -0,0 +1,225 @@
+/**
+ * Redundant load and store elimination within the blocks and traces of the optimizing tier.
+ * Like propagate.c, this pass rewrites the parsed instructions in place, before macro fusion:
+ * - A load of a location an earlier load of the block already read into a register, which is unchanged since, copies
+ *   that register instead (ADDI rd, rs, 0).
+ * - A load of a location the block stored a register to is forwarded the stored register, if the load needs at most
+ *   one instruction to extend it: LD after SD (ADDI), LW after SW (ADDIW), LHU/LBU after SH/SB (ANDI).
+ * - A store of an unchanged register to the location it was already stored to is dropped.
+ * Locations are identified by their base register and offset, so the base register must not change in between.
+ * A store through another base register may alias any location, and forgets all of them; stores through the same
+ * base register only forget the locations they overlap. Syscalls, fences and atomics forget everything.
+ * The rewritten loads mostly become dead then and are dropped by eliminate_dead_instructions() (see liveness.c).
+ */
+
+#include "forward.h"
+
+//locations tracked at once, the oldest one is forgotten first
+#define MAX_MEMORY_VALUES 16
+
+typedef struct {
+    //the load or store that accessed the location
+    t_risc_mnem mnem;
+    t_risc_reg base;
+    int64_t offset;
+    int size;
+    //the register holding the value loaded from or stored to the location
+    t_risc_reg value;
+} t_memory_value;
+
+typedef struct {
+    t_memory_value values[MAX_MEMORY_VALUES];
+    int count;
+} t_memory_state;
+
+static inline bool is_gp(t_risc_reg reg) {
+    return reg > x0 && reg <= x31;
+}
+
+static inline bool is_atomic(t_risc_mnem mnem) {
+    return mnem >= LRW && mnem <= AMOMAXUD;
+}
+
+/**
+ * Get the number of bytes accessed by the passed load or store, 0 for other instructions.
+ */
+static int get_access_size(t_risc_mnem mnem) {
+    switch (mnem) {
+        case LB:
+        case LBU:
+        case SB:
+            return 1;
+        case LH:
+        case LHU:
+        case SH:
+            return 2;
+        case LW:
+        case LWU:
+        case SW:
+        case FLW:
+        case FSW:
+            return 4;
+        case LD:
+        case SD:
+        case FLD:
+        case FSD:
+            return 8;
+        default:
+            return 0;
+    }
+}
+
+static void forget(t_memory_state *state, int index) {
+    for (int i = index + 1; i < state->count; i++) {
+        state->values[i - 1] = state->values[i];
+    }
+    state->count--;
+}
+
+/**
+ * Forget the locations whose base register or value register is overwritten by the passed register.
+ */
+static void forget_register(t_memory_state *state, t_risc_reg reg) {
+    if (!is_gp(reg)) return;
+    for (int i = state->count - 1; i >= 0; i--) {
+        if (state->values[i].base == reg || state->values[i].value == reg) forget(state, i);
+    }
+}
+
+/**
+ * Forget the locations the passed store may overwrite.
+ */
+static void forget_aliases(t_memory_state *state, t_risc_reg base, int64_t offset, int size) {
+    for (int i = state->count - 1; i >= 0; i--) {
+        const t_memory_value *known = &state->values[i];
+        if (known->base != base || (known->offset < offset + size && offset < known->offset + known->size)) {
+            forget(state, i);
+        }
+    }
+}
+
+static void remember(t_memory_state *state, const t_risc_instr *instr, t_risc_reg value) {
+    if (state->count == MAX_MEMORY_VALUES) forget(state, 0);
+    state->values[state->count++] = (t_memory_value) {
+            .mnem = instr->mnem, .base = instr->reg_src_1, .offset = instr->imm,
+            .size = get_access_size(instr->mnem), .value = value
+    };
+}
+
+static inline bool same_location(const t_memory_value *known, const t_risc_instr *instr) {
+    return known->base == instr->reg_src_1 && known->offset == instr->imm;
+}
+
+/**
+ * Rewrite the passed load into an instruction computing its result from the register holding the known content of
+ * the location.
+ * @return whether the load was rewritten
+ */
+static bool forward_load(t_risc_instr *load, const t_memory_state *state) {
+    for (int i = state->count - 1; i >= 0; i--) {
+        const t_memory_value *known = &state->values[i];
+        if (!same_location(known, load)) continue;
+
+        t_risc_mnem mnem;
+        int64_t imm = 0;
+        if (known->mnem == load->mnem || (known->mnem == SD && load->mnem == LD)) {
+            mnem = ADDI;
+        } else if (known->mnem == SW && load->mnem == LW) {
+            mnem = ADDIW;
+        } else if (known->mnem == SH && load->mnem == LHU) {
+            mnem = ANDI;
+            imm = 0xffff;
+        } else if (known->mnem == SB && load->mnem == LBU) {
+            mnem = ANDI;
+            imm = 0xff;
+        } else {
+            ///e.g. sign extending a stored byte needs two instructions
+            continue;
+        }
+
+        load->mnem = mnem;
+        load->optype = IMMEDIATE;
+        load->reg_src_1 = known->value;
+        load->reg_src_2 = INVALID_REG;
+        load->imm = imm;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Whether the passed store writes the register the location is already known to hold, with the same width.
+ */
+static bool is_redundant_store(const t_risc_instr *store, const t_memory_state *state) {
+    for (int i = 0; i < state->count; i++) {
+        const t_memory_value *known = &state->values[i];
+        if (same_location(known, store) && known->mnem == store->mnem && known->value == store->reg_src_2) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Eliminate the redundant loads and stores of the passed block, rewriting its instructions.
+ * @param instrs the parsed instructions of the block
+ * @param count the number of instructions
+ * @return the number of loads and stores eliminated
+ */
+int forward_memory_values(t_risc_instr *instrs, int count) {
+    t_memory_state state = {.count = 0};
+
+    int eliminated = 0;
+    for (int i = 0; i < count; i++) {
+        t_risc_instr *instr = &instrs[i];
+
+        if (instr->optype == SYSTEM || instr->optype == PSEUDO || instr->optype == INVALID_INSTRUCTION ||
+                instr->optype == INVALID_BLOCK || is_atomic(instr->mnem)) {
+            ///may access any memory (e.g. syscalls, fences), or end the block
+            state.count = 0;
+            continue;
+        }
+
+        int size = get_access_size(instr->mnem);
+        if (size == 0) {
+            if (instr->optype != STORE && instr->optype != BRANCH) forget_register(&state, instr->reg_dest);
+            continue;
+        }
+
+        if (instr->optype == FLOAT) {
+            ///the fp registers are not tracked, only the locations stored to are forgotten
+            if (instr->mnem == FSW || instr->mnem == FSD) {
+                forget_aliases(&state, instr->reg_src_1, instr->imm, size);
+            }
+            continue;
+        }
+
+        if (instr->optype == STORE) {
+            if (is_redundant_store(instr, &state)) {
+                instr->mnem = SILENT_NOP;
+                eliminated++;
+                continue;
+            }
+            forget_aliases(&state, instr->reg_src_1, instr->imm, size);
+            remember(&state, instr, instr->reg_src_2);
+            continue;
+        }
+
+        t_risc_reg rd = instr->reg_dest;
+        if (!is_gp(rd)) continue;
+        if (forward_load(instr, &state)) {
+            eliminated++;
+            if (instr->mnem == ADDI && instr->reg_src_1 == rd) {
+                ///the register still holds the content
+                instr->mnem = SILENT_NOP;
+            } else {
+                forget_register(&state, rd);
+            }
+            continue;
+        }
+        t_risc_reg base = instr->reg_src_1;
+        forget_register(&state, rd);
+        if (rd != base) remember(&state, instr, rd);
+    }
+    return eliminated;
+}
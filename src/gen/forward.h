@@ -0,0 +1,16 @@
+#ifndef DYNAMICBINARYTRANSLATORRISCV64_X86_64_FORWARD_H
+#define DYNAMICBINARYTRANSLATORRISCV64_X86_64_FORWARD_H
+
+#include <util/typedefs.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int forward_memory_values(t_risc_instr *instrs, int count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //DYNAMICBINARYTRANSLATORRISCV64_X86_64_FORWARD_H
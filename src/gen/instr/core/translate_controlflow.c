@@ -20,6 +20,9 @@ translate_controlflow_cmp_rs1_rs2(const t_risc_instr *instr, const register_info
 static inline void
 translate_controlflow_set_pc2(const t_risc_instr *instr, const register_info *r_info, uint8_t *jmpLoc, uint64_t mnem);
 
+static inline void
+translate_controlflow_lookup_RAX(void);
+
 
 void translate_JAL(const t_risc_instr *instr, const register_info *r_info) {
     log_asm_out("Translate JAL\n");
@@ -30,7 +33,7 @@ void translate_JAL(const t_risc_instr *instr, const register_info *r_info) {
     }
 
     ///push to return stack
-    if (flag_translate_opt_ras && (instr->reg_dest == x1 || instr->reg_dest == x5)) {
+    if (!flag_host_ras && flag_translate_opt_ras && (instr->reg_dest == x1 || instr->reg_dest == x5)) {
         rs_emit_push(instr, r_info, false);
     }
 
@@ -42,42 +45,25 @@ void translate_JAL(const t_risc_instr *instr, const register_info *r_info) {
             x0,
             x0,
             instr->reg_dest,
-            {{4}}
+            {{4}},
+            TRACE_NONE
     };
 
     translate_AUIPC(&aupicInstr, r_info);
 
     ///jump...
+    //afaik the "multiples of two" thing is resolved in parser.c
     t_risc_addr target = instr->addr + instr->imm;
 
-    t_cache_loc cache_loc;
-
     //potentially write back the register used by the translated AUIPC instruction above
     invalidateAllReplacements(r_info);
 
-    if (!flag_translate_opt_chain || (cache_loc = lookup_cache_entry(target)) == UNSEEN_CODE ||
-            cache_loc == TRANSLATION_STARTED) {
-        //afaik the "multiples of two" thing is resolved in parser.c
-
-        ///write chainEnd to be chained by chainer
-        if (flag_translate_opt_chain) {
-            err |= fe_enc64(&current, FE_LEA64rm, FE_AX, FE_MEM(FE_IP, 0, 0, 0));
-            err |= fe_enc64(&current, FE_MOV64mr, FE_MEM_ADDR((uint64_t) &chain_end), FE_AX);
-            err |= fe_enc64(&current, FE_MOV32mi, FE_MEM_ADDR((uint64_t) &chain_type), FE_JMP);
-        }
-
-        ///set pc
-        if (r_info->gp_mapped[pc]) {
-            err |= fe_enc64(&current, FE_MOV64ri, r_info->gp_map[pc],
-                            instr->addr + instr->imm);
-        } else {
-            err |= fe_enc64(&current, FE_MOV64mi, FE_MEM_ADDR(r_info->base + 8 * pc),
-                            instr->addr + instr->imm);
-        }
-    } else {
-        log_asm_out("DIRECT JUMP JAL\n");
-        err |= fe_enc64(&current, FE_JMP, (intptr_t) cache_loc);
+    ///call on the shadow stack
+    if (flag_host_ras && (instr->reg_dest == x1 || instr->reg_dest == x5)) {
+        rs_emit_host_call(instr->addr + 4, r_info);
     }
+
+    emit_exit(target, r_info);
 }
 
 void translate_JALR(const t_risc_instr *instr, const register_info *r_info) {
@@ -122,7 +108,15 @@ void translate_JALR(const t_risc_instr *instr, const register_info *r_info) {
     }
 
     ///3: check return stack
-    if (flag_translate_opt_ras) {
+    if (flag_host_ras) {
+        if (instr->reg_dest == x1 || instr->reg_dest == x5) {
+            ///call, also for pop and push (coroutine swap): the entry below stays for the return of the caller
+            rs_emit_host_call(instr->addr + 4, r_info);
+        } else if (instr->reg_src_1 == x1 || instr->reg_src_1 == x5) {
+            ///return, falls through on a mismatch
+            rs_emit_host_return_RAX(r_info);
+        }
+    } else if (flag_translate_opt_ras) {
 
         if (instr->reg_dest == x1 || instr->reg_dest == x5) {
             if (instr->reg_src_1 == x1 || instr->reg_src_1 == x5) {
@@ -158,30 +152,22 @@ void translate_JALR(const t_risc_instr *instr, const register_info *r_info) {
         t_risc_instr tmp_p_instr;
         tmp_p_instr.addr = instr->addr - 4;
 
-        parse_instruction(&tmp_p_instr);
+        parse_instruction_cached(&tmp_p_instr);
 
         t_risc_addr target = tmp_p_instr.addr + tmp_p_instr.imm + instr->imm;
 
-        t_cache_loc cache_loc;
-
-        if ((cache_loc = lookup_cache_entry(target)) == UNSEEN_CODE || cache_loc == TRANSLATION_STARTED) {
-            ///4: write chainEnd to be chained by chainer
-            log_asm_out("CHAIN JALR\n");
-            err |= fe_enc64(&current, FE_LEA64rm, FE_AX, FE_MEM(FE_IP, 0, 0, 0));
-            err |= fe_enc64(&current, FE_MOV64mr, FE_MEM_ADDR((uint64_t) &chain_end), FE_AX);
-            err |= fe_enc64(&current, FE_MOV32mi, FE_MEM_ADDR((uint64_t) &chain_type), FE_JMP);
-        } else {
-            log_asm_out("DIRECT JUMP JALR\n");
-            err |= fe_enc64(&current, FE_MOV64ri, FE_CX, (FeOp) cache_loc);
-            err |= fe_enc64(&current, FE_JMPr, FE_CX);
-        }
+        ///4: jump to the target block, the exit sets pc itself
+        log_asm_out("CHAIN JALR\n");
+        emit_exit(target, r_info);
+        return;
 
     } else {
         ///dont chain
         log_asm_out("DON'T CHAIN JALR\n");
-        if (flag_translate_opt_chain) {
-            err |= fe_enc64(&current, FE_MOV64mi, FE_MEM_ADDR((uint64_t) &chain_end), 0);
-            //no need to set chain type here
+
+        ///4: look the target up in the tlb and jump there directly if present
+        if (flag_translate_opt_ibl) {
+            translate_controlflow_lookup_RAX();
         }
     }
 
@@ -302,62 +288,86 @@ translate_controlflow_cmp_rs1_rs2(const t_risc_instr *instr, const register_info
     invalidateAllReplacements(r_info);
 }
 
+/**
+ * Get the conditional jump with the opposite condition.
+ */
+static inline uint64_t
+translate_controlflow_invert_jcc(uint64_t jmpMnem) {
+    switch (jmpMnem) {
+        case FE_JZ:
+            return FE_JNZ;
+        case FE_JNZ:
+            return FE_JZ;
+        case FE_JL:
+            return FE_JGE;
+        case FE_JGE:
+            return FE_JL;
+        case FE_JC:
+            return FE_JNC;
+        case FE_JNC:
+            return FE_JC;
+        default:
+            critical_not_yet_implemented("Unknown conditional jump");
+            return jmpMnem;
+    }
+}
+
 static inline void
 translate_controlflow_set_pc2(const t_risc_instr *instr, const register_info *r_info, uint8_t *noJmpLoc,
                               uint64_t jmpMnem) {
-    ///set pc: BRANCH
-    t_risc_addr target = instr->addr + instr->imm;
-    t_cache_loc cache_loc;
-    if (flag_translate_opt_chain && (cache_loc = lookup_cache_entry(target)) != UNSEEN_CODE &&
-            cache_loc != TRANSLATION_STARTED) {
-        log_asm_out("DIRECT JUMP BRANCH 1\n");
-        err |= fe_enc64(&current, FE_JMP, (intptr_t) cache_loc);
-    } else {
-        ///write chainEnd to be chained by chainer
-        if (flag_translate_opt_chain) {
-            err |= fe_enc64(&current, FE_LEA64rm, FE_AX, FE_MEM(FE_IP, 0, 0, 0));
-            err |= fe_enc64(&current, FE_MOV64mr, FE_MEM_ADDR((uint64_t) &chain_end), FE_AX);
-            err |= fe_enc64(&current, FE_MOV32mi, FE_MEM_ADDR((uint64_t) &chain_type), FE_JMP);
-        }
-
-        if (r_info->gp_mapped[pc]) {
-            err |= fe_enc64(&current, FE_MOV64ri, r_info->gp_map[pc], (instr->addr + ((int64_t) (instr->imm))));
-        } else {
-            err |= fe_enc64(&current, FE_MOV64mi, FE_MEM_ADDR(r_info->base + 8 * pc),
-                            instr->addr + (int64_t) instr->imm);
-        }
+    ///inside of traces only the unlikely direction exits, the other one continues behind the branch
+    if (instr->trace_follow == TRACE_TAKEN) {
+        defer_exit(noJmpLoc, jmpMnem, instr->addr + 4);
+        return;
+    } else if (instr->trace_follow == TRACE_NOT_TAKEN) {
+        defer_exit(noJmpLoc, translate_controlflow_invert_jcc(jmpMnem), instr->addr + instr->imm);
+        return;
     }
 
+    ///set pc: BRANCH
+    emit_exit(instr->addr + instr->imm, r_info);
+
     ///continue to ret after setting pc
     uint8_t *endJmpLoc = current;
     err |= fe_enc64(&current, FE_JMP, (intptr_t) current); //dummy jump
 
+    ///set pc: NO BRANCH, the conditional dummy is the exit's jump
+    emit_exit_at(noJmpLoc, jmpMnem, instr->addr + 4, r_info);
 
-    ///set pc: NO BRANCH
-    target = instr->addr + 4;
-
-    if (flag_translate_opt_chain && (cache_loc = lookup_cache_entry(target)) != UNSEEN_CODE &&
-            cache_loc != TRANSLATION_STARTED) {
-        log_asm_out("DIRECT JUMP BRANCH 2\n");
-        err |= fe_enc64(&noJmpLoc, jmpMnem|FE_JMPL, (intptr_t) cache_loc); //replace conditional dummy
-    } else {
-        err |= fe_enc64(&noJmpLoc, jmpMnem|FE_JMPL, (intptr_t) current); //replace conditional dummy
-
-        ///write chainEnd to be chained by chainer
-        if (flag_translate_opt_chain) {
-            err |= fe_enc64(&current, FE_MOV64ri, FE_AX, (uint64_t) (noJmpLoc - 6));
-            err |= fe_enc64(&current, FE_MOV64mr, FE_MEM_ADDR((uint64_t) &chain_end), FE_AX);
-            err |= fe_enc64(&current, FE_MOV32mi, FE_MEM_ADDR((uint64_t) &chain_type), jmpMnem);
-        }
+    err |= fe_enc64(&endJmpLoc, FE_JMP, (intptr_t) current); //replace dummy
+}
 
-        if (r_info->gp_mapped[pc]) {
-            err |= fe_enc64(&current, FE_MOV64ri, r_info->gp_map[pc], instr->addr + 4);
-        } else {
-            err |= fe_enc64(&current, FE_MOV64mi, FE_MEM_ADDR(r_info->base + 8 * pc), instr->addr + 4);
-        }
+/**
+ * Emit an inline lookup of the RISC-V target address in RAX in the tlb.
+ * On a hit the code jumps straight to the translated target block,
+ * on a miss it falls through so the target can be resolved by the dispatcher in the main loop.
+ * Clobbers RCX, so all replacement registers must have been invalidated before.
+ */
+static inline void
+translate_controlflow_lookup_RAX(void) {
+    ///tlb index: smallhash(target) * sizeof(t_cache_entry)
+    err |= fe_enc64(&current, FE_MOV32rr, FE_CX, FE_AX);
+    err |= fe_enc64(&current, FE_SHR32ri, FE_CX, 3);
+    err |= fe_enc64(&current, FE_AND32ri, FE_CX, SMALLTLB - 1);
+    err |= fe_enc64(&current, FE_SHL32ri, FE_CX, 4);
+    err |= fe_enc64(&current, FE_ADD64rm, FE_CX, FE_MEM_ADDR((intptr_t) &tlb));        //tlb base + index
+
+    ///compare risc addr of the entry with the target
+    err |= fe_enc64(&current, FE_CMP64rm, FE_AX, FE_MEM(FE_CX, 0, 0, 0));
+    uint8_t *jmpMiss = current;
+    err |= fe_enc64(&current, FE_JNZ, (intptr_t) current);                              //dummy: miss jump
+
+    ///hit: jump to cache loc of the entry
+    if (flag_do_profile) {
+        err |= fe_enc64(&current, FE_INC64m, FE_MEM_ADDR((intptr_t) get_ibl_hit_counter()));
     }
+    err |= fe_enc64(&current, FE_JMPm, FE_MEM(FE_CX, 0, 0, 8));
 
-    err |= fe_enc64(&endJmpLoc, FE_JMP, (intptr_t) current); //replace dummy
+    ///miss: continue with setting pc and return to the dispatcher
+    err |= fe_enc64(&jmpMiss, FE_JNZ, (intptr_t) current);                              //replace dummy
+    if (flag_do_profile) {
+        err |= fe_enc64(&current, FE_INC64m, FE_MEM_ADDR((intptr_t) get_ibl_miss_counter()));
+    }
 }
 
 void translate_INVALID(const t_risc_instr *instr, const register_info *r_info) {
@@ -166,4 +166,6 @@ void translate_MANUAL_CSRR(const t_risc_instr *instr, const register_info *r_inf
     //emit c_info->load_execute_save_context(*, false); //* means value does not matter, false means load without execute
     err |= fe_enc64(&current, FE_XOR32rr, FE_SI, FE_SI);
     err |= fe_enc64(&current, FE_CALL, (intptr_t) c_info->load_execute_save_context);
+    //the fp registers were stored by save_context, and are likely used next (e.g. after reading fflags)
+    emit_load_fp_context(c_info);
 }
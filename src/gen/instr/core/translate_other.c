@@ -4,6 +4,210 @@
 
 #include "translate_other.h"
 #include <runtime/emulateEcall.h>
+#include <env/flags.h>
+#include <util/util.h>
+#include <common.h>
+#include <util/tools/profile.h>
+
+/**
+ * Syscalls issued directly by the translated code, without switching the context to emulate_ecall().
+ * These are passed through to the host unchanged and touch no translator state, so only the argument and result
+ * registers need to be shuffled (see emit_host_syscall()).
+ */
+typedef struct {
+    bool fast;
+    int host_number;
+    int args;
+    //whether the syscall writes guest memory, which needs to invalidate translated code in it first with --smc
+    bool writes_memory;
+} t_fast_syscall;
+
+#define FAST_SYSCALL_TABLE_SIZE 179
+
+static const t_fast_syscall fast_syscalls[FAST_SYSCALL_TABLE_SIZE] = {
+        [62] = {true, __NR_lseek, 3, false},
+        [63] = {true, __NR_read, 3, true},
+        [64] = {true, __NR_write, 3, false},
+        [113] = {true, __NR_clock_gettime, 2, true},
+        [169] = {true, __NR_gettimeofday, 2, true},
+        [172] = {true, __NR_getpid, 0, false},
+        [174] = {true, __NR_getuid, 0, false},
+        [175] = {true, __NR_geteuid, 0, false},
+        [176] = {true, __NR_getgid, 0, false},
+        [177] = {true, __NR_getegid, 0, false},
+        [178] = {true, __NR_gettid, 0, false},
+};
+
+//code of the fast syscalls in the routine generated by emit_fast_ecall_dispatch(), indexed by the guest number
+static t_cache_loc fast_ecall_table[FAST_SYSCALL_TABLE_SIZE];
+
+int64_t ecall_syscall_number = UNKNOWN_SYSCALL;
+
+static bool is_fast_syscall(int64_t number) {
+    if (!flag_translate_opt_ecall || flag_log_syscall) return false;
+    if (number < 0 || number >= FAST_SYSCALL_TABLE_SIZE || !fast_syscalls[number].fast) return false;
+    return !fast_syscalls[number].writes_memory || !flag_smc;
+}
+
+/**
+ * Find the syscall number of the ECALL at the passed position, if it is set by a li a7 earlier in the block.
+ * @param instrs the instructions of the block
+ * @param ecall_pos the position of the ECALL
+ * @return the syscall number, or UNKNOWN_SYSCALL
+ */
+int64_t find_syscall_number(const t_risc_instr *instrs, int ecall_pos) {
+    for (int i = ecall_pos - 1; i >= 0; i--) {
+        const t_risc_instr *instr = &instrs[i];
+        if (instr->mnem == PATTERN_EMIT) {
+            //the fused sequence may write a7 in any of its instructions
+            return UNKNOWN_SYSCALL;
+        }
+        if (instr->reg_dest != (t_risc_reg) a7) continue;
+        if ((instr->mnem == ADDI && instr->reg_src_1 == x0) || instr->mnem == LUI) {
+            //LUI also holds the full value of constants loaded by the block optimizations (see propagate.c)
+            return instr->imm;
+        }
+        return UNKNOWN_SYSCALL;
+    }
+    return UNKNOWN_SYSCALL;
+}
+
+static void load_guest_register(FeReg dest, t_risc_reg reg, const register_info *r_info) {
+    if (r_info->gp_mapped[reg]) {
+        err |= fe_enc64(&current, FE_MOV64rr, dest, r_info->gp_map[reg]);
+    } else {
+        err |= fe_enc64(&current, FE_MOV64rm, dest, FE_MEM_ADDR(r_info->base + 8 * reg));
+    }
+}
+
+/**
+ * Get the address of the pointer to the vDSO function serving the passed fast syscall in process, or 0 if it has to
+ * enter the kernel.
+ * The vDSO is mapped at a random address on every run, so the translated code calls through the pointer, which is
+ * at a fixed address, and stays valid for the persistent cache.
+ */
+static uintptr_t get_vdso_pointer(int64_t number) {
+    switch (number) {
+        case 113:
+            return vdso_clock_gettime != NULL ? (uintptr_t) &vdso_clock_gettime : 0;
+        case 169:
+            return vdso_gettimeofday != NULL ? (uintptr_t) &vdso_gettimeofday : 0;
+        default:
+            return 0;
+    }
+}
+
+/**
+ * Emit a call of the vDSO function the passed pointer points to with the two arguments in a0 and a1, moving its
+ * result to a0.
+ * The caller-saved host registers holding mapped guest registers are preserved on the stack.
+ * Not usable while the fp registers may hold guest values, as they are caller-saved as well.
+ */
+static void emit_vdso_call(uintptr_t pointer, const register_info *r_info) {
+    static const FeReg saved[] = {FE_R11, FE_R10, FE_R9, FE_R8, FE_DI, FE_SI};
+    for (size_t i = 0; i < sizeof(saved) / sizeof(saved[0]); i++) {
+        err |= fe_enc64(&current, FE_PUSHr, saved[i]);
+    }
+
+    ///a1 goes through RCX, as RSI may be the source of a0 and RDI the source of a1
+    load_guest_register(FE_CX, (t_risc_reg) a1, r_info);
+    load_guest_register(FE_DI, (t_risc_reg) a0, r_info);
+    err |= fe_enc64(&current, FE_MOV64rr, FE_SI, FE_CX);
+
+    ///align the stack for the call, keeping the old stack pointer on it
+    err |= fe_enc64(&current, FE_MOV64rr, FE_AX, FE_SP);
+    err |= fe_enc64(&current, FE_AND64ri, FE_SP, 0xFFFFFFFFFFFFFFF0);
+    err |= fe_enc64(&current, FE_PUSHr, FE_AX);
+    err |= fe_enc64(&current, FE_SUB64ri, FE_SP, 8);
+    err |= fe_enc64(&current, FE_CALLm, FE_MEM_ADDR(pointer));
+    err |= fe_enc64(&current, FE_MOV64rm, FE_SP, FE_MEM(FE_SP, 0, 0, 8));
+
+    for (size_t i = sizeof(saved) / sizeof(saved[0]); i > 0; i--) {
+        err |= fe_enc64(&current, FE_POPr, saved[i - 1]);
+    }
+
+    ///the result is an int
+    err |= fe_enc64(&current, FE_MOVSXr64r32, FE_AX, FE_AX);
+    if (r_info->gp_mapped[a0]) {
+        err |= fe_enc64(&current, FE_MOV64rr, r_info->gp_map[a0], FE_AX);
+    } else {
+        err |= fe_enc64(&current, FE_MOV64mr, FE_MEM_ADDR(r_info->base + 8 * a0), FE_AX);
+    }
+}
+
+/**
+ * Emit a fast syscall: move the guest's arguments to the host's argument registers, issue the host syscall and
+ * move the result to a0. The host registers used for arguments, as well as R11 clobbered by syscall, may hold
+ * mapped guest registers, so they are preserved on the stack.
+ * The time syscalls call the vDSO instead, unless the guest uses the fp registers.
+ * The replacement registers must have been invalidated before.
+ */
+static void emit_host_syscall(int64_t number, const register_info *r_info, bool floatBinary) {
+    uintptr_t vdso_pointer = floatBinary ? 0 : get_vdso_pointer(number);
+    if (vdso_pointer != 0) {
+        emit_vdso_call(vdso_pointer, r_info);
+        return;
+    }
+
+    const t_fast_syscall *call = &fast_syscalls[number];
+
+    err |= fe_enc64(&current, FE_PUSHr, FE_R11);
+    if (call->args >= 1) err |= fe_enc64(&current, FE_PUSHr, FE_DI);
+    if (call->args >= 2) err |= fe_enc64(&current, FE_PUSHr, FE_SI);
+
+    ///a1 goes through RCX, as RSI may be the source of a0 and RDI the source of a1
+    if (call->args >= 3) load_guest_register(FE_DX, (t_risc_reg) a2, r_info);
+    if (call->args >= 2) load_guest_register(FE_CX, (t_risc_reg) a1, r_info);
+    if (call->args >= 1) load_guest_register(FE_DI, (t_risc_reg) a0, r_info);
+    if (call->args >= 2) err |= fe_enc64(&current, FE_MOV64rr, FE_SI, FE_CX);
+
+    err |= fe_enc64(&current, FE_MOV32ri, FE_AX, call->host_number);
+    err |= fe_enc64(&current, FE_SYSCALL);
+
+    if (call->args >= 2) err |= fe_enc64(&current, FE_POPr, FE_SI);
+    if (call->args >= 1) err |= fe_enc64(&current, FE_POPr, FE_DI);
+    err |= fe_enc64(&current, FE_POPr, FE_R11);
+
+    if (r_info->gp_mapped[a0]) {
+        err |= fe_enc64(&current, FE_MOV64rr, r_info->gp_map[a0], FE_AX);
+    } else {
+        err |= fe_enc64(&current, FE_MOV64mr, FE_MEM_ADDR(r_info->base + 8 * a0), FE_AX);
+    }
+}
+
+/**
+ * Emit the routine issuing the fast syscalls whose number is only known at runtime, see context.c.
+ * It dispatches on a7 through a jump table, and returns with AL set if it issued the syscall,
+ * or cleared if it has to be emulated by emulate_ecall().
+ * @param r_info the runtime register mapping (RISC-V -> x86)
+ * @param floatBinary whether the guest uses the fp registers
+ */
+void emit_fast_ecall_dispatch(const register_info *r_info, bool floatBinary) {
+    load_guest_register(FE_AX, (t_risc_reg) a7, r_info);
+    err |= fe_enc64(&current, FE_CMP64ri, FE_AX, FAST_SYSCALL_TABLE_SIZE);
+    uint8_t *jmpNotFast = current;
+    err |= fe_enc64(&current, FE_JNC | FE_JMPL, (intptr_t) current);             //dummy
+    err |= fe_enc64(&current, FE_LEA64rm, FE_CX, FE_MEM_ADDR((intptr_t) fast_ecall_table));
+    err |= fe_enc64(&current, FE_JMPm, FE_MEM(FE_CX, 8, FE_AX, 0));
+
+    for (int64_t number = 0; number < FAST_SYSCALL_TABLE_SIZE; number++) {
+        if (!is_fast_syscall(number)) continue;
+        fast_ecall_table[number] = current;
+        if (flag_do_profile) {
+            err |= fe_enc64(&current, FE_INC64m, FE_MEM_ADDR((intptr_t) get_fast_ecall_counter()));
+        }
+        emit_host_syscall(number, r_info, floatBinary);
+        err |= fe_enc64(&current, FE_MOV32ri, FE_AX, 1);
+        err |= fe_enc64(&current, FE_RET);
+    }
+
+    ///not fast: emulate
+    err |= fe_enc64(&jmpNotFast, FE_JNC | FE_JMPL, (intptr_t) current);          //replace dummy
+    for (int64_t number = 0; number < FAST_SYSCALL_TABLE_SIZE; number++) {
+        if (!is_fast_syscall(number)) fast_ecall_table[number] = current;
+    }
+    err |= fe_enc64(&current, FE_XOR32rr, FE_AX, FE_AX);
+}
 
 /**
 * Translate the FENCE instruction.
@@ -18,6 +222,9 @@ void translate_FENCE(const t_risc_instr *instr, const register_info *r_info) {
 /**
 * Translate the ECALL instruction.
 * Makes a system call to the execution environment.
+* Frequent syscalls that are passed through to the host are issued directly, without the context switch:
+* inline if the syscall number is known at translation time (see find_syscall_number()), else through the routine
+* dispatching on a7 at runtime (see emit_fast_ecall_dispatch()).
 * @param instr the RISC-V instruction to translate
 * @param r_info the runtime register mapping (RISC-V -> x86)
 */
@@ -26,6 +233,34 @@ void translate_ECALL(const t_risc_instr *instr, const register_info *r_info, con
     log_asm_out("Translate ECALL...\n");
 
     invalidateAllReplacements(r_info);
+
+    if (is_fast_syscall(ecall_syscall_number)) {
+        log_asm_out("Fast syscall %li\n", ecall_syscall_number);
+        if (flag_do_profile) {
+            err |= fe_enc64(&current, FE_INC64m, FE_MEM_ADDR((intptr_t) get_fast_ecall_counter()));
+        }
+        emit_host_syscall(ecall_syscall_number, r_info, c_info->load_fp_context != NULL);
+        ///the syscall does not change the control flow, so the exit can be chained
+        emit_exit(instr->addr + 4, r_info);
+        return;
+    }
+
+    uint8_t *jmpDone = NULL;
+    if (c_info->fast_ecall != NULL) {
+        err |= fe_enc64(&current, FE_CALL, (intptr_t) c_info->fast_ecall);
+        err |= fe_enc64(&current, FE_TEST8rr, FE_AX, FE_AX);
+        uint8_t *jmpEmulate = current;
+        err |= fe_enc64(&current, FE_JZ, (intptr_t) current);                    //dummy
+        if (r_info->gp_mapped[pc]) {
+            err |= fe_enc64(&current, FE_MOV64ri, r_info->gp_map[pc], instr->addr + 4);
+        } else {
+            err |= fe_enc64(&current, FE_MOV64mi, FE_MEM_ADDR(r_info->base + 8 * pc), instr->addr + 4);
+        }
+        jmpDone = current;
+        err |= fe_enc64(&current, FE_JMP | FE_JMPL, (intptr_t) current);        //dummy
+        err |= fe_enc64(&jmpEmulate, FE_JZ, (intptr_t) current);                 //replace dummy
+    }
+
     //emit c_info->save_context();
     err |= fe_enc64(&current, FE_CALL, (intptr_t) c_info->save_context);
     //emit emulate_ecall(instr->addr, r_info->base);
@@ -37,6 +272,10 @@ void translate_ECALL(const t_risc_instr *instr, const register_info *r_info, con
     //emit c_info->load_execute_save_context(*, false); //* means value does not matter, false means load without execute
     err |= fe_enc64(&current, FE_XOR32rr, FE_SI, FE_SI);
     err |= fe_enc64(&current, FE_CALL, (intptr_t) c_info->load_execute_save_context);
+
+    if (jmpDone != NULL) {
+        err |= fe_enc64(&jmpDone, FE_JMP | FE_JMPL, (intptr_t) current);        //replace dummy
+    }
 }
 
 /**
@@ -51,10 +290,28 @@ void translate_EBREAK(const t_risc_instr *instr, const register_info *r_info) {
 
 /**
 * Translate the FENCE_I instruction.
-* Description
+* Synchronizes the instruction and data streams, so the guest sees its own modifications of code afterwards.
+* FENCE_I always ends the block (see parse_block()).
+* With --smc, modified code has already been invalidated by the write faults, so the block simply exits.
+* Otherwise, the whole code cache is flushed by the main loop before the next block runs.
 * @param instr the RISC-V instruction to translate
 * @param r_info the runtime register mapping (RISC-V -> x86)
 */
 void translate_FENCE_I(const t_risc_instr *instr, const register_info *r_info) {
-    critical_not_yet_implemented("Invalid FENCE_I translation call");
+    log_asm_out("Translate FENCE_I...\n");
+
+    invalidateAllReplacements(r_info);
+
+    if (flag_smc) {
+        emit_exit(instr->addr + 4, r_info);
+        return;
+    }
+
+    ///request the flush and return to the dispatcher without chaining
+    err |= fe_enc64(&current, FE_MOV8mi, FE_MEM_ADDR((intptr_t) &code_cache_flush_requested), 1);
+    if (r_info->gp_mapped[pc]) {
+        err |= fe_enc64(&current, FE_MOV64ri, r_info->gp_map[pc], instr->addr + 4);
+    } else {
+        err |= fe_enc64(&current, FE_MOV64mi, FE_MEM_ADDR(r_info->base + 8 * pc), instr->addr + 4);
+    }
 }
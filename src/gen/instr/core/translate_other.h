@@ -9,6 +9,16 @@
 #include "gen/translate.h"
 #include <util/typedefs.h>
 
+//syscall number of an ECALL not known at translation time
+#define UNKNOWN_SYSCALL (-1)
+
+//the syscall number of the ECALL currently translated, see find_syscall_number()
+extern int64_t ecall_syscall_number;
+
+int64_t find_syscall_number(const t_risc_instr *instrs, int ecall_pos);
+
+void emit_fast_ecall_dispatch(const register_info *r_info, bool floatBinary);
+
 void translate_FENCE(const t_risc_instr *instr, const register_info *r_info);
 
 void translate_ECALL(const t_risc_instr *instr, const register_info *r_info, const context_info *c_info);
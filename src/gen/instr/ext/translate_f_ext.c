@@ -21,9 +21,9 @@
  */
 void translate_FLW(const t_risc_instr *instr, const register_info *r_info) {
     log_asm_out("Translate FLW...\n");
-    FeReg regSrc1 = getRs1(instr, r_info);
+    FeOp address = getMemOperand(instr, r_info);
     FeReg regDest = getFpRegNoLoad((t_risc_fp_reg) instr->reg_dest, r_info, FIRST_FP_REG);
-    err |= fe_enc64(&current, FE_SSE_MOVSSrm, regDest, FE_MEM(regSrc1, 0, 0, instr->imm));
+    err |= fe_enc64(&current, FE_SSE_MOVSSrm, regDest, address);
     setFpReg((t_risc_fp_reg) instr->reg_dest, r_info, regDest);
 }
 
@@ -36,9 +36,9 @@ void translate_FLW(const t_risc_instr *instr, const register_info *r_info) {
  */
 void translate_FSW(const t_risc_instr *instr, const register_info *r_info) {
     log_asm_out("Translate FSW...\n");
-    FeReg regSrc1 = getRs1(instr, r_info);
+    FeOp address = getMemOperand(instr, r_info);
     FeReg regSrc2 = getFpReg((t_risc_fp_reg) instr->reg_src_2, r_info, FIRST_FP_REG);
-    err |= fe_enc64(&current, FE_SSE_MOVSSmr, FE_MEM(regSrc1, 0, 0, instr->imm), regSrc2);
+    err |= fe_enc64(&current, FE_SSE_MOVSSmr, address, regSrc2);
 }
 
 /**
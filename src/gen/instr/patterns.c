@@ -14,17 +14,18 @@
  * ----1: elements:-----
  * Element fields:
  *  mnem : mnem
- *  rs1, rs2, rd :
- *      rs1_h1 means, that rs1 of the instruction
- *      has to be the same as in the instruction at
- *      the position stored in h1. (block_cache[pattern_start + h1]).
- *      rs2, rd work the same. all are also available with h2.
+ *  rs1, rs2, rd, imm : constraints on the field of the instruction
+ *      P_ANY                  : any value
+ *      P_IS(v)                : the value v (a register for rs1, rs2, rd)
+ *      P_SAME(pos, field)     : the same value as the field (F_RS1, F_RS2, F_RD, F_IMM) of the instruction at
+ *                               position pos of the pattern (block_cache[pattern_start + pos])
+ *      P_NOT_SAME(pos, field) : a different value than that field
  *
  *      Example:
  *      pattern_element jsjfbefjb[] = {
  *          {.....},
  *          {.....},
- *          {ADDI, rd_h1, DONT_CARE, rs1_h2, 1, 0, 1, 32}
+ *          {ADDI, P_SAME(1, F_RD), P_ANY, P_SAME(0, F_RS1), P_IS(32)}
  *      };
  *
  *      In this example, rs1 of the 3rd instruction has to be
@@ -32,16 +33,7 @@
  *      and rd has to be the same register as rs1 of the first instruction.
  *      The immediate has to be 32.
  *
- *      NOTE: not all options are implemented for every field yet
- *            (to avoid unnecessary comparisons in matcher).
- *            Do so in the switch-case under the corresponding comments (e.g. "rs1 match") in optimize.c
- *
- *  h1, h2 : helper variables
- *
- *  imm :
- *      0 = dont care ;
- *      1 = value has to be equal to imm_value ;
- *      2 = value has to be equal to immediate of (block_cache[pattern_start + h1])
+ *      Every constraint is available for every field, the matcher (optimize.c) needs no changes.
  *
  * ----2: emitter function:-----
  * Emits the x86 equivalent of the pattern.
@@ -52,121 +44,134 @@
 
 
 const pattern_element p_0_elem[] = {
-        {LUI,  DONT_CARE, DONT_CARE, DONT_CARE, 0, 0, 0, 0},
-        {LD,   rd_h1,     DONT_CARE, DONT_CARE, 0, 0, 0, 0},
-        {ADDI, rd_h1,     DONT_CARE, rd_h1,     1, 0, 0, 0},
-        {SD,   rd_h2,     rd_h1,     DONT_CARE, 1, 0, 2, 1}
+        {LUI,  P_ANY,           P_ANY,           P_ANY,           P_ANY},
+        {LD,   P_SAME(0, F_RD), P_ANY,           P_ANY,           P_ANY},
+        {ADDI, P_SAME(1, F_RD), P_ANY,           P_SAME(1, F_RD), P_ANY},
+        {SD,   P_SAME(0, F_RD), P_SAME(1, F_RD), P_ANY,           P_SAME(1, F_IMM)}
 };
 
 const pattern_element p_1_elem[] = {
-        {LUI,   DONT_CARE, DONT_CARE, DONT_CARE, 0, 0, 0, 0},
-        {LW,    rd_h1,     DONT_CARE, DONT_CARE, 0, 0, 0, 0},
-        {ADDIW, rd_h1,     DONT_CARE, rd_h1,     1, 0, 0, 0},
-        {SW,    rd_h2,     rd_h1,     DONT_CARE, 1, 0, 2, 1}
+        {LUI,   P_ANY,           P_ANY,           P_ANY,           P_ANY},
+        {LW,    P_SAME(0, F_RD), P_ANY,           P_ANY,           P_ANY},
+        {ADDIW, P_SAME(1, F_RD), P_ANY,           P_SAME(1, F_RD), P_ANY},
+        {SW,    P_SAME(0, F_RD), P_SAME(1, F_RD), P_ANY,           P_SAME(1, F_IMM)}
 };
 
 const pattern_element p_2_elem[] = {
-        {AUIPC, DONT_CARE, DONT_CARE, DONT_CARE, 0, 0, 0, 0},
-        {ADDI,  rd_h1,     DONT_CARE, DONT_CARE, 0, 0, 0, 0},
-        {LW,    rd_h1,     DONT_CARE, DONT_CARE, 1, 0, 0, 0},
-        {ADDIW, rd_h1,     DONT_CARE, DONT_CARE, 2, 0, 0, 0},
-        {SW,    rd_h1,     rd_h2,     DONT_CARE, 0, 3, 2, 2}
+        {AUIPC, P_ANY,           P_ANY,           P_ANY, P_ANY},
+        {ADDI,  P_SAME(0, F_RD), P_ANY,           P_ANY, P_ANY},
+        {LW,    P_SAME(1, F_RD), P_ANY,           P_ANY, P_ANY},
+        {ADDIW, P_SAME(2, F_RD), P_ANY,           P_ANY, P_ANY},
+        {SW,    P_SAME(0, F_RD), P_SAME(3, F_RD), P_ANY, P_SAME(2, F_IMM)}
 };
 
 const pattern_element p_3_elem[] = {
-        {AUIPC, DONT_CARE, DONT_CARE, DONT_CARE, 0, 0, 0, 0},
-        {ADDI,  rd_h1,     DONT_CARE, rd_h1,     0, 0, 0, 0}
+        {AUIPC, P_ANY,           P_ANY, P_ANY,           P_ANY},
+        {ADDI,  P_SAME(0, F_RD), P_ANY, P_SAME(0, F_RD), P_ANY}
 };
 
 const pattern_element p_4_elem[] = {
-        {AUIPC, DONT_CARE, DONT_CARE, DONT_CARE, 0, 0, 0, 0},
-        {LW,    rd_h1,     DONT_CARE, rd_h1,     0, 0, 0, 0}
+        {AUIPC, P_ANY,           P_ANY, P_ANY,           P_ANY},
+        {LW,    P_SAME(0, F_RD), P_ANY, P_SAME(0, F_RD), P_ANY}
 };
 
 const pattern_element p_5_elem[] = {
-        {AUIPC, DONT_CARE, DONT_CARE, DONT_CARE, 0, 0, 0, 0},
-        {LD,    rd_h1,     DONT_CARE, rd_h1,     0, 0, 0, 0}
+        {AUIPC, P_ANY,           P_ANY, P_ANY,           P_ANY},
+        {LD,    P_SAME(0, F_RD), P_ANY, P_SAME(0, F_RD), P_ANY}
 };
 
 const pattern_element p_6_elem[] = {
-        {SLLI, DONT_CARE, DONT_CARE, DONT_CARE, 0, 0, 1, 32},    //rd == rs1???
-        {SRLI, rd_h1,     DONT_CARE, rd_h1,     0, 0, 1, 32}
+        {SLLI, P_ANY,           P_ANY, P_ANY,           P_IS(32)},    //rd == rs1???
+        {SRLI, P_SAME(0, F_RD), P_ANY, P_SAME(0, F_RD), P_IS(32)}
 };
 
 const pattern_element p_7_elem[] = {
-        {ADDIW, DONT_CARE, DONT_CARE, DONT_CARE, 0, 0, 0, 0},
-        {SLLI,  rd_h1,     DONT_CARE, rd_h1,     0, 0, 1, 32},
-        {SRLI,  rd_h1,     DONT_CARE, rd_h1,     0, 0, 1, 32}
+        {ADDIW, P_ANY,           P_ANY, P_ANY,           P_ANY},
+        {SLLI,  P_SAME(0, F_RD), P_ANY, P_SAME(0, F_RD), P_IS(32)},
+        {SRLI,  P_SAME(0, F_RD), P_ANY, P_SAME(0, F_RD), P_IS(32)}
 };
 
 const pattern_element p_8_elem[] = {
-        {ADDIW, DONT_CARE, DONT_CARE, DONT_CARE, 0, 0, 1, 0}
+        {ADDIW, P_ANY, P_ANY, P_ANY, P_IS(0)}
 };
 
 const pattern_element p_9_elem[] = {
-        {LUI,  DONT_CARE, DONT_CARE, DONT_CARE, 0, 0, 0, 0},
-        {ADDI, rd_h1,     DONT_CARE, not_rd_h1, 0, 0, 1, 0},
-        {SLLI, not_rd_h1, DONT_CARE, rd_h2,     1, 0, 1, 32},
-        {SRLI, rd_h1,     DONT_CARE, rd_h1,     2, 0, 1, 32}
+        {LUI,  P_ANY,               P_ANY, P_ANY,               P_ANY},
+        {ADDI, P_SAME(0, F_RD),     P_ANY, P_NOT_SAME(0, F_RD), P_IS(0)},
+        {SLLI, P_NOT_SAME(1, F_RD), P_ANY, P_SAME(0, F_RD),     P_IS(32)},
+        {SRLI, P_SAME(2, F_RD),     P_ANY, P_SAME(2, F_RD),     P_IS(32)}
 };
 
 const pattern_element p_10_elem[] = {
-        {ADDI, x0, DONT_CARE, x0, 0, 0, 1, 0}
+        {ADDI, P_IS(x0), P_ANY, P_IS(x0), P_IS(0)}
 };
 
 const pattern_element p_11_elem[] = {
-        {ADDI, DONT_CARE, DONT_CARE, DONT_CARE, 0, 0, 1, 0}
+        {ADDI, P_ANY, P_ANY, P_ANY, P_IS(0)}
 };
 
 const pattern_element p_12_elem[] = {
-        {XORI, DONT_CARE, DONT_CARE, DONT_CARE, 0, 0, 1, -1}
+        {XORI, P_ANY, P_ANY, P_ANY, P_IS(-1)}
 };
 
 const pattern_element p_13_elem[] = {
-        {SUB, x0, DONT_CARE, DONT_CARE, 0, 0, 0, 0}
+        {SUB, P_IS(x0), P_ANY, P_ANY, P_ANY}
 };
 
 const pattern_element p_14_elem[] = {
-        {SUBW, x0, DONT_CARE, DONT_CARE, 0, 0, 0, 0}
+        {SUBW, P_IS(x0), P_ANY, P_ANY, P_ANY}
 };
 
 const pattern_element p_15_elem[] = {
-        {SLTIU, DONT_CARE, DONT_CARE, DONT_CARE, 0, 0, 1, 1}
+        {SLTIU, P_ANY, P_ANY, P_ANY, P_IS(1)}
 };
 
 const pattern_element p_16_elem[] = {
-        {SLTU, x0, DONT_CARE, DONT_CARE, 0, 0, 0, 0}
+        {SLTU, P_IS(x0), P_ANY, P_ANY, P_ANY}
 };
 
 const pattern_element p_17_elem[] = {
-        {SLT, DONT_CARE, x0, DONT_CARE, 0, 0, 0, 0}
+        {SLT, P_ANY, P_IS(x0), P_ANY, P_ANY}
 };
 
 const pattern_element p_18_elem[] = {
-        {SLT, x0, DONT_CARE, DONT_CARE, 0, 0, 0, 0}
+        {SLT, P_IS(x0), P_ANY, P_ANY, P_ANY}
 };
 
 const pattern_element p_19_elem[] = {
-        {LUI,  DONT_CARE, DONT_CARE, DONT_CARE, 0, 0, 0, 0},
-        {ADDI, rd_h1,     DONT_CARE, rd_h1,     0, 0, 0, 0}
+        {LUI,  P_ANY,           P_ANY, P_ANY,           P_ANY},
+        {ADDI, P_SAME(0, F_RD), P_ANY, P_SAME(0, F_RD), P_ANY}
 };
 
 const pattern_element p_20_elem[] = {
-        {ADDI, x0, DONT_CARE, DONT_CARE, 0, 0, 0, 0}
+        {ADDI, P_IS(x0), P_ANY, P_ANY, P_ANY}
 };
 
 const pattern_element p_21_elem[] = {
-        {SLLI, DONT_CARE, DONT_CARE, DONT_CARE, 0, 0, 1, 32},
-        {SRLI, rd_h1,     DONT_CARE, rd_h1,     0, 0, 0, 0}
+        {SLLI, P_ANY,           P_ANY, P_ANY,           P_IS(32)},
+        {SRLI, P_SAME(0, F_RD), P_ANY, P_SAME(0, F_RD), P_ANY}
 };
 
 const pattern_element p_22_elem[] = {
-        {ANDI, DONT_CARE, DONT_CARE, DONT_CARE, 0, 0, 1, 0xff}
+        {ANDI, P_ANY, P_ANY, P_ANY, P_IS(0xff)}
 };
 
 const pattern_element p_23_elem[] = {
-        {ADDIW, DONT_CARE, DONT_CARE, DONT_CARE, 0, 0, 0, 0},
-        {ANDI,  rd_h1,     DONT_CARE, rd_h1,     0, 0, 1, 0xff}
+        {ADDIW, P_ANY,           P_ANY, P_ANY,           P_ANY},
+        {ANDI,  P_SAME(0, F_RD), P_ANY, P_SAME(0, F_RD), P_IS(0xff)}
+};
+
+//p_0 and p_2 once propagate.c folded the known base into the address (rd of the load must not be x0)
+const pattern_element p_24_elem[] = {
+        {LD,   P_IS(x0),        P_ANY,           P_NOT_SAME(0, F_RS1), P_ANY},
+        {ADDI, P_SAME(0, F_RD), P_ANY,           P_SAME(0, F_RD),      P_ANY},
+        {SD,   P_IS(x0),        P_SAME(0, F_RD), P_ANY,                P_SAME(0, F_IMM)}
+};
+
+const pattern_element p_25_elem[] = {
+        {LW,    P_IS(x0),        P_ANY,           P_NOT_SAME(0, F_RS1), P_ANY},
+        {ADDIW, P_SAME(0, F_RD), P_ANY,           P_SAME(0, F_RD),      P_ANY},
+        {SW,    P_IS(x0),        P_SAME(0, F_RD), P_ANY,                P_SAME(0, F_IMM)}
 };
 
 /* unused */
@@ -642,6 +647,37 @@ void emit_pattern_23(const t_risc_instr instrs[static 2], const register_info *r
     err |= fe_enc64(&current, FE_MOVZXr32r8, regDest, regDest);
 }
 
+/**
+ * Translate an increment of the 64-bit value at an absolute address, which is also left in the register.
+ * @param instrs the RISC-V instructions to translate
+ * @param r_info the runtime register mapping (RISC-V -> x86)
+ */
+void emit_pattern_24(const t_risc_instr instrs[static 3], const register_info *r_info) {
+    log_asm_out("emit pattern 24: inc m64 at absolute address at 0x%lx\n", instrs[0].addr);
+
+    FeOp address = getMemOperand(&instrs[0], r_info);
+    FeReg regDest = getRd(&instrs[1], r_info);
+
+    err |= fe_enc64(&current, FE_ADD64mi, address, instrs[1].imm);
+    err |= fe_enc64(&current, FE_MOV64rm, regDest, address);
+}
+
+/**
+ * Translate an increment of the 32-bit value at an absolute address, which is also left sign extended in the
+ * register.
+ * @param instrs the RISC-V instructions to translate
+ * @param r_info the runtime register mapping (RISC-V -> x86)
+ */
+void emit_pattern_25(const t_risc_instr instrs[static 3], const register_info *r_info) {
+    log_asm_out("emit pattern 25: inc m32 at absolute address at 0x%lx\n", instrs[0].addr);
+
+    FeOp address = getMemOperand(&instrs[0], r_info);
+    FeReg regDest = getRd(&instrs[1], r_info);
+
+    err |= fe_enc64(&current, FE_ADD32mi, address, instrs[1].imm);
+    err |= fe_enc64(&current, FE_MOVSXr64m32, regDest, address);
+}
+
 
 //order = length, descending
 //order is important because longer patterns can contain shorter ones,
@@ -650,6 +686,8 @@ void emit_pattern_23(const t_risc_instr instrs[static 2], const register_info *r
 const pattern patterns[] = {
         {p_2_elem,  5, &emit_pattern_2},  //inc mem64
         {p_9_elem,  4, &emit_pattern_9},  //LUI + ADDI + SRLI + SLLI
+        {p_24_elem, 3, &emit_pattern_24}, //inc mem64 at absolute address
+        {p_25_elem, 3, &emit_pattern_25}, //inc mem32 at absolute address
         {p_7_elem,  3, &emit_pattern_7},  //ADDIW + SLLI + SRLI
         {p_3_elem,  2, &emit_pattern_3},  //AUIPC + ADDI
         {p_4_elem,  2, &emit_pattern_4},  //AUIPC + LW
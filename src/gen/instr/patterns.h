@@ -7,6 +7,14 @@
 #ifndef DYNAMICBINARYTRANSLATORRISCV64_X86_64_PATTERNS_H
 #define DYNAMICBINARYTRANSLATORRISCV64_X86_64_PATTERNS_H
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 extern const pattern patterns[];
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif //DYNAMICBINARYTRANSLATORRISCV64_X86_64_PATTERNS_H
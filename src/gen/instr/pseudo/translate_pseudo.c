@@ -17,17 +17,10 @@
  */
 void translate_PC_NEXT_INST(const t_risc_addr addr, const register_info *r_info) {
     log_asm_out("Translate pseudo PC_NEXT_INST\n");
-    ///write chainEnd to be chained by chainer
     invalidateAllReplacements(r_info);
-    if (flag_translate_opt_chain) {
-        err |= fe_enc64(&current, FE_LEA64rm, FE_AX, FE_MEM(FE_IP, 0, 0, 0));
-        err |= fe_enc64(&current, FE_MOV64mr, FE_MEM_ADDR((uint64_t) &chain_end), FE_AX);
-        err |= fe_enc64(&current, FE_MOV32mi, FE_MEM_ADDR((uint64_t) &chain_type), FE_JMP);
-    }
 
-    ///set pc
-    err |= fe_enc64(&current, FE_MOV64ri, FE_AX, addr);
-    err |= fe_enc64(&current, FE_MOV64mr, FE_MEM_ADDR(r_info->base + 8 * pc), FE_AX);
+    ///jump to the next block or set pc
+    emit_exit(addr, r_info);
 }
 
 /**
@@ -0,0 +1,214 @@
+/**
+ * Liveness of the RISC-V general purpose registers within a block, to skip writing back the replacement registers
+ * (FIRST_REG, SECOND_REG, THIRD_REG) when their content is overwritten by the guest before being read again.
+ * analyze_liveness() runs backwards over the parsed block and yields the registers live at each instruction.
+ * While an instruction is translated, live_registers holds its set, which invalidateReplacement() and the
+ * replacement loads consult before writing a register back.
+ *
+ * At the exits of the block, all registers are live, except at exits towards statically known targets:
+ * for these, a summary of the target is used, the registers it overwrites before reading them or leaving its
+ * straight-line code (see get_killed_on_entry()).
+ * Summaries are not used where their assumptions do not hold, i.e. if the guest code may change after translation
+ * (--smc) or the registers are inspected between blocks (single stepping, register dumps).
+ *
+ * The same analysis drops computations whose result is never read before the block optimizations (see propagate.c),
+ * in eliminate_dead_instructions().
+ */
+
+#include "liveness.h"
+#include <parser/parser.h>
+#include <env/flags.h>
+
+//instructions of a target looked at for its summary
+#define SUMMARY_LENGTH 16
+#define SUMMARY_PAGE_SIZE 4096lu
+
+t_reg_set live_registers = ALL_LIVE;
+
+static inline t_reg_set reg_bit(t_risc_reg reg) {
+    return reg > x0 && reg <= x31 ? (t_reg_set) 1 << reg : 0;
+}
+
+/**
+ * Get the registers possibly read by the passed instruction. May include registers that are not read.
+ */
+static t_reg_set get_uses(const t_risc_instr *instr) {
+    t_reg_set uses = reg_bit(instr->reg_src_1) | reg_bit(instr->reg_src_2);
+    switch (instr->optype) {
+        case REG_REG:
+        case IMMEDIATE:
+        case UPPER_IMMEDIATE:
+        case STORE:
+        case BRANCH:
+        case JUMP:
+            break;
+        default:
+            //e.g. floating point instructions reading some general purpose register in any field
+            uses |= reg_bit(instr->reg_dest);
+    }
+    return uses;
+}
+
+/**
+ * Get the registers certainly overwritten by the passed instruction. May miss registers that are written.
+ */
+static t_reg_set get_defs(const t_risc_instr *instr) {
+    switch (instr->optype) {
+        case REG_REG:
+        case IMMEDIATE:
+        case UPPER_IMMEDIATE:
+        case JUMP:
+            return reg_bit(instr->reg_dest);
+        default:
+            return 0;
+    }
+}
+
+static bool use_summaries(void) {
+    return !flag_smc && !flag_single_step && !flag_log_reg_dump;
+}
+
+/**
+ * Get the registers overwritten before being read by the code at the passed address,
+ * i.e. the registers that are dead when entering it.
+ * Only looks at the straight-line code at that address within its page.
+ * @param risc_addr the RISC-V address of the code
+ * @return the registers dead on entry
+ */
+t_reg_set get_killed_on_entry(t_risc_addr risc_addr) {
+    t_reg_set used = 0;
+    t_reg_set killed = 0;
+    t_risc_addr page = risc_addr & ~(SUMMARY_PAGE_SIZE - 1);
+
+    for (int i = 0; i < SUMMARY_LENGTH && (risc_addr & ~(SUMMARY_PAGE_SIZE - 1)) == page; i++, risc_addr += 4) {
+        t_risc_instr instr = {.addr = risc_addr};
+        parse_instruction_cached(&instr);
+
+        switch (instr.optype) {
+            case REG_REG:
+            case IMMEDIATE:
+            case UPPER_IMMEDIATE:
+            case STORE:
+            case FLOAT:
+                used |= get_uses(&instr);
+                killed |= get_defs(&instr) & ~used;
+                break;
+            default:
+                ///control flow or system instruction: anything not overwritten yet may be read
+                return killed;
+        }
+    }
+    return killed;
+}
+
+static t_reg_set get_live_on_entry(t_risc_addr risc_addr) {
+    return use_summaries() ? ALL_LIVE & ~get_killed_on_entry(risc_addr) : ALL_LIVE;
+}
+
+/**
+ * Get the registers live behind the passed instruction if it leaves the straight-line code of the block.
+ * @param instr the instruction
+ * @param live_next the registers live at the next instruction in the block (for traces following a branch)
+ * @param last whether this is the last instruction of the block
+ */
+static t_reg_set get_live_out(const t_risc_instr *instr, t_reg_set live_next, bool last) {
+    switch (instr->mnem) {
+        case BEQ:
+        case BNE:
+        case BLT:
+        case BGE:
+        case BLTU:
+        case BGEU: {
+            t_reg_set taken = instr->trace_follow == TRACE_TAKEN ? live_next : get_live_on_entry(instr->addr + instr->imm);
+            t_reg_set not_taken = instr->trace_follow == TRACE_NOT_TAKEN ? live_next : get_live_on_entry(instr->addr + 4);
+            return taken | not_taken;
+        }
+        case JAL:
+            return get_live_on_entry(instr->addr + instr->imm);
+        case PC_NEXT_INST:
+            return get_live_on_entry(instr->imm);
+        case JALR:
+        case ECALL:
+        case FENCE_I:
+        case MANUAL_CSRR:
+        case INVALID_MNEM:
+            return ALL_LIVE;
+        default:
+            return last ? ALL_LIVE : live_next;
+    }
+}
+
+/**
+ * Get the registers live before the passed instruction.
+ * @param instr the instruction
+ * @param live_out the registers live behind it, see get_live_out()
+ */
+static t_reg_set get_live_in(const t_risc_instr *instr, t_reg_set live_out) {
+    if (instr->mnem == PATTERN_EMIT) {
+        ///the emitter translates the whole fused sequence, in which it may write back any register
+        return ALL_LIVE;
+    } else if (instr->mnem == SILENT_NOP) {
+        return live_out;
+    } else if (instr->optype == SYSTEM || instr->optype == INVALID_INSTRUCTION) {
+        return ALL_LIVE;
+    } else {
+        return (live_out & ~get_defs(instr)) | get_uses(instr);
+    }
+}
+
+/**
+ * Compute the registers live while translating each of the passed instructions:
+ * those read by the instruction or live behind it.
+ * @param instrs the parsed instructions of the block, after macro fusion
+ * @param count the number of instructions
+ * @param live returns the live registers for each instruction, count big
+ */
+void analyze_liveness(const t_risc_instr *instrs, int count, t_reg_set *live) {
+    t_reg_set live_next = ALL_LIVE;
+    for (int i = count - 1; i >= 0; i--) {
+        const t_risc_instr *instr = &instrs[i];
+        t_reg_set live_out = get_live_out(instr, live_next, i == count - 1);
+        t_reg_set live_in = get_live_in(instr, live_out);
+
+        live[i] = live_in | live_out;
+        live_next = live_in;
+    }
+}
+
+/**
+ * Whether the passed instruction has no effect besides writing its destination register,
+ * i.e. integer computations (no memory accesses).
+ */
+static bool is_pure(const t_risc_instr *instr) {
+    switch (instr->mnem) {
+        case LUI:
+        case AUIPC:
+            return true;
+        default:
+            ///ADDI to AND, ADDIW to REMUW are contiguous in t_risc_mnem
+            return (instr->mnem >= ADDI && instr->mnem <= AND) || (instr->mnem >= ADDIW && instr->mnem <= REMUW);
+    }
+}
+
+/**
+ * Replace the instructions whose result is overwritten before being read, and that have no other effect,
+ * by SILENT_NOP. Exits of the block are treated like in analyze_liveness(), the last instruction is kept.
+ * @param instrs the parsed instructions of the block, before macro fusion
+ * @param count the number of instructions
+ * @return the number of instructions replaced
+ */
+int eliminate_dead_instructions(t_risc_instr *instrs, int count) {
+    int eliminated = 0;
+    t_reg_set live_next = ALL_LIVE;
+    for (int i = count - 1; i >= 0; i--) {
+        t_risc_instr *instr = &instrs[i];
+        t_reg_set live_out = get_live_out(instr, live_next, i == count - 1);
+
+        if (i < count - 1 && is_pure(instr) && (live_out & reg_bit(instr->reg_dest)) == 0) {
+            instr->mnem = SILENT_NOP;
+            eliminated++;
+        }
+        live_next = get_live_in(instr, live_out);
+    }
+    return eliminated;
+}
@@ -0,0 +1,28 @@
+#ifndef DYNAMICBINARYTRANSLATORRISCV64_X86_64_LIVENESS_H
+#define DYNAMICBINARYTRANSLATORRISCV64_X86_64_LIVENESS_H
+
+#include <util/typedefs.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//bit set of RISC-V general purpose registers, bit n for xn
+typedef uint64_t t_reg_set;
+
+#define ALL_LIVE (~(t_reg_set) 0)
+
+//the registers whose value may still be read while translating the current instruction, see analyze_liveness()
+extern t_reg_set live_registers;
+
+void analyze_liveness(const t_risc_instr *instrs, int count, t_reg_set *live);
+
+int eliminate_dead_instructions(t_risc_instr *instrs, int count);
+
+t_reg_set get_killed_on_entry(t_risc_addr risc_addr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //DYNAMICBINARYTRANSLATORRISCV64_X86_64_LIVENESS_H
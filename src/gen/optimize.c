@@ -2,211 +2,339 @@
 // Created by Flo Schmidt on 12.09.20.
 //
 
+/**
+ * Macro fusion: sequences of RISC-V instructions matching one of the patterns in patterns[] (see patterns.c)
+ * are translated as a whole by the pattern's emitter.
+ * The patterns are compiled into a trie over their mnemonic sequences once, so a block is matched in a single pass:
+ * at each position, the trie is followed along the mnemonics of the block and only the patterns ending at the visited
+ * nodes have their register and immediate constraints checked.
+ * The patterns are prioritized by their order in the table: a match is only taken if none of its instructions starts
+ * a match of an earlier pattern, and matches of the same pattern do not overlap (the leftmost one is taken).
+ *
+ * Comparisons feeding a branch are fused before, by rewriting the branch (see fuse_compare_branches()).
+ */
+
 #include "optimize.h"
 #include <gen/instr/patterns.h>
+#include <util/arena.h>
+#include <util/log.h>
+
+typedef struct {
+    unsigned short mnem;
+    //index + 1 of the first child and of the next sibling, 0 for none
+    int first_child;
+    int next_sibling;
+    //index + 1 of the first pattern whose mnemonics end here, in priority order, 0 for none
+    int first_pattern;
+} t_trie_node;
+
+struct pattern_matcher {
+    const pattern *table;
+    int count_patterns;
+    //index + 1 of the node for each first mnemonic, 0 for none
+    int root[N_MNEM];
+    t_trie_node *nodes;
+    //index + 1 of the next pattern ending at the same node, 0 for none
+    int *next_pattern;
+};
+
+//a match of the pattern at a position in the block, before resolving priorities
+typedef struct {
+    int pattern;
+    int pos;
+} t_candidate;
+
+static pattern_matcher *default_matcher = NULL;
+
+static int *get_child(pattern_matcher *matcher, int *count_nodes, int *link, unsigned short mnem) {
+    while (*link != 0 && matcher->nodes[*link - 1].mnem != mnem) {
+        link = &matcher->nodes[*link - 1].next_sibling;
+    }
+    if (*link == 0) {
+        matcher->nodes[*count_nodes] = (t_trie_node) {.mnem = mnem};
+        *link = ++*count_nodes;
+    }
+    return link;
+}
 
 /**
- * pattern matching
-*/
-void optimize_patterns(t_risc_instr block_cache[], int len) {
-    for(int i = 0; patterns[i].len > 0; i++) {
-        for(int j = 0; j < len - patterns[i].len; j++) {
-            for(int k = 0; k < patterns[i].len; k++) {
-                ///mnem match
-                if(patterns[i].elements[k].mnem != block_cache[j + k].mnem) {
-                    goto MISMATCH;
-                }
+ * Compile the passed pattern table for match_patterns().
+ * @param table the patterns in priority order, terminated by an entry of length 0
+ * @return the matcher, allocated for the lifetime of the translator
+ */
+pattern_matcher *compile_patterns(const pattern *table) {
+    pattern_matcher *matcher = arena_alloc(&static_arena, sizeof(pattern_matcher));
+    matcher->table = table;
+
+    int max_nodes = 0;
+    while (table[matcher->count_patterns].len > 0) {
+        max_nodes += table[matcher->count_patterns++].len;
+    }
+    matcher->nodes = arena_alloc(&static_arena, max_nodes * sizeof(t_trie_node));
+    matcher->next_pattern = arena_alloc(&static_arena, matcher->count_patterns * sizeof(int));
+
+    int count_nodes = 0;
+    for (int i = 0; i < matcher->count_patterns; i++) {
+        int *link = get_child(matcher, &count_nodes, &matcher->root[table[i].elements[0].mnem],
+                              table[i].elements[0].mnem);
+        for (int k = 1; k < table[i].len; k++) {
+            link = get_child(matcher, &count_nodes, &matcher->nodes[*link - 1].first_child, table[i].elements[k].mnem);
+        }
 
-                ///rs1 match
-                switch(patterns[i].elements[k].rs1) {
-                    case DONT_CARE : {} break;
-
-                    //uncomment as needed
-
-                    /*
-                    case rs1_h1 : {
-                        if(block_cache[j + k].reg_src_1 !=
-                                block_cache[j + patterns[i].elements[k].h1].reg_src_1) {
-                            goto MISMATCH;
-                        }
-                    } break;
-                     */
-                    /*
-                    case rs2_h1: {
-                        if(block_cache[j + k].reg_src_1 !=
-                                block_cache[j + patterns[i].elements[k].h1].reg_src_2) {
-                            goto MISMATCH;
-                        }
-                    }
-                        break;
-                    */
-
-                    case rd_h1: {
-                        if (block_cache[j + k].reg_src_1 !=
-                                block_cache[j + patterns[i].elements[k].h1].reg_dest) {
-                            goto MISMATCH;
-                        }
-                    }
-                        break;
-
-                    case not_rd_h1 : {
-                        if (block_cache[j + k].reg_src_1 ==
-                                block_cache[j + patterns[i].elements[k].h1].reg_dest) {
-                            goto MISMATCH;
-                        }
-                    }
-                        break;
-
-                        /*
-                        case rs1_h2: {
-                            if(block_cache[j + k].reg_src_1 !=
-                                    block_cache[j + patterns[i].elements[k].h2].reg_src_1) {
-                                goto MISMATCH;
-                            }
-                        }
-                            break;
-                        */
-                        /*
-                        case rs2_h2: {
-                            if(block_cache[j + k].reg_src_1 !=
-                                    block_cache[j + patterns[i].elements[k].h2].reg_src_2) {
-                                goto MISMATCH;
-                            }
-                        }
-                            break;
-                        */
-
-                    case rd_h2: {
-                        if(block_cache[j + k].reg_src_1 !=
-                                block_cache[j + patterns[i].elements[k].h2].reg_dest) {
-                            goto MISMATCH;
-                        }
-                    }
-                        break;
-
-                    default: {
-                        if(block_cache[j + k].reg_src_1 != patterns[i].elements[k].rs1) {
-                            goto MISMATCH;
-                        }
-                    }
-                }
+        ///append to the patterns ending at this node, keeping the priority order
+        int *pattern_link = &matcher->nodes[*link - 1].first_pattern;
+        while (*pattern_link != 0) {
+            pattern_link = &matcher->next_pattern[*pattern_link - 1];
+        }
+        *pattern_link = i + 1;
+    }
 
-                ///rs2 match
-                switch (patterns[i].elements[k].rs2) {
-                    case DONT_CARE : {} break;
-
-                        //insert as needed
-
-                        /*
-                        case rs2_h2 : {
-                            if(block_cache[j + k].reg_src_2 !=
-                                    block_cache[j + patterns[i].elements[k].h2].reg_src_2) {
-                                goto MISMATCH;
-                            }
-                        } break;
-                         */
-
-                    case rd_h1 : {
-                        if(block_cache[j + k].reg_src_2 !=
-                                block_cache[j + patterns[i].elements[k].h1].reg_dest) {
-                            goto MISMATCH;
-                        }
-                    }   break;
-
-                    case rd_h2 : {
-                        if(block_cache[j + k].reg_src_2 !=
-                                block_cache[j + patterns[i].elements[k].h2].reg_dest) {
-                            goto MISMATCH;
-                        }
-                    }   break;
-
-                    default: {
-                        if(block_cache[j + k].reg_src_2 != patterns[i].elements[k].rs2) {
-                            goto MISMATCH;
-                        }
-                    }
-                }
+    log_general("Compiled %d fusion patterns into %d trie nodes.\n", matcher->count_patterns, count_nodes);
+    return matcher;
+}
 
-                ///rd match
-                switch (patterns[i].elements[k].rd) {
-                    case DONT_CARE : {} break;
-
-                    //insert as needed
-
-                    case rd_h1 : {
-                        if(block_cache[j + k].reg_dest !=
-                                block_cache[j + patterns[i].elements[k].h1].reg_dest) {
-                            goto MISMATCH;
-                        }
-                    } break;
-
-                    case rd_h2 : {
-                        if(block_cache[j + k].reg_dest !=
-                                block_cache[j + patterns[i].elements[k].h2].reg_dest) {
-                            goto MISMATCH;
-                        }
-                    }
-                        break;
-
-                    case rs1_h1 : {
-                        if (block_cache[j + k].reg_dest !=
-                                block_cache[j + patterns[i].elements[k].h1].reg_src_1) {
-                            goto MISMATCH;
-                        }
-                    }
-                        break;
-
-                    case not_rd_h1 : {
-                        if (block_cache[j + k].reg_dest ==
-                                block_cache[j + patterns[i].elements[k].h1].reg_dest) {
-                            goto MISMATCH;
-                        }
-                    }
-                        break;
-
-                    default: {
-                        if (block_cache[j + k].reg_dest != patterns[i].elements[k].rd) {
-                            goto MISMATCH;
-                        }
-                    }
-                }
+static inline int64_t get_field(const t_risc_instr *instr, unsigned char field) {
+    switch (field) {
+        case F_RS1:
+            return instr->reg_src_1;
+        case F_RS2:
+            return instr->reg_src_2;
+        case F_RD:
+            return instr->reg_dest;
+        default:
+            return instr->imm;
+    }
+}
+
+static inline bool
+satisfies(const t_risc_instr *start, const t_risc_instr *instr, unsigned char field, const pattern_constraint *c) {
+    switch (c->match) {
+        case MATCH_ANY:
+            return true;
+        case MATCH_VALUE:
+            return get_field(instr, field) == c->value;
+        case MATCH_FIELD:
+            return get_field(instr, field) == get_field(&start[c->pos], c->field);
+        default:
+            return get_field(instr, field) != get_field(&start[c->pos], c->field);
+    }
+}
+
+/**
+ * Check the register and immediate constraints of the passed pattern at the start of the passed instructions,
+ * whose mnemonics are known to match.
+ */
+static bool satisfies_constraints(const pattern *p, const t_risc_instr *start) {
+    for (int k = 0; k < p->len; k++) {
+        const pattern_element *element = &p->elements[k];
+        if (!satisfies(start, &start[k], F_RS1, &element->rs1) ||
+                !satisfies(start, &start[k], F_RS2, &element->rs2) ||
+                !satisfies(start, &start[k], F_RD, &element->rd) ||
+                !satisfies(start, &start[k], F_IMM, &element->imm)) {
+            return false;
+        }
+    }
+    return true;
+}
 
-                ///imm match
-                switch (patterns[i].elements[k].imm) {
-                    case 0 : {} break;
-
-                    case 1 : {
-                        if (block_cache[j + k].imm != patterns[i].elements[k].imm_value) {
-                            goto MISMATCH;
-                        }
-                    } break;
-
-                    case 2 : {
-                        if (block_cache[j + k].imm != block_cache[j + patterns[i].elements[k].imm_value].imm) {
-                            goto MISMATCH;
-                        }
-                    } break;
-
-                    default : {
-                        goto MISMATCH;
-                    }
+/**
+ * Replace the first instruction of every pattern match in the block by a PATTERN_EMIT pseudo instruction
+ * (with the index of the pattern as optype).
+ * Patterns never include the last instruction of the block.
+ * @param matcher the compiled patterns
+ * @param block_cache the parsed instructions of the block
+ * @param len the number of instructions
+ */
+void match_patterns(const pattern_matcher *matcher, t_risc_instr *block_cache, int len) {
+    t_arena_mark mark = arena_mark(&scratch_arena);
+    int capacity = len;
+    int count_candidates = 0;
+    t_candidate *candidates = arena_alloc(&scratch_arena, capacity * sizeof(t_candidate));
+
+    ///1: find all matches, following the trie from each position
+    for (int j = 0; j < len - 1; j++) {
+        int node = matcher->root[block_cache[j].mnem];
+        for (int depth = 1; node != 0 && j + depth < len; depth++) {
+            for (int p = matcher->nodes[node - 1].first_pattern; p != 0; p = matcher->next_pattern[p - 1]) {
+                if (!satisfies_constraints(&matcher->table[p - 1], &block_cache[j])) continue;
+
+                if (count_candidates == capacity) {
+                    candidates = arena_grow(&scratch_arena, candidates, capacity * sizeof(t_candidate),
+                                            2 * capacity * sizeof(t_candidate));
+                    capacity *= 2;
                 }
+                candidates[count_candidates++] = (t_candidate) {p - 1, j};
             }
 
-            ///match:
+            ///descend along the next mnemonic of the block
+            node = matcher->nodes[node - 1].first_child;
+            while (node != 0 && matcher->nodes[node - 1].mnem != block_cache[j + depth].mnem) {
+                node = matcher->nodes[node - 1].next_sibling;
+            }
+        }
+    }
+    if (count_candidates == 0) {
+        arena_reset(&scratch_arena, mark);
+        return;
+    }
+
+    ///2: order the matches by pattern priority, then position (they are ordered by position already)
+    int *first = arena_alloc(&scratch_arena, (matcher->count_patterns + 1) * sizeof(int));
+    for (int c = 0; c < count_candidates; c++) {
+        first[candidates[c].pattern + 1]++;
+    }
+    for (int p = 0; p < matcher->count_patterns; p++) {
+        first[p + 1] += first[p];
+    }
+    t_candidate *ordered = arena_alloc(&scratch_arena, count_candidates * sizeof(t_candidate));
+    for (int c = 0; c < count_candidates; c++) {
+        ordered[first[candidates[c].pattern]++] = candidates[c];
+    }
+
+    ///3: take the matches not overlapping a match taken before, marking their first instruction
+    bool *taken = arena_alloc(&scratch_arena, len * sizeof(bool));
+    int end_of_last = -1;
+    for (int c = 0; c < count_candidates; c++) {
+        int pattern_len = matcher->table[ordered[c].pattern].len;
+        int pos = ordered[c].pos;
+        if (c > 0 && ordered[c - 1].pattern != ordered[c].pattern) {
+            end_of_last = -1;
+        }
+
+        bool overlaps = pos <= end_of_last;
+        for (int k = 0; k < pattern_len && !overlaps; k++) {
+            overlaps = taken[pos + k];
+        }
+        if (overlaps) continue;
+
+        taken[pos] = true;
+        end_of_last = pos + pattern_len - 1;
+        block_cache[pos].mnem = PATTERN_EMIT;
+        block_cache[pos].optype = ordered[c].pattern;
+    }
+
+    arena_reset(&scratch_arena, mark);
+}
+
+/**
+ * pattern matching
+*/
+void optimize_patterns(t_risc_instr block_cache[], int len) {
+    if (default_matcher == NULL) {
+        default_matcher = compile_patterns(patterns);
+    }
+    match_patterns(default_matcher, block_cache, len);
+}
+
+/**
+ * Whether the passed instruction may overwrite the passed register.
+ * Conservative for instructions other than integer computations, i.e. also true if an fp register of that number is
+ * written.
+ */
+static inline bool may_write(const t_risc_instr *instr, t_risc_reg reg) {
+    return instr->optype != STORE && instr->optype != BRANCH && instr->reg_dest == reg;
+}
 
-            ///insert pseudo instruction
-            block_cache[j].mnem = PATTERN_EMIT;
-            block_cache[j].optype = i;
+/**
+ * Rewrite the passed BEQ/BNE testing the result of the passed comparison against zero into a branch comparing the
+ * operands of the comparison directly.
+ * @return false if the comparison has no branch equivalent
+ */
+static bool fuse_compare_branch(const t_risc_instr *compare, t_risc_instr *branch) {
+    ///the mnemonics branching if the comparison is true, and if it is false
+    t_risc_mnem if_true;
+    t_risc_mnem if_false;
+    t_risc_reg rs1 = compare->reg_src_1;
+    t_risc_reg rs2 = compare->reg_src_2;
+    switch (compare->mnem) {
+        case SLT:
+            if_true = BLT;
+            if_false = BGE;
+            break;
+        case SLTU:
+            if (rs1 == x0) {
+                ///SNEZ
+                if_true = BNE;
+                if_false = BEQ;
+                rs1 = rs2;
+                rs2 = x0;
+            } else {
+                if_true = BLTU;
+                if_false = BGEU;
+            }
+            break;
+        case SLTI:
+            if (compare->imm != 0) return false;
+            ///SLTZ
+            if_true = BLT;
+            if_false = BGE;
+            rs2 = x0;
+            break;
+        case SLTIU:
+            if (compare->imm != 1) return false;
+            ///SEQZ
+            if_true = BEQ;
+            if_false = BNE;
+            rs2 = x0;
+            break;
+        default:
+            return false;
+    }
 
-            //invalidate matched sequence ??
+    branch->mnem = branch->mnem == BNE ? if_true : if_false;
+    branch->reg_src_1 = rs1;
+    branch->reg_src_2 = rs2;
+    return true;
+}
 
-            ///skip to end of pattern
-            j = j + patterns[i].len - 1;
+/**
+ * Compare-and-branch fusion: rewrite the BEQ/BNE testing the result of a SLT, SLTU, SLTZ, SNEZ or SEQZ against zero
+ * into a branch comparing the operands of the comparison, so a single cmp and jcc are emitted instead of materializing
+ * the flag first.
+ * The comparison itself is left in place, the dead code elimination (see eliminate_dead_instructions()) drops it if its
+ * result is not read otherwise.
+ * The operands must not be overwritten in between, so the comparison must not overwrite one of its operands either.
+ * @param block_cache the parsed instructions of the block, before macro fusion
+ * @param len the number of instructions
+ * @return the number of branches rewritten
+ */
+int fuse_compare_branches(t_risc_instr *block_cache, int len) {
+    int fused = 0;
+    for (int i = 0; i < len - 1; i++) {
+        const t_risc_instr *compare = &block_cache[i];
+        switch (compare->mnem) {
+            case SLT:
+            case SLTU:
+            case SLTI:
+            case SLTIU:
+                break;
+            default:
+                continue;
+        }
+        t_risc_reg rd = compare->reg_dest;
+        if (rd == x0 || rd == compare->reg_src_1 || (compare->optype == REG_REG && rd == compare->reg_src_2)) {
+            continue;
+        }
 
-            MISMATCH:;
+        ///find the branch testing rd in the straight-line code following, while the operands are unchanged
+        for (int j = i + 1; j < len; j++) {
+            t_risc_instr *instr = &block_cache[j];
+            if ((instr->mnem == BEQ || instr->mnem == BNE) && ((instr->reg_src_1 == rd && instr->reg_src_2 == x0) ||
+                    (instr->reg_src_1 == x0 && instr->reg_src_2 == rd))) {
+                fused += fuse_compare_branch(compare, instr);
+                break;
+            }
+            if (instr->optype != REG_REG && instr->optype != IMMEDIATE && instr->optype != UPPER_IMMEDIATE &&
+                    instr->optype != STORE && instr->optype != FLOAT) {
+                break;
+            }
+            if (may_write(instr, rd) || may_write(instr, compare->reg_src_1) ||
+                    (compare->optype == REG_REG && may_write(instr, compare->reg_src_2))) {
+                break;
+            }
         }
     }
+    return fused;
 }
 
 void translate_pattern_emit(t_risc_instr *instr, const register_info *r_info) {
@@ -8,33 +8,48 @@
 #include <util/typedefs.h>
 #include <main/context.h>
 
-void optimize_patterns(t_risc_instr *block_cache, int len);
+#ifdef __cplusplus
+extern "C" {
+#endif
 
-void translate_pattern_emit(t_risc_instr *instr, const register_info *r_info);
+//the fields of an instruction a pattern constrains
+typedef enum {
+    F_RS1,
+    F_RS2,
+    F_RD,
+    F_IMM,
+} t_pattern_field;
 
 typedef enum {
-    DONT_CARE = 33,
-
-    // -> same as rs[x] at pattern position h1
-    rs1_h1,
-    rs2_h1,
-    rd_h1,
-    rs1_h2,
-    rs2_h2,
-    rd_h2,
-    not_rd_h1,
-} t_risc_reg_meta;
+    //any value
+    MATCH_ANY,
+    //equal to value
+    MATCH_VALUE,
+    //equal to field of the instruction at pattern position pos
+    MATCH_FIELD,
+    //not equal to field of the instruction at pattern position pos
+    MATCH_NOT_FIELD,
+} t_pattern_match;
 
+//constraint on one field of an instruction in a pattern, see patterns.c
 typedef struct {
-    unsigned short mnem;
-    unsigned short rs1;
-    unsigned short rs2;
-    unsigned short rd;
-    unsigned int h1;
-    unsigned int h2;
-    unsigned short imm;
-    int imm_value;  //0: DONT_CARE  1: imm_value  2: imm patt. pos imm_value
+    unsigned char match;
+    unsigned char pos;
+    unsigned char field;
+    int64_t value;
+} pattern_constraint;
 
+#define P_ANY {MATCH_ANY, 0, 0, 0}
+#define P_IS(value) {MATCH_VALUE, 0, 0, (value)}
+#define P_SAME(pos, field) {MATCH_FIELD, (pos), (field), 0}
+#define P_NOT_SAME(pos, field) {MATCH_NOT_FIELD, (pos), (field), 0}
+
+typedef struct {
+    unsigned short mnem;
+    pattern_constraint rs1;
+    pattern_constraint rs2;
+    pattern_constraint rd;
+    pattern_constraint imm;
 } pattern_element;
 
 typedef struct {
@@ -44,4 +59,20 @@ typedef struct {
     void (* emitter)(const t_risc_instr *, const register_info *);
 } pattern;
 
+typedef struct pattern_matcher pattern_matcher;
+
+pattern_matcher *compile_patterns(const pattern *table);
+
+void match_patterns(const pattern_matcher *matcher, t_risc_instr *block_cache, int len);
+
+void optimize_patterns(t_risc_instr *block_cache, int len);
+
+int fuse_compare_branches(t_risc_instr *block_cache, int len);
+
+void translate_pattern_emit(t_risc_instr *instr, const register_info *r_info);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif //DYNAMICBINARYTRANSLATORRISCV64_X86_64_OPTIMIZE_H
@@ -0,0 +1,438 @@
+/**
+ * Constant and copy propagation within a block.
+ * The parsed instructions of a block serve as its intermediate representation: before macro fusion, this pass
+ * rewrites them in place into cheaper equivalents, which the emitters then translate as usual.
+ * - An instruction computing a value known at translation time (from LUI, AUIPC, ADDI chains, ...) is replaced by
+ *   loading the value: a LUI whose immediate holds all 64 bits. The instructions computing the parts of the value
+ *   then mostly become dead and are dropped by eliminate_dead_instructions() (see liveness.c).
+ * - A register operand with a known value is folded into the immediate form of the instruction, e.g. ADD -> ADDI.
+ * - A load or store (also of fp registers) whose base register has a known value, e.g. from AUIPC or LUI, addresses
+ *   the absolute address instead: its base becomes x0 and its immediate the address, which the translators encode
+ *   as a 32-bit displacement (see getMemOperand()). The AUIPC or LUI becomes dead once all accesses through it,
+ *   e.g. to several globals near each other, are folded.
+ * - The instructions behind a register copy (MV) read the copied register instead, unless only the copy is mapped to
+ *   a host register. The copy then often becomes dead as well.
+ * The values are tracked along the straight-line code of the block, which traces also continue in behind branches.
+ * x0 operands are left alone, as the translators and fusion patterns already handle them specially.
+ */
+
+#include "propagate.h"
+
+typedef struct {
+    bool known;
+    int64_t value;
+    //the register this one holds a copy of, INVALID_REG for none
+    t_risc_reg copy_of;
+} t_reg_state;
+
+static inline bool is_gp(t_risc_reg reg) {
+    return reg > x0 && reg <= x31;
+}
+
+static inline bool fits_imm(int64_t value) {
+    return value == (int32_t) value;
+}
+
+static void forget(t_reg_state *state, t_risc_reg reg) {
+    if (!is_gp(reg)) return;
+    state[reg] = (t_reg_state) {.copy_of = INVALID_REG};
+    for (t_risc_reg other = x1; other <= x31; other++) {
+        if (state[other].copy_of == reg) state[other].copy_of = INVALID_REG;
+    }
+}
+
+static void forget_all(t_reg_state *state) {
+    for (t_risc_reg reg = x0; reg <= x31; reg++) {
+        state[reg] = (t_reg_state) {.copy_of = INVALID_REG};
+    }
+}
+
+static inline bool get_constant(const t_reg_state *state, t_risc_reg reg, int64_t *value) {
+    if (reg == x0) {
+        *value = 0;
+        return true;
+    }
+    *value = is_gp(reg) ? state[reg].value : 0;
+    return is_gp(reg) && state[reg].known;
+}
+
+static inline bool is_atomic(t_risc_mnem mnem) {
+    return mnem >= LRW && mnem <= AMOMAXUD;
+}
+
+/**
+ * Whether the register operands of the passed instruction are general purpose registers that may be exchanged for
+ * another register holding the same value.
+ */
+static bool has_gp_operands(const t_risc_instr *instr) {
+    switch (instr->optype) {
+        case REG_REG:
+            return !is_atomic(instr->mnem);
+        case IMMEDIATE:
+        case STORE:
+        case BRANCH:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * Read the copied register instead of the passed operand register if it holds a copy, and reading the copied one is
+ * not more expensive.
+ * @return whether the operand was replaced
+ */
+static bool propagate_copy(t_risc_reg *operand, const t_reg_state *state, const register_info *r_info) {
+    if (!is_gp(*operand)) return false;
+    t_risc_reg copied = state[*operand].copy_of;
+    if (copied == INVALID_REG || (r_info->gp_mapped[*operand] && !r_info->gp_mapped[copied])) return false;
+
+    *operand = copied;
+    return true;
+}
+
+/**
+ * Fold a register operand with a known value into the immediate form of the passed register-register instruction.
+ * @return whether the instruction was rewritten
+ */
+static bool fold_operand(t_risc_instr *instr, const t_reg_state *state) {
+    t_risc_mnem immediate_form;
+    bool commutative = false;
+    bool negate = false;
+    bool word = false;
+    //mask of the shift amount for shifts, 0 for others
+    int64_t shift_mask = 0;
+
+    switch (instr->mnem) {
+        case ADD:
+            immediate_form = ADDI;
+            commutative = true;
+            break;
+        case SUB:
+            immediate_form = ADDI;
+            negate = true;
+            break;
+        case AND:
+            immediate_form = ANDI;
+            commutative = true;
+            break;
+        case OR:
+            immediate_form = ORI;
+            commutative = true;
+            break;
+        case XOR:
+            immediate_form = XORI;
+            commutative = true;
+            break;
+        case SLT:
+            immediate_form = SLTI;
+            break;
+        case SLTU:
+            immediate_form = SLTIU;
+            break;
+        case SLL:
+            immediate_form = SLLI;
+            shift_mask = 0x3f;
+            break;
+        case SRL:
+            immediate_form = SRLI;
+            shift_mask = 0x3f;
+            break;
+        case SRA:
+            immediate_form = SRAI;
+            shift_mask = 0x3f;
+            break;
+        case ADDW:
+            immediate_form = ADDIW;
+            commutative = true;
+            word = true;
+            break;
+        case SUBW:
+            immediate_form = ADDIW;
+            negate = true;
+            word = true;
+            break;
+        case SLLW:
+            immediate_form = SLLIW;
+            shift_mask = 0x1f;
+            break;
+        case SRLW:
+            immediate_form = SRLIW;
+            shift_mask = 0x1f;
+            break;
+        case SRAW:
+            immediate_form = SRAIW;
+            shift_mask = 0x1f;
+            break;
+        default:
+            return false;
+    }
+
+    int64_t value;
+    t_risc_reg other;
+    if (is_gp(instr->reg_src_2) && get_constant(state, instr->reg_src_2, &value)) {
+        other = instr->reg_src_1;
+    } else if (commutative && is_gp(instr->reg_src_1) && get_constant(state, instr->reg_src_1, &value)) {
+        other = instr->reg_src_2;
+    } else {
+        return false;
+    }
+
+    if (negate) {
+        value = (int64_t) -(uint64_t) value;
+    }
+    if (shift_mask != 0) {
+        value &= shift_mask;
+    } else if (word) {
+        ///only the lower 32 bits take part in the operation
+        value = (int32_t) value;
+    }
+    if (!fits_imm(value)) return false;
+
+    instr->mnem = immediate_form;
+    instr->optype = IMMEDIATE;
+    instr->reg_src_1 = other;
+    instr->reg_src_2 = INVALID_REG;
+    instr->imm = value;
+    return true;
+}
+
+static bool is_memory_access(t_risc_mnem mnem) {
+    switch (mnem) {
+        case LB:
+        case LH:
+        case LW:
+        case LBU:
+        case LHU:
+        case LWU:
+        case LD:
+        case SB:
+        case SH:
+        case SW:
+        case SD:
+        case FLW:
+        case FSW:
+        case FLD:
+        case FSD:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * Fold a base register with a known value into the immediate of the passed load or store, if the resulting absolute
+ * address fits into a 32-bit displacement.
+ * @return whether the instruction was rewritten
+ */
+static bool fold_address(t_risc_instr *instr, const t_reg_state *state) {
+    int64_t base;
+    if (!is_memory_access(instr->mnem) || !is_gp(instr->reg_src_1) || !get_constant(state, instr->reg_src_1, &base)) {
+        return false;
+    }
+    int64_t address = (int64_t) ((uint64_t) base + (uint64_t) instr->imm);
+    if (!fits_imm(address)) return false;
+
+    instr->reg_src_1 = x0;
+    instr->imm = address;
+    return true;
+}
+
+/**
+ * Compute the value the passed instruction writes to its destination register, if it is known at translation time.
+ * @param instr the instruction
+ * @param state the known register values before the instruction
+ * @param result returns the value
+ * @return whether the value is known
+ */
+static bool evaluate(const t_risc_instr *instr, const t_reg_state *state, int64_t *result) {
+    switch (instr->mnem) {
+        case LUI:
+            *result = instr->imm;
+            return true;
+        case AUIPC:
+            *result = (int64_t) (instr->addr + instr->imm);
+            return true;
+        case JAL:
+        case JALR:
+            *result = (int64_t) (instr->addr + 4);
+            return true;
+        default:
+            break;
+    }
+
+    int64_t a;
+    int64_t b;
+    if (!get_constant(state, instr->reg_src_1, &a)) return false;
+    bool known_b = get_constant(state, instr->reg_src_2, &b);
+    uint64_t ua = a;
+    uint64_t ub = b;
+    uint64_t imm = instr->imm;
+    uint64_t r;
+
+    switch (instr->mnem) {
+        case ADDI:
+            r = ua + imm;
+            break;
+        case SLTI:
+            r = a < instr->imm;
+            break;
+        case SLTIU:
+            r = ua < imm;
+            break;
+        case XORI:
+            r = ua ^ imm;
+            break;
+        case ORI:
+            r = ua | imm;
+            break;
+        case ANDI:
+            r = ua & imm;
+            break;
+        case SLLI:
+            r = ua << (imm & 0x3f);
+            break;
+        case SRLI:
+            r = ua >> (imm & 0x3f);
+            break;
+        case SRAI:
+            r = a >> (imm & 0x3f);
+            break;
+        case ADDIW:
+            r = (int32_t) (ua + imm);
+            break;
+        case SLLIW:
+            r = (int32_t) ((uint32_t) ua << (imm & 0x1f));
+            break;
+        case SRLIW:
+            r = (int32_t) ((uint32_t) ua >> (imm & 0x1f));
+            break;
+        case SRAIW:
+            r = (int32_t) a >> (imm & 0x1f);
+            break;
+        default:
+            if (!known_b) return false;
+            switch (instr->mnem) {
+                case ADD:
+                    r = ua + ub;
+                    break;
+                case SUB:
+                    r = ua - ub;
+                    break;
+                case SLL:
+                    r = ua << (ub & 0x3f);
+                    break;
+                case SLT:
+                    r = a < b;
+                    break;
+                case SLTU:
+                    r = ua < ub;
+                    break;
+                case XOR:
+                    r = ua ^ ub;
+                    break;
+                case SRL:
+                    r = ua >> (ub & 0x3f);
+                    break;
+                case SRA:
+                    r = a >> (ub & 0x3f);
+                    break;
+                case OR:
+                    r = ua | ub;
+                    break;
+                case AND:
+                    r = ua & ub;
+                    break;
+                case ADDW:
+                    r = (int32_t) (ua + ub);
+                    break;
+                case SUBW:
+                    r = (int32_t) (ua - ub);
+                    break;
+                case SLLW:
+                    r = (int32_t) ((uint32_t) ua << (ub & 0x1f));
+                    break;
+                case SRLW:
+                    r = (int32_t) ((uint32_t) ua >> (ub & 0x1f));
+                    break;
+                case SRAW:
+                    r = (int32_t) a >> (ub & 0x1f);
+                    break;
+                case MUL:
+                    r = ua * ub;
+                    break;
+                case MULW:
+                    r = (int32_t) (ua * ub);
+                    break;
+                default:
+                    return false;
+            }
+    }
+    *result = (int64_t) r;
+    return true;
+}
+
+/**
+ * Propagate the known values and register copies through the passed block, rewriting its instructions.
+ * @param instrs the parsed instructions of the block
+ * @param count the number of instructions
+ * @param r_info the register mapping info, to only read copied registers if that is not more expensive
+ * @return the number of instructions rewritten
+ */
+int propagate_block(t_risc_instr *instrs, int count, const register_info *r_info) {
+    t_reg_state state[N_REG];
+    forget_all(state);
+
+    int rewritten = 0;
+    for (int i = 0; i < count; i++) {
+        t_risc_instr *instr = &instrs[i];
+        bool changed = false;
+
+        switch (instr->optype) {
+            case SYSTEM:
+            case PSEUDO:
+            case INVALID_INSTRUCTION:
+            case INVALID_BLOCK:
+                ///may write any register (e.g. syscalls), or end the block
+                forget_all(state);
+                continue;
+            default:
+                break;
+        }
+
+        if (has_gp_operands(instr)) {
+            changed |= propagate_copy(&instr->reg_src_1, state, r_info);
+            changed |= propagate_copy(&instr->reg_src_2, state, r_info);
+            if (instr->optype == REG_REG) {
+                changed |= fold_operand(instr, state);
+            }
+        }
+        changed |= fold_address(instr, state);
+
+        t_risc_reg rd = instr->reg_dest;
+        int64_t value;
+        if (is_gp(rd) && instr->optype != FLOAT && evaluate(instr, state, &value)) {
+            ///load the value directly if the instruction reads a register for it
+            if (instr->mnem != JAL && instr->mnem != JALR && (is_gp(instr->reg_src_1) || is_gp(instr->reg_src_2))) {
+                instr->mnem = LUI;
+                instr->optype = UPPER_IMMEDIATE;
+                instr->reg_src_1 = INVALID_REG;
+                instr->reg_src_2 = INVALID_REG;
+                instr->imm = value;
+                changed = true;
+            }
+            forget(state, rd);
+            state[rd].known = true;
+            state[rd].value = value;
+        } else {
+            forget(state, rd);
+            if (is_gp(rd) && instr->mnem == ADDI && instr->imm == 0 && is_gp(instr->reg_src_1) &&
+                    instr->reg_src_1 != rd) {
+                state[rd].copy_of = instr->reg_src_1;
+            }
+        }
+
+        if (changed) rewritten++;
+    }
+    return rewritten;
+}
@@ -0,0 +1,16 @@
+#ifndef DYNAMICBINARYTRANSLATORRISCV64_X86_64_PROPAGATE_H
+#define DYNAMICBINARYTRANSLATORRISCV64_X86_64_PROPAGATE_H
+
+#include <util/typedefs.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int propagate_block(t_risc_instr *instrs, int count, const register_info *r_info);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //DYNAMICBINARYTRANSLATORRISCV64_X86_64_PROPAGATE_H
@@ -0,0 +1,141 @@
+/**
+ * Dynamic register allocation for code translated by the optimizing tier.
+ * The static mapping of context.c keeps the 12 RISC-V registers used most across typical programs in host registers,
+ * and the others in the register file in memory. Within a block or trace, a register unmapped there may well be used
+ * far more often than some of the mapped ones, which then occupy their host register for nothing.
+ * Such a block is split into regions at all instructions that leave it or hand the context to C code (branches,
+ * jumps, ECALL, ...). At the start of a region, the most referenced unmapped registers are promoted into the host
+ * registers of the least referenced mapped ones, by swapping the mapping in r_info for as long as the region is
+ * translated. Glue code stores the displaced register and loads the promoted one on entry, and does the reverse before
+ * the region is left. This keeps the static mapping at every block boundary, so chained blocks, the context switching
+ * routines and the runtime still interoperate unchanged.
+ */
+
+#include "regalloc.h"
+#include <gen/translate.h>
+#include <util/util.h>
+#include <util/log.h>
+#include <env/flags.h>
+#include <util/tools/profile.h>
+
+//promotions per region, each costs two stores and two loads of glue
+#define MAX_PROMOTIONS 4
+//references a promoted register needs more than the one it displaces to outweigh the glue
+#define MIN_REFERENCE_GAIN 4
+
+static struct {
+    t_risc_reg promoted;
+    t_risc_reg displaced;
+    FeReg promoted_map;
+} promotions[MAX_PROMOTIONS];
+static int count_promotions = 0;
+static bool active = false;
+
+/**
+ * Count the references of every general purpose register by the passed instructions.
+ * Fused instructions are counted with the whole matched sequence: the PATTERN_EMIT keeps the registers of the first
+ * instruction (its optype is the pattern index, see match_patterns()), and the rest of the sequence follows unchanged.
+ */
+static void count_references(const t_risc_instr *instrs, int count, size_t references[N_REG]) {
+    memset(references, 0, N_REG * sizeof(size_t));
+    for (int i = 0; i < count; i++) {
+        //the operands of floating point instructions are mostly floating point registers
+        if (instrs[i].mnem == SILENT_NOP || (instrs[i].mnem != PATTERN_EMIT && instrs[i].optype == FLOAT)) continue;
+
+        t_risc_reg regs[] = {instrs[i].reg_src_1, instrs[i].reg_src_2, instrs[i].reg_dest};
+        for (size_t j = 0; j < sizeof(regs) / sizeof(regs[0]); j++) {
+            if (regs[j] > x0 && regs[j] <= x31) references[regs[j]]++;
+        }
+    }
+}
+
+/**
+ * Start a region of the current block, promoting the unmapped registers its instructions reference most often into
+ * host registers of rarely referenced mapped ones. Emits the entry glue.
+ * @param instrs the instructions of the region, none of them leaving the block
+ * @param count the number of instructions in the region
+ * @param r_info the register mapping info, modified until end_region_allocation()
+ */
+void begin_region_allocation(const t_risc_instr *instrs, int count, const register_info *r_info) {
+    size_t references[N_REG];
+    count_references(instrs, count, references);
+
+    bool touched[N_REG] = {false};
+    count_promotions = 0;
+    while (count_promotions < MAX_PROMOTIONS) {
+        t_risc_reg promoted = INVALID_REG;
+        t_risc_reg displaced = INVALID_REG;
+        for (t_risc_reg reg = x1; reg <= x31; reg++) {
+            if (touched[reg]) continue;
+            if (!r_info->gp_mapped[reg]) {
+                if (promoted == INVALID_REG || references[reg] > references[promoted]) promoted = reg;
+            } else {
+                if (displaced == INVALID_REG || references[reg] < references[displaced]) displaced = reg;
+            }
+        }
+        if (promoted == INVALID_REG || displaced == INVALID_REG ||
+                references[promoted] < references[displaced] + MIN_REFERENCE_GAIN) {
+            break;
+        }
+
+        touched[promoted] = true;
+        touched[displaced] = true;
+        promotions[count_promotions].promoted = promoted;
+        promotions[count_promotions].displaced = displaced;
+        promotions[count_promotions].promoted_map = r_info->gp_map[promoted];
+        count_promotions++;
+        if (flag_do_profile) profile_register_promotion(references[promoted] - references[displaced]);
+    }
+    if (count_promotions == 0) return;
+
+    ///the replacement registers must not hold stale copies of the promoted registers
+    invalidateAllReplacements(r_info);
+    for (int i = 0; i < count_promotions; i++) {
+        t_risc_reg promoted = promotions[i].promoted;
+        t_risc_reg displaced = promotions[i].displaced;
+        FeReg host = r_info->gp_map[displaced];
+        log_context("Promoting %s into %s, displacing %s\n", gp_to_string(promoted), reg_x86_to_string(host),
+                    gp_to_string(displaced));
+
+        err |= fe_enc64(&current, FE_MOV64mr, FE_MEM_ADDR(r_info->base + 8 * displaced), host);
+        err |= fe_enc64(&current, FE_MOV64rm, host, FE_MEM_ADDR(r_info->base + 8 * promoted));
+
+        r_info->gp_mapped[displaced] = false;
+        r_info->gp_map[promoted] = host;
+        r_info->gp_mapped[promoted] = true;
+    }
+    active = true;
+}
+
+/**
+ * End the current region, writing back the promoted registers and restoring the static mapping.
+ * Must be called before the translated code leaves the block or hands over the context in any way.
+ * @param r_info the register mapping info
+ */
+void end_region_allocation(const register_info *r_info) {
+    if (!active) return;
+
+    ///the displaced registers may have been loaded into the replacement registers
+    invalidateAllReplacements(r_info);
+    for (int i = 0; i < count_promotions; i++) {
+        t_risc_reg promoted = promotions[i].promoted;
+        t_risc_reg displaced = promotions[i].displaced;
+        FeReg host = r_info->gp_map[promoted];
+
+        err |= fe_enc64(&current, FE_MOV64mr, FE_MEM_ADDR(r_info->base + 8 * promoted), host);
+        err |= fe_enc64(&current, FE_MOV64rm, host, FE_MEM_ADDR(r_info->base + 8 * displaced));
+
+        r_info->gp_mapped[promoted] = false;
+        r_info->gp_map[promoted] = promotions[i].promoted_map;
+        r_info->gp_mapped[displaced] = true;
+    }
+    count_promotions = 0;
+    active = false;
+}
+
+/**
+ * Whether registers are currently promoted, i.e. r_info deviates from the static mapping.
+ */
+bool region_allocation_active(void) {
+    return active;
+}
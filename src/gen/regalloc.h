@@ -0,0 +1,20 @@
+#ifndef DYNAMICBINARYTRANSLATORRISCV64_X86_64_REGALLOC_H
+#define DYNAMICBINARYTRANSLATORRISCV64_X86_64_REGALLOC_H
+
+#include <util/typedefs.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void begin_region_allocation(const t_risc_instr *instrs, int count, const register_info *r_info);
+
+void end_region_allocation(const register_info *r_info);
+
+bool region_allocation_active(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //DYNAMICBINARYTRANSLATORRISCV64_X86_64_REGALLOC_H
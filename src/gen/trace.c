@@ -0,0 +1,197 @@
+/**
+ * Tiered translation and trace (superblock) formation for hot code.
+ * Blocks are first translated quickly by translate_block() (the baseline tier), each starting with a counter of
+ * its executions. Once a block has been executed tier_threshold times (--tier-threshold), it returns to the
+ * dispatcher with trace_requested set, which then retranslates it with the optimizing tier as a trace starting at it:
+ * the blocks are parsed one after another, following every conditional branch in the direction whose successor has
+ * been executed more often so far. The trace is translated as one unit by translate_optimized_block_instructions(),
+ * with the other direction of each of these branches as side exit, and replaces the original block in the
+ * cache_table. All exits chained to the original block are relinked to the trace.
+ * The blocks of a trace are parsed again with the longer length limit of hot code (--trace-length) rather than the
+ * one of cold code (--block-length), so straight-line code split into several baseline blocks is joined.
+ */
+
+#include "trace.h"
+#include <common.h>
+#include <linux/mman.h>
+#include <util/arena.h>
+#include <gen/translate.h>
+#include <cache/smc.h>
+#include <env/flags.h>
+#include <env/opt.h>
+#include <env/exit.h>
+#include <util/log.h>
+#include <util/tools/profile.h>
+
+#define TRACE_MAX_BLOCKS 8
+//minimum number of instructions left within the trace length to append another block
+#define TRACE_MIN_ROOM 16
+
+#define MAX_COUNTERS (1u << 16u)
+#define COUNTER_BUCKETS 4096
+
+bool trace_requested = false;
+
+/**
+ * The counters are referenced by the generated code, so they must never move.
+ */
+static t_block_counter counters[MAX_COUNTERS];
+static size_t count_counters = 0;
+
+//index + 1 of the first counter per bucket, 0 for none
+static uint32_t counter_buckets[COUNTER_BUCKETS];
+
+static inline size_t counter_hash(t_risc_addr risc_addr) {
+    return (risc_addr >> 2u) & (COUNTER_BUCKETS - 1);
+}
+
+static t_block_counter *find_counter(t_risc_addr risc_addr) {
+    for (uint32_t i = counter_buckets[counter_hash(risc_addr)]; i != 0; i = counters[i - 1].next) {
+        if (counters[i - 1].risc_addr == risc_addr) return &counters[i - 1];
+    }
+    return NULL;
+}
+
+/**
+ * Get the execution counter for a block that is about to be translated, and (re)start counting.
+ * @param risc_addr the RISC-V address of the block
+ * @return the counter, or NULL if the block should not be counted
+ */
+int64_t *get_block_counter(t_risc_addr risc_addr) {
+    if (tier_threshold == 0) return NULL;
+
+    t_block_counter *counter = find_counter(risc_addr);
+    if (counter == NULL) {
+        if (count_counters == MAX_COUNTERS) return NULL;
+
+        size_t bucket = counter_hash(risc_addr);
+        counter = &counters[count_counters];
+        *counter = (t_block_counter) {.risc_addr = risc_addr, .next = counter_buckets[bucket]};
+        counter_buckets[bucket] = ++count_counters;
+    }
+    counter->remaining = (int64_t) tier_threshold;
+    return &counter->remaining;
+}
+
+/**
+ * Get the number of times the block at the passed address has been executed, as far as it was counted.
+ */
+uint64_t get_execution_count(t_risc_addr risc_addr) {
+    t_block_counter *counter = find_counter(risc_addr);
+    return counter == NULL ? 0 : (uint64_t) ((int64_t) tier_threshold - counter->remaining);
+}
+
+/**
+ * Parse the blocks of the trace starting at head.
+ * @param head the RISC-V address of the trace's first block
+ * @param buffer the buffer for the parsed instructions
+ * @param blocks returns the number of blocks in the trace
+ * @param isFloatBlock returns whether the trace uses fp registers
+ */
+static void parse_trace(t_risc_addr head, t_parse_buffer *buffer, int *blocks, bool *isFloatBlock) {
+    t_risc_addr starts[TRACE_MAX_BLOCKS];
+    t_risc_addr risc_addr = head;
+    int limit = get_block_length_limit(true);
+    *blocks = 0;
+
+    while (true) {
+        starts[(*blocks)++] = risc_addr;
+        parse_block(risc_addr, buffer, limit - buffer->count, isFloatBlock);
+
+        t_risc_instr *last = &buffer->instrs[buffer->count - 1];
+        if (last->optype != BRANCH || *blocks == TRACE_MAX_BLOCKS || limit - buffer->count < TRACE_MIN_ROOM) {
+            break;
+        }
+
+        ///continue in the direction whose successor was executed more often, ties favour falling through
+        t_risc_addr taken = last->addr + last->imm;
+        t_risc_addr not_taken = last->addr + 4;
+        uint64_t taken_count = get_execution_count(taken);
+        uint64_t not_taken_count = get_execution_count(not_taken);
+        t_risc_addr next = taken_count > not_taken_count ? taken : not_taken;
+        if (taken_count == 0 && not_taken_count == 0) {
+            break;
+        }
+
+        ///stop at loops, the exit back to their start gets chained instead
+        for (int i = 0; i < *blocks; i++) {
+            if (starts[i] == next) return;
+        }
+
+        last->trace_follow = next == taken ? TRACE_TAKEN : TRACE_NOT_TAKEN;
+        risc_addr = next;
+    }
+}
+
+/**
+ * Retranslate the passed hot block with the optimizing tier, as the trace starting at it, and replace the block.
+ * Must only be called from the main loop, while no translated code is running.
+ * @param head the RISC-V address of the hot block
+ * @param c_info the context info
+ */
+void form_trace(t_risc_addr head, const context_info *c_info) {
+    t_cache_loc block = lookup_cache_entry(head);
+    if (block == UNSEEN_CODE) return;
+
+    t_arena_mark mark = arena_mark(&scratch_arena);
+    t_parse_buffer buffer;
+    init_parse_buffer(&buffer);
+
+    int blocks;
+    bool isFloatBlock = false;
+    parse_trace(head, &buffer, &blocks, &isFloatBlock);
+    t_risc_instr *trace_cache = buffer.instrs;
+    int instructions_in_trace = buffer.count;
+
+    t_cache_loc trace = translate_optimized_block_instructions(trace_cache, instructions_in_trace, c_info,
+                                                               isFloatBlock);
+    log_cache("Formed trace at (riscv)%p: %d blocks, %d instructions at %p\n", (void *) head, blocks,
+              instructions_in_trace, trace);
+    if (flag_do_profile) {
+        profile_trace(blocks);
+        profile_block_split(true, trace_cache[instructions_in_trace - 1].mnem == PC_NEXT_INST);
+    }
+
+    ///swap it in, the baseline block stays valid for references that are not tracked
+    if (flag_smc) {
+        smc_register_block(head, trace, trace_cache, instructions_in_trace);
+        smc_redirect_block(block, trace);
+    }
+    set_cache_entry(head, trace);
+
+    arena_reset(&scratch_arena, mark);
+}
+
+/**
+ * Forget all counters, e.g. because the code containing them was flushed.
+ */
+void clear_block_counters(void) {
+    memset(counter_buckets, 0, sizeof(counter_buckets));
+    count_counters = 0;
+    trace_requested = false;
+}
+
+size_t get_block_counter_count(void) {
+    return count_counters;
+}
+
+const t_block_counter *get_block_counters(void) {
+    return counters;
+}
+
+/**
+ * Restore counters saved in an earlier run at their original positions, as the restored code references them.
+ * @param saved the saved counters
+ * @param count the number of counters
+ */
+void restore_block_counters(const t_block_counter *saved, size_t count) {
+    clear_block_counters();
+    if (count > MAX_COUNTERS) return;
+
+    for (size_t i = 0; i < count; i++) {
+        size_t bucket = counter_hash(saved[i].risc_addr);
+        counters[i] = (t_block_counter) {saved[i].risc_addr, saved[i].remaining, counter_buckets[bucket]};
+        counter_buckets[bucket] = i + 1;
+    }
+    count_counters = count;
+}
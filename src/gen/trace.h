@@ -0,0 +1,42 @@
+#ifndef DYNAMICBINARYTRANSLATORRISCV64_X86_64_TRACE_H
+#define DYNAMICBINARYTRANSLATORRISCV64_X86_64_TRACE_H
+
+#include <util/typedefs.h>
+#include <main/context.h>
+#include <cache/cache.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//execution counter of a translated block, decremented by the block itself on every entry
+typedef struct {
+    t_risc_addr risc_addr;
+    //executions left until the block is hot, negative once it has been hot
+    int64_t remaining;
+    //index + 1 of the next counter in the same bucket, 0 for none
+    uint32_t next;
+} t_block_counter;
+
+//set by a block that just became hot, pc then holds its address
+extern bool trace_requested;
+
+int64_t *get_block_counter(t_risc_addr risc_addr);
+
+uint64_t get_execution_count(t_risc_addr risc_addr);
+
+void form_trace(t_risc_addr head, const context_info *c_info);
+
+void clear_block_counters(void);
+
+size_t get_block_counter_count(void);
+
+const t_block_counter *get_block_counters(void);
+
+void restore_block_counters(const t_block_counter *saved, size_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //DYNAMICBINARYTRANSLATORRISCV64_X86_64_TRACE_H
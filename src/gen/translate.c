@@ -8,6 +8,7 @@
 #include <fadec/fadec-enc.h>
 #include <common.h>
 #include <linux/mman.h>
+#include <util/arena.h>
 #include <util/util.h>
 #include <util/log.h>
 #include <util/typedefs.h>
@@ -18,14 +19,40 @@
 #include <fadec/fadec.h>
 #include <env/exit.h>
 #include "runtime/register.h"
+#include <cache/return_stack.h>
+#include <cache/chain.h>
+#include <cache/smc.h>
+#include <gen/trace.h>
+#include <gen/regalloc.h>
+#include <gen/liveness.h>
+#include <gen/propagate.h>
+#include <gen/forward.h>
+#include <gen/worklist.h>
+#include <gen/instr/core/translate_other.h>
+#include <env/opt.h>
+#include <util/tools/profile.h>
 
 void *currentPos = NULL;
 
+/**
+ * Start of the memory for translated blocks.
+ * Page aligned and placed behind the context switching routines generated by init_map_context().
+ */
+void *blockMemStart = NULL;
+
+/**
+ * Set by translated code (FENCE.I) to have the main loop flush the code cache before the next block runs.
+ */
+bool code_cache_flush_requested = false;
+
 //instruction translation
 void translate_risc_instr(t_risc_instr *instr, const context_info *c_info);
 
-int parse_block(t_risc_addr risc_addr, t_risc_instr *parse_buf, int maxCount, const context_info *c_info,
-                bool *isFloatBlock);
+static t_cache_loc
+translate_instructions(t_risc_instr *block_cache, int instructions_in_block, const context_info *c_info,
+                       t_risc_addr risc_addr, int64_t *counter, bool float_block);
+
+static bool ends_lookahead(const t_risc_instr *instr);
 
 /**
  * The pointer to the head of the current basic block.
@@ -33,6 +60,38 @@ int parse_block(t_risc_addr risc_addr, t_risc_instr *parse_buf, int maxCount, co
  */
 static uint8_t *block_head;
 
+/**
+ * Exits of the current block emitted out of line behind its end, see defer_exit().
+ */
+#define MAX_DEFERRED_EXITS 16
+static struct {
+    uint8_t *site;
+    uint64_t type;
+    t_risc_addr target;
+} deferred_exits[MAX_DEFERRED_EXITS];
+static int count_deferred_exits;
+
+/**
+ * The jump of the current block's execution counter towards the stub requesting a trace, NULL if it is not counted.
+ */
+static uint8_t *hot_site;
+static t_risc_addr hot_risc_addr;
+
+/**
+ * The instructions of the block currently translated by the optimizing tier, to look ahead when allocating the
+ * replacement registers. NULL while translating with the baseline tier.
+ */
+static const t_risc_instr *lookahead_instrs = NULL;
+static int lookahead_count;
+//index of the instruction currently translated
+static int lookahead_pos;
+//access recency of the replacement registers before the current instruction
+static uint64_t lookahead_start_recency;
+
+//instructions per block or trace (--block-length, --trace-length), bounding the parse buffer
+#define MAX_BLOCK_LENGTH (1 << 16)
+#define INITIAL_PARSE_CAPACITY 32
+
 /**
  * The pointer to the current assembly instruction.
  */
@@ -59,6 +118,15 @@ void init_block(register_info *r_info) {
     block_head = (uint8_t *) currentPos;
     current = block_head;
     err = 0;
+    count_deferred_exits = 0;
+    hot_site = NULL;
+
+    if (flag_smc) {
+        //patchable entry, redirected to the dispatcher once the block is invalidated (see smc.c)
+        for (int i = 0; i < SMC_ENTRY_SIZE; i++) {
+            fe_enc64(&current, FE_NOP);
+        }
+    }
 
 #ifndef NDEBUG
     //insert nop at the beginning so debugger step-into works as expected
@@ -69,25 +137,46 @@ void init_block(register_info *r_info) {
     invalidateAllReplacements(r_info);
 }
 
+/**
+ * Emit the code of the current block that is placed behind its final RET:
+ * the fallbacks of deferred exits and the stub of the execution counter.
+ */
+static void emit_out_of_line_code(const register_info *r_info) {
+    for (int i = 0; i < count_deferred_exits; i++) {
+        emit_exit_at(deferred_exits[i].site, deferred_exits[i].type, deferred_exits[i].target, r_info);
+        err |= fe_enc64(&current, FE_RET);
+    }
+    count_deferred_exits = 0;
+
+    if (hot_site != NULL) {
+        ///the block just became hot: return to the dispatcher, which forms a trace starting at it
+        err |= fe_enc64(&hot_site, FE_JZ | FE_JMPL, (intptr_t) current);
+        if (r_info->gp_mapped[pc]) {
+            err |= fe_enc64(&current, FE_MOV64ri, r_info->gp_map[pc], hot_risc_addr);
+        } else {
+            err |= fe_enc64(&current, FE_MOV64mi, FE_MEM_ADDR(r_info->base + 8 * pc), hot_risc_addr);
+        }
+        err |= fe_enc64(&current, FE_MOV8mi, FE_MEM_ADDR((intptr_t) &trace_requested), 1);
+        err |= fe_enc64(&current, FE_RET);
+        hot_site = NULL;
+    }
+}
+
 /**
  * Finalize the translated block.
- * Invalidates the replacement registers and prepares the block for chaining.
- * Also emits the RET instruction at the end of the block.
+ * Invalidates the replacement registers and emits the RET instruction at the end of the block,
+ * followed by the out of line code of its exits.
  * @return the starting address of the function block, or the nullptr in case of error
  */
-t_cache_loc finalize_block(int chainLinkOp, const register_info *r_info) {
+t_cache_loc finalize_block(const register_info *r_info) {
     //invalidate all replacement registers used in this block
     invalidateAllReplacements(r_info);
 
-    ///write chainEnd to be chained by chainer
-    if (flag_translate_opt_chain && chainLinkOp == LINK_NULL) {
-        err |= fe_enc64(&current, FE_MOV64mi, FE_MEM_ADDR((uint64_t) &chain_end), 0);
-        //no need to set chain_type here
-    }
-
     //emit the ret instruction as the final instruction in the block
     err |= fe_enc64(&current, FE_RET);
 
+    emit_out_of_line_code(r_info);
+
     //Addtional over 16B alignment
     uintptr_t offset = (uintptr_t) (current) & 0xf;
     //Alignment Bytes wanted
@@ -180,30 +269,38 @@ void translate_risc_instr(t_risc_instr *instr, const context_info *c_info) {
 t_cache_loc translate_block(t_risc_addr risc_addr, const context_info *c_info) {
     log_asm_out("Start translating block at (riscv)%p...\n", (void *) risc_addr);
 
-    /// get memory for structs
-#define BLOCK_CACHE_SIZE 64
-    int maxCount = BLOCK_CACHE_SIZE;
-    if (flag_single_step) {
-        maxCount = 2;
-    }
-    t_risc_instr *block_cache = (t_risc_instr *) mmap(NULL, maxCount * sizeof(t_risc_instr),
-                                                      PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
-
-    if (BAD_ADDR(block_cache)) {
-        dprintf(2, "Failed to allocate cache for parsing instructions");
-        panic(FAIL_HEAP_ALLOC);
-    }
+    ///cold code is split into short blocks, hot code is parsed again with longer ones when forming traces
+    int maxCount = get_block_length_limit(false);
+    t_arena_mark mark = arena_mark(&scratch_arena);
+    t_parse_buffer buffer;
+    init_parse_buffer(&buffer);
 
     bool isFloatBlock = false;
 
-    int instructions_in_block = parse_block(risc_addr, block_cache, maxCount, c_info, &isFloatBlock);
+    int instructions_in_block = parse_block(risc_addr, &buffer, maxCount, &isFloatBlock);
+    t_risc_instr *block_cache = buffer.instrs;
+    if (flag_do_profile && !flag_single_step) {
+        profile_block_split(false, block_cache[instructions_in_block - 1].mnem == PC_NEXT_INST);
+    }
+
+    ///count the executions of the block if it may become part of a trace
+    int64_t *counter = NULL;
+    if (flag_translate_opt_trace && !flag_single_step) {
+        counter = get_block_counter(risc_addr);
+    }
 
     ///Start of actual translation
-    t_cache_loc block = translate_block_instructions(block_cache, instructions_in_block, c_info);
+    t_cache_loc block = translate_instructions(block_cache, instructions_in_block, c_info, risc_addr, counter,
+                                               isFloatBlock);
+    if (flag_do_profile) profile_baseline_block();
 
     log_asm_out("Translated block at (riscv)%p: %d instructions\n", (void *) risc_addr, instructions_in_block);
 
-    munmap(block_cache, maxCount * sizeof(t_risc_instr));
+    if (flag_smc) {
+        smc_register_block(risc_addr, block, block_cache, instructions_in_block);
+    }
+
+    arena_reset(&scratch_arena, mark);
     return block;
 }
 
@@ -217,53 +314,261 @@ t_cache_loc translate_block(t_risc_addr risc_addr, const context_info *c_info) {
  */
 t_cache_loc
 translate_block_instructions(t_risc_instr *block_cache, int instructions_in_block, const context_info *c_info) {
+    //the instructions may use fp registers
+    return translate_instructions(block_cache, instructions_in_block, c_info, 0, NULL, true);
+}
+
+/**
+ * Translates the parsed instructions of a hot block or trace with the optimizing tier.
+ * In addition to the baseline translation, the replacement registers are allocated by looking ahead in the block:
+ * the register evicted is the one referenced again the latest, rather than the least recently used one,
+ * which saves reloads and write-backs in blocks using many unmapped registers.
+ * Frequently used unmapped registers are also promoted into host registers for the regions between the exits of the
+ * block (see regalloc.c), and redundant loads and stores are eliminated before (see forward.c).
+ *
+ * @param block_cache the array of parsed RISC-V instructions
+ * @param instructions_in_block the number of instructions in block_cache
+ * @param c_info the context info for this block
+ * @param isFloatBlock whether the instructions use fp registers
+ * @return the cached location of the generated block.
+ */
+t_cache_loc
+translate_optimized_block_instructions(t_risc_instr *block_cache, int instructions_in_block,
+                                       const context_info *c_info, bool isFloatBlock) {
+    lookahead_instrs = block_cache;
+    lookahead_count = instructions_in_block;
+    t_cache_loc block = translate_instructions(block_cache, instructions_in_block, c_info, 0, NULL, isFloatBlock);
+    lookahead_instrs = NULL;
+    return block;
+}
+
+/**
+ * Whether the passed instruction ends the region the replacement registers are kept in,
+ * as it leaves the block or hands over the context.
+ */
+static bool ends_lookahead(const t_risc_instr *instr) {
+    switch (instr->mnem) {
+        case BEQ:
+        case BNE:
+        case BLT:
+        case BGE:
+        case BLTU:
+        case BGEU:
+        case JAL:
+        case JALR:
+        case ECALL:
+        case FENCE_I:
+        case MANUAL_CSRR:
+        case PC_NEXT_INST:
+        case INVALID_MNEM:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * Get the distance in instructions from the current instruction to the next one referencing the passed register,
+ * or SIZE_MAX if there is none before the replacement registers are invalidated anyways.
+ */
+static size_t next_reference_distance(t_risc_reg reg) {
+    for (int i = lookahead_pos; i < lookahead_count; i++) {
+        const t_risc_instr *instr = &lookahead_instrs[i];
+        if (instr->mnem != SILENT_NOP &&
+                (instr->reg_src_1 == reg || instr->reg_src_2 == reg || instr->reg_dest == reg)) {
+            return i - lookahead_pos;
+        }
+        if (ends_lookahead(instr)) break;
+    }
+    return SIZE_MAX;
+}
+
+/**
+ * Select the replacement register to load another RISC-V register into, in blocks translated by the optimizing tier.
+ * Free registers come first, then the one whose content is referenced again the latest.
+ * Registers loaded for the current instruction are spared, as it may still use them.
+ * @param r_info the register mapping info
+ * @return the index of the replacement register, or -1 if the least recently used one should be taken
+ */
+int select_replacement_by_next_use(const register_info *r_info) {
+    if (lookahead_instrs == NULL) return -1;
+
+    int victim = -1;
+    size_t victim_distance = 0;
+    for (int i = 0; i < N_REPLACE; i++) {
+        if (r_info->replacement_recency[i] == 0 || r_info->replacement_content[i] == INVALID_REG) return i;
+        if (r_info->replacement_recency[i] > lookahead_start_recency) continue;
+
+        size_t distance = next_reference_distance(r_info->replacement_content[i]);
+        if (victim == -1 || distance > victim_distance || (distance == victim_distance &&
+                r_info->replacement_recency[i] < r_info->replacement_recency[victim])) {
+            victim = i;
+            victim_distance = distance;
+        }
+    }
+    return victim;
+}
+
+/**
+ * Translates the parsed instructions into a new memory page, optionally counting the executions of the block.
+ *
+ * @param block_cache the array of parsed RISC-V instructions
+ * @param instructions_in_block the number of instructions in block_cache
+ * @param c_info the context info for this block
+ * @param risc_addr the RISC-V address of the block
+ * @param counter the execution counter of the block (see trace.c), or NULL
+ * @param float_block whether the instructions use fp registers, which are then loaded on entry if necessary
+ * @return the cached location of the generated block.
+ */
+static t_cache_loc
+translate_instructions(t_risc_instr *block_cache, int instructions_in_block, const context_info *c_info,
+                       t_risc_addr risc_addr, int64_t *counter, bool float_block) {
     ///initialize new block
     init_block(c_info->r_info);
 
+    ///count down the executions left until the block is hot
+    if (counter != NULL) {
+        err |= fe_enc64(&current, FE_SUB64mi, FE_MEM_ADDR((intptr_t) counter), 1);
+        hot_site = current;
+        hot_risc_addr = risc_addr;
+        err |= fe_enc64(&current, FE_JZ | FE_JMPL, (intptr_t) current); //dummy
+    }
+
+    if (float_block) {
+        emit_load_fp_context(c_info);
+    }
+
+    ///optimize the parsed instructions, dropping dead ones needs the liveness analysis
+    int rewritten = 0;
+    int forwarded = 0;
+    int fused = 0;
+    int eliminated = 0;
+    if (flag_translate_opt_propagate) {
+        rewritten = propagate_block(block_cache, instructions_in_block, c_info->r_info);
+    }
+    if (lookahead_instrs != NULL && flag_translate_opt_forward) {
+        forwarded = forward_memory_values(block_cache, instructions_in_block);
+    }
+    if (flag_translate_opt_fusion) {
+        fused = fuse_compare_branches(block_cache, instructions_in_block);
+    }
+    if (flag_translate_opt_propagate && flag_translate_opt_liveness) {
+        eliminated = eliminate_dead_instructions(block_cache, instructions_in_block);
+    }
+    if (flag_do_profile) profile_block_optimization(rewritten, forwarded, fused, eliminated);
+
     ///apply macro optimization
     if (flag_translate_opt_fusion) {
         optimize_patterns(block_cache, instructions_in_block);
     }
 
+    ///find the registers whose replacement registers need no write-back
+    bool liveness = flag_translate_opt_liveness;
+    t_arena_mark mark = arena_mark(&scratch_arena);
+    t_reg_set *block_liveness = NULL;
+    if (liveness) {
+        block_liveness = arena_alloc(&scratch_arena, instructions_in_block * sizeof(t_reg_set));
+        analyze_liveness(block_cache, instructions_in_block, block_liveness);
+    }
+
     /// translate structs
+    bool allocate = lookahead_instrs != NULL && flag_translate_opt_regalloc;
     for (int i = 0; i < instructions_in_block; i++) {
+        ///restore the static mapping before leaving the region, and start a new one after it
+        if (allocate && ends_lookahead(&block_cache[i])) {
+            end_region_allocation(c_info->r_info);
+        } else if (allocate && !region_allocation_active()) {
+            int end = i;
+            while (end < instructions_in_block && !ends_lookahead(&block_cache[end])) end++;
+            begin_region_allocation(&block_cache[i], end - i, c_info->r_info);
+        }
+
+        lookahead_pos = i;
+        lookahead_start_recency = *c_info->r_info->current_recency;
+        live_registers = liveness ? block_liveness[i] : ALL_LIVE;
+        ecall_syscall_number =
+                block_cache[i].mnem == ECALL ? find_syscall_number(block_cache, i) : UNKNOWN_SYSCALL;
         translate_risc_instr(&block_cache[i], c_info);
     }
+    end_region_allocation(c_info->r_info);
+    arena_reset(&scratch_arena, mark);
 
-    t_cache_loc block;
-    ///finalize block and return cached location
-    if (
-        //block_cache[instructions_in_block - 1].mnem == JALR ||
-            block_cache[instructions_in_block - 1].mnem == ECALL) {
-        block = finalize_block(LINK_NULL, c_info->r_info);
-    } else {
-        block = finalize_block(DONT_LINK, c_info->r_info);
+    ///finalize block and return cached location, the exits are chained individually (see emit_exit())
+    t_cache_loc block = finalize_block(c_info->r_info);
+    live_registers = ALL_LIVE;
+
+    if (flag_do_profile) {
+        ///the pseudo instruction setting pc is not a guest instruction
+        int guest_instructions = instructions_in_block - (block_cache[instructions_in_block - 1].mnem == PC_NEXT_INST);
+        profile_emitted_code(guest_instructions, (uint8_t *) currentPos - (uint8_t *) block);
     }
 
     return block;
 }
 
+/**
+ * Get the maximum number of instructions per block.
+ * @param hot whether the block is parsed as part of a trace by the optimizing tier
+ */
+int get_block_length_limit(bool hot) {
+    if (flag_single_step) {
+        ///one instruction and the pseudo instruction setting pc
+        return 2;
+    }
+    size_t limit = hot ? trace_length : block_length;
+    return limit < 2 ? 2 : limit > MAX_BLOCK_LENGTH ? MAX_BLOCK_LENGTH : (int) limit;
+}
+
+/**
+ * Start an empty parse buffer in the scratch arena.
+ */
+void init_parse_buffer(t_parse_buffer *buffer) {
+    buffer->capacity = INITIAL_PARSE_CAPACITY;
+    buffer->count = 0;
+    buffer->instrs = arena_alloc(&scratch_arena, buffer->capacity * sizeof(t_risc_instr));
+}
+
+/**
+ * Make room for the passed number of instructions behind the ones already in the parse buffer.
+ * Nothing else is allocated from the scratch arena while parsing, so the buffer usually grows in place.
+ * @return the position behind the instructions in the buffer
+ */
+static t_risc_instr *reserve_parse_buffer(t_parse_buffer *buffer, int count) {
+    if (buffer->count + count > buffer->capacity) {
+        int capacity = buffer->capacity;
+        while (buffer->count + count > capacity) capacity *= 2;
+        buffer->instrs = arena_grow(&scratch_arena, buffer->instrs, buffer->capacity * sizeof(t_risc_instr),
+                                    capacity * sizeof(t_risc_instr));
+        buffer->capacity = capacity;
+    }
+    return buffer->instrs + buffer->count;
+}
+
 /**
  * Parse the instructions in the block starting at the given address.
+ * If the block reaches maxCount instructions, it is split: it ends with a PC_NEXT_INST pseudo instruction
+ * continuing at the next address.
  * @param risc_addr the RISC-V address the block starts at.
- * @param parse_buf the buffer to place the parsed instructions into.
- * @param maxCount the maximum number of parsed instructions to be parsed. parse_buf is at least this big.
- * @param c_info the context info for this block.
- * @return
+ * @param buffer the buffer to append the parsed instructions to, grown as needed.
+ * @param maxCount the maximum number of parsed instructions to be parsed, at least 2.
+ * @param isFloatBlock set if the instructions use fp registers.
+ * @return the number of instructions appended to the buffer
  */
-int parse_block(t_risc_addr risc_addr, t_risc_instr *parse_buf, int maxCount, const context_info *c_info,
-                bool *isFloatBlock) {
+int parse_block(t_risc_addr risc_addr, t_parse_buffer *buffer, int maxCount, bool *isFloatBlock) {
 
     int instructions_in_block = 0;
+    t_risc_instr *parse_buf = buffer->instrs + buffer->count;
 
     ///parse structs
     for (int parse_pos = 0; parse_pos <= maxCount - 2; parse_pos++) { //-2 rather than -1 bc of final AUIPC
 
+        ///room for this instruction and the final pseudo instruction
+        parse_buf = reserve_parse_buffer(buffer, parse_pos + 2);
         parse_buf[parse_pos] = (t_risc_instr) {.addr=risc_addr};
 
         //printf("parse at: %p", (void*)block_cache[parse_pos].addr);
 
-        parse_instruction(&parse_buf[parse_pos]);
+        parse_instruction_cached(&parse_buf[parse_pos]);
 
         switch (parse_buf[parse_pos].optype) {
 
@@ -277,11 +582,12 @@ int parse_block(t_risc_addr risc_addr, t_risc_instr *parse_buf, int maxCount, co
             {
                 switch (parse_buf[parse_pos].mnem) {
                     case ECALL:
-                        ///Potential program end stop parsing
+                    case FENCE_I:
+                        ///Potential program end or code modification stop parsing
+                        enqueue_successor(risc_addr + 4);
                         instructions_in_block++;
                         goto PARSE_DONE;
                     case FENCE:
-                    case FENCE_I:
                         ///ignore get next instruction address
                         risc_addr += 4;
                         parse_pos--; //decrement for next loop cycle
@@ -319,6 +625,8 @@ int parse_block(t_risc_addr risc_addr, t_risc_instr *parse_buf, int maxCount, co
                 break;
             case BRANCH : {    ///BEQ, BNE, BLT, BGE, BLTU, BGEU, syscalls
                 ///destination address unknown at translate time, stop parsing
+                enqueue_successor(risc_addr + parse_buf[parse_pos].imm);
+                enqueue_successor(risc_addr + 4);
                 instructions_in_block++;
                 goto PARSE_DONE;
             }
@@ -329,6 +637,10 @@ int parse_block(t_risc_addr risc_addr, t_risc_instr *parse_buf, int maxCount, co
                     case JAL : {
                         if (!flag_translate_opt_jump) {
                             ///could follow, but cache
+                            enqueue_successor(risc_addr + parse_buf[parse_pos].imm);
+                            if (parse_buf[parse_pos].reg_dest != x0) {
+                                enqueue_successor(risc_addr + 4);
+                            }
                             instructions_in_block++;
                             goto PARSE_DONE;
                         }
@@ -337,56 +649,20 @@ int parse_block(t_risc_addr risc_addr, t_risc_instr *parse_buf, int maxCount, co
                             ///could follow, but cache
                             instructions_in_block++;
 
-                            ///1: recursively translate target
-                            {
-                                t_risc_addr target = risc_addr + parse_buf[parse_pos].imm;
-
-                                t_cache_loc cache_loc = lookup_cache_entry(target);
-
-                                if (cache_loc == UNSEEN_CODE) {
-                                    log_asm_out("Recursion in JAL from (riscv)%p to target (riscv)%p\n",
-                                                (void *) risc_addr, (void *) target);
-                                    set_cache_entry(target, TRANSLATION_STARTED); //break cycles
-                                    cache_loc = translate_block(target, c_info);
-                                    set_cache_entry(target, cache_loc);
-                                }
-                            }
+                            ///1: translate target ahead
+                            enqueue_translation(risc_addr + parse_buf[parse_pos].imm);
 
-
-                            ///2: recursively translate return addr (+4)
+                            ///2: translate return addr (+4) ahead
                             //dead ends could arise here
-                            {
-                                t_risc_addr ret_target = risc_addr + 4;
-                                t_cache_loc cache_loc = lookup_cache_entry(ret_target);
-
-                                if (cache_loc == UNSEEN_CODE) {
-                                    log_asm_out("Recursion in JAL from (riscv)%p to ret_target(+4) (riscv)%p\n",
-                                                (void *) risc_addr, (void *) ret_target);
-                                    set_cache_entry(ret_target, TRANSLATION_STARTED); //break cycles
-                                    cache_loc = translate_block(ret_target, c_info);
-                                    set_cache_entry(ret_target, cache_loc);
-                                }
-                            }
+                            enqueue_translation(risc_addr + 4);
 
                             goto PARSE_DONE;
 
                         } else if (parse_buf[parse_pos].reg_dest != x0) {
                             instructions_in_block++;
 
-                            ///1: recursively translate target
-                            {
-                                t_risc_addr target = risc_addr + parse_buf[parse_pos].imm;
-
-                                t_cache_loc cache_loc = lookup_cache_entry(target);
-
-                                if (cache_loc == UNSEEN_CODE) {
-                                    log_asm_out("Recursion in JAL from (riscv)%p to target (riscv)%p\n",
-                                                (void *) risc_addr, (void *) target);
-                                    set_cache_entry(target, TRANSLATION_STARTED); //break cycles
-                                    cache_loc = translate_block(target, c_info);
-                                    set_cache_entry(target, cache_loc);
-                                }
-                            }
+                            ///1: translate target ahead
+                            enqueue_translation(risc_addr + parse_buf[parse_pos].imm);
                             goto PARSE_DONE;
                         }
 
@@ -408,7 +684,8 @@ int parse_block(t_risc_addr risc_addr, t_risc_instr *parse_buf, int maxCount, co
                                 x0,
                                 x0,
                                 parse_buf[parse_pos].reg_dest,
-                                {{4}}
+                                {{4}},
+                                TRACE_NONE
                         };
 
                         instructions_in_block++;
@@ -420,24 +697,16 @@ int parse_block(t_risc_addr risc_addr, t_risc_instr *parse_buf, int maxCount, co
                         break;
 
                     case JALR : {
+                        if (parse_buf[parse_pos].reg_dest != x0) {
+                            enqueue_successor(risc_addr + 4);
+                        }
 
-                        if (flag_translate_opt_ras &&
+                        if ((flag_translate_opt_ras || flag_host_ras) &&
                                 (parse_buf[parse_pos].reg_dest == x1 || parse_buf[parse_pos].reg_dest == x5)) {
 
-                            ///1: recursively translate return addr (+4)
+                            ///1: translate return addr (+4) ahead
                             //dead ends could arise here
-                            {
-                                t_risc_addr ret_target = risc_addr + 4;
-                                t_cache_loc cache_loc = lookup_cache_entry(ret_target);
-
-                                if (cache_loc == UNSEEN_CODE) {
-                                    log_asm_out("Recursion in JALR from (riscv)%p to ret_target(+4) (riscv)%p\n",
-                                                (void *) risc_addr, (void *) ret_target);
-                                    set_cache_entry(ret_target, TRANSLATION_STARTED); //break cycles
-                                    cache_loc = translate_block(ret_target, c_info);
-                                    set_cache_entry(ret_target, cache_loc);
-                                }
-                            }
+                            enqueue_translation(risc_addr + 4);
                         }
 
                         if (flag_translate_opt_jump &&
@@ -454,36 +723,12 @@ int parse_block(t_risc_addr risc_addr, t_risc_instr *parse_buf, int maxCount, co
                                 log_asm_out("---------WRONG POP JALR------------\n");
                             }
 
-                            ///1: recursively translate return addr (+4)
+                            ///1: translate return addr (+4) ahead
                             //dead ends could arise here
-                            {
-                                t_risc_addr ret_target = risc_addr + 4;
-                                t_cache_loc cache_loc = lookup_cache_entry(ret_target);
-
-                                if (cache_loc == UNSEEN_CODE) {
-                                    log_asm_out("Recursion in JALR from (riscv)%p to ret_target(+4) (riscv)%p\n",
-                                                (void *) risc_addr, (void *) ret_target);
-                                    set_cache_entry(ret_target, TRANSLATION_STARTED); //break cycles
-                                    cache_loc = translate_block(ret_target, c_info);
-                                    set_cache_entry(ret_target, cache_loc);
-                                }
-                            }
-
-                            ///2: recursively translate target
-                            {
-                                t_risc_addr target =
-                                        (risc_addr - 4) + parse_buf[parse_pos - 1].imm + parse_buf[parse_pos].imm;
-
-                                t_cache_loc cache_loc = lookup_cache_entry(target);
+                            enqueue_translation(risc_addr + 4);
 
-                                if (cache_loc == UNSEEN_CODE) {
-                                    log_asm_out("Recursion in JALR from (riscv)%p to target (riscv)%p\n",
-                                                (void *) risc_addr, (void *) target);
-                                    set_cache_entry(target, TRANSLATION_STARTED); //break cycles
-                                    cache_loc = translate_block(target, c_info);
-                                    set_cache_entry(target, cache_loc);
-                                }
-                            }
+                            ///2: translate target ahead
+                            enqueue_translation((risc_addr - 4) + parse_buf[parse_pos - 1].imm + parse_buf[parse_pos].imm);
 
                             ///3: tell translate_JALR to chain
                             parse_buf[parse_pos].reg_src_2 = 1;
@@ -520,36 +765,126 @@ int parse_block(t_risc_addr risc_addr, t_risc_instr *parse_buf, int maxCount, co
 
     }
 
-    ///loop ended at BLOCK_CACHE_SIZE -> set pc for next instruction
+    ///loop ended at maxCount -> set pc for next instruction
     ///insert Pseudo instruction (has the address for the next PC in immediate field) for this
-    parse_buf[maxCount - 1] = (t_risc_instr) {.imm=risc_addr, .mnem=PC_NEXT_INST, .optype=PSEUDO};
+    enqueue_successor(risc_addr);
+    parse_buf[instructions_in_block] = (t_risc_instr) {.imm=risc_addr, .mnem=PC_NEXT_INST, .optype=PSEUDO};
     instructions_in_block++;
 
     ///loop ended at BRANCH: skip setting pc
     PARSE_DONE:
 
+    buffer->count += instructions_in_block;
     return instructions_in_block;
 }
 
 /**
- * inserts direct jumps after first cache lookup in main
- * */
-void chain(t_cache_loc target) {
-    if (!flag_translate_opt_chain) return;
-    int chain_err = 0;
-    if (chain_end != NULL) {
-        log_general("chaining: ...\n");
-        chain_err |= fe_enc64((uint8_t **) &chain_end, chain_type|FE_JMPL, (intptr_t) target);
-        ///Reset chain_end
-        chain_end = NULL;
-    }
-
-
-    ///check failed flag
-    if (chain_err != 0) {
-        ///terminate if we encounter errors. this most likely is a bug in a RISC-V instruction's translation
-        dprintf(2, "Assembly error in chain, exiting...\n");
-        panic(FAIL_ASSEMBLY_ERR);
+ * Emit the lazy load of the mapped fp registers, for code using them that may run while they are not loaded,
+ * e.g. after a block not using them returned to the dispatcher.
+ * @param c_info the context info
+ */
+void emit_load_fp_context(const context_info *c_info) {
+    if (c_info->load_fp_context == NULL) return;
+
+    err |= fe_enc64(&current, FE_CMP8mi, FE_MEM_ADDR((intptr_t) &fp_context_loaded), 0);
+    uint8_t *jmpLoaded = current;
+    err |= fe_enc64(&current, FE_JNZ, (intptr_t) current); //dummy
+    err |= fe_enc64(&current, FE_CALL, (intptr_t) c_info->load_fp_context);
+    err |= fe_enc64(&jmpLoaded, FE_JNZ, (intptr_t) current);
+}
+
+/**
+ * Emit an exit of the current block towards a statically known RISC-V address.
+ * With chaining enabled, this is a patchable jump that leads to the target's block directly if it was already
+ * translated, or else to a fallback that sets pc and returns to the dispatcher until the target gets translated
+ * and the exit is linked (see link_exits()).
+ * The fallback continues behind the emitted code, so the block has to end there.
+ * @param target the RISC-V address the exit leads to
+ * @param r_info the register mapping info
+ */
+void emit_exit(t_risc_addr target, const register_info *r_info) {
+    uint8_t *site = NULL;
+    if (flag_translate_opt_chain) {
+        site = current;
+        err |= fe_enc64(&current, FE_JMP | FE_JMPL, (intptr_t) current); //dummy
+    }
+    emit_exit_at(site, FE_JMP, target, r_info);
+}
+
+/**
+ * Emit an exit of the current block whose jump has already been emitted by the caller, but whose fallback is
+ * placed out of line behind the end of the block, so the code can continue behind the jump.
+ * Used for the side exits of traces.
+ * @param site the jump instruction, emitted with FE_JMPL so it can be patched
+ * @param type the mnemonic the jump at site is encoded with
+ * @param target the RISC-V address the exit leads to
+ */
+void defer_exit(uint8_t *site, uint64_t type, t_risc_addr target) {
+    if (count_deferred_exits == MAX_DEFERRED_EXITS) {
+        dprintf(2, "Too many deferred exits in block.\n");
+        panic(FAIL_INVALID_STATE);
+    }
+    deferred_exits[count_deferred_exits].site = site;
+    deferred_exits[count_deferred_exits].type = type;
+    deferred_exits[count_deferred_exits].target = target;
+    count_deferred_exits++;
+}
+
+/**
+ * Emit a stub entering the block at the passed RISC-V address, for code that needs a host address of that block
+ * before it is translated, e.g. the return stack. The stub is an exit that gets linked once the block is translated,
+ * until then its fallback sets pc and returns to the dispatcher.
+ * The stub is placed within the current block, which jumps over it.
+ * @param target the RISC-V address of the block
+ * @return the host address of the stub
+ */
+t_cache_loc emit_entry_stub(t_risc_addr target) {
+    uint8_t *jmpOver = current;
+    err |= fe_enc64(&current, FE_JMP | FE_JMPL, (intptr_t) current); //dummy
+    uint8_t *stub = current;
+    err |= fe_enc64(&current, FE_JMP | FE_JMPL, (intptr_t) current); //dummy
+    defer_exit(stub, FE_JMP, target);
+    err |= fe_enc64(&jmpOver, FE_JMP | FE_JMPL, (intptr_t) current);
+    return (t_cache_loc) stub;
+}
+
+/**
+ * Emit the fallback of an exit whose jump has already been emitted by the caller, e.g. the jcc of a branch,
+ * and direct that jump to either the target's block or the fallback.
+ * @param site the jump instruction, emitted with FE_JMPL so it can be patched, or NULL if there is none
+ * @param type the mnemonic of the jump at site
+ * @param target the RISC-V address the exit leads to
+ * @param r_info the register mapping info
+ */
+void emit_exit_at(uint8_t *site, uint64_t type, t_risc_addr target, const register_info *r_info) {
+    ///fallback: set pc
+    uint8_t *fallback = current;
+    if (flag_do_profile) {
+        err |= fe_enc64(&current, FE_INC64m, FE_MEM_ADDR((intptr_t) get_unlinked_exit_counter()));
+    }
+    if (r_info->gp_mapped[pc]) {
+        err |= fe_enc64(&current, FE_MOV64ri, r_info->gp_map[pc], target);
+    } else {
+        err |= fe_enc64(&current, FE_MOV64mi, FE_MEM_ADDR(r_info->base + 8 * pc), target);
+    }
+
+    if (site == NULL) return;
+
+    ///jump directly to the target if it is already there, else record the exit for chaining
+    t_cache_loc cache_loc = UNSEEN_CODE;
+    if (flag_translate_opt_chain) {
+        cache_loc = lookup_cache_entry(target);
+    }
+    bool linked = cache_loc != UNSEEN_CODE;
+    if (linked) {
+        log_asm_out("DIRECT JUMP to (riscv)%p\n", (void *) target);
+    }
+
+    uint8_t *patch = site;
+    err |= fe_enc64(&patch, type | FE_JMPL, (intptr_t) (linked ? cache_loc : fallback));
+
+    if (flag_translate_opt_chain) {
+        register_exit(target, site, fallback, type, linked);
     }
 }
 
@@ -569,3 +904,54 @@ void setupInstrMem() {
         panic(FAIL_HEAP_ALLOC);
     }
 }
+
+/**
+ * Mark the start of the memory for translated blocks.
+ * Call this after init_map_context() so the context switching routines are kept separate from the blocks.
+ */
+void setupBlockMem(void) {
+    currentPos = (void *) (((uintptr_t) currentPos + 0xfff) & ~(uintptr_t) 0xfff);
+    blockMemStart = currentPos;
+}
+
+/**
+ * Get the number of bytes of translated code currently in the code cache.
+ */
+size_t get_code_cache_usage(void) {
+    return (uint8_t *) currentPos - (uint8_t *) blockMemStart;
+}
+
+/**
+ * Throw away all translated blocks and start over with an empty code cache.
+ * Besides the code itself, this drops everything pointing into it: the cache table and tlb, the block exits,
+ * the return stack, the execution counters and the blocks pending translation.
+ * Must only be called from the main loop, while neither translated code nor a translation is running.
+ */
+void flush_code_cache(void) {
+    size_t used = get_code_cache_usage();
+    log_cache("Flushing code cache (%lu bytes used)...\n", used);
+    if (flag_do_profile) profile_code_cache_flush(used);
+
+    clear_cache_table();
+    clear_return_stack();
+    clear_block_counters();
+    clear_pending_translations();
+    smc_reset();
+
+    ///hand the memory back, it is faulted in again when translating
+    syscall(__NR_madvise, (long) blockMemStart, (long) (((uintptr_t) used + 0xfff) & ~(uintptr_t) 0xfff),
+            MADV_DONTNEED, 0, 0, 0);
+    currentPos = blockMemStart;
+}
+
+/**
+ * Flush the code cache if it exceeds the limit set via --cache-size, or if the guest requested it (FENCE.I).
+ * The limit is soft: it is only checked between the execution of blocks,
+ * so translating a block and the blocks discovered ahead of it may overshoot it.
+ */
+void check_code_cache_limit(void) {
+    if (code_cache_flush_requested || (code_cache_limit != 0 && get_code_cache_usage() >= code_cache_limit)) {
+        code_cache_flush_requested = false;
+        flush_code_cache();
+    }
+}
@@ -17,24 +17,31 @@ extern "C" {
 //shortcut for memory operands
 #define FE_MEM_ADDR(addr) FE_MEM(FE_IP, 0, 0, (addr) - (intptr_t) current)
 
-///chainLink options
-#define LINK_NULL 0
-#define LINK_ADDR 1
-#define DONT_LINK 2
-
 #define FIRST_REG FE_AX
 #define SECOND_REG FE_DX
 #define THIRD_REG FE_CX
 #define FIRST_FP_REG FE_XMM0
 #define SECOND_FP_REG FE_XMM1
 
+/**
+ * Parsed instructions of a block or trace, in a buffer from the scratch arena that grows as needed.
+ */
+typedef struct {
+    t_risc_instr *instrs;
+    int count;
+    int capacity;
+} t_parse_buffer;
+
 extern uint8_t *current;
 extern int err;
+extern void *currentPos;
+extern void *blockMemStart;
+extern bool code_cache_flush_requested;
 
 //basic block translation management
 void init_block(register_info *r_info);
 
-t_cache_loc finalize_block(int chainLinkOp, const register_info *r_info);
+t_cache_loc finalize_block(const register_info *r_info);
 
 ///basic block translation
 t_cache_loc translate_block(t_risc_addr risc_addr, const context_info *c_info);
@@ -42,11 +49,39 @@ t_cache_loc translate_block(t_risc_addr risc_addr, const context_info *c_info);
 t_cache_loc
 translate_block_instructions(t_risc_instr *block_cache, int instructions_in_block, const context_info *c_info);
 
+t_cache_loc
+translate_optimized_block_instructions(t_risc_instr *block_cache, int instructions_in_block,
+                                       const context_info *c_info, bool isFloatBlock);
+
+int select_replacement_by_next_use(const register_info *r_info);
+
+int get_block_length_limit(bool hot);
+
+void init_parse_buffer(t_parse_buffer *buffer);
+
+int parse_block(t_risc_addr risc_addr, t_parse_buffer *buffer, int maxCount, bool *isFloatBlock);
+
+void emit_load_fp_context(const context_info *c_info);
+
 ///chaining
-void chain(t_cache_loc target);
+void emit_exit(t_risc_addr target, const register_info *r_info);
+
+void emit_exit_at(uint8_t *site, uint64_t type, t_risc_addr target, const register_info *r_info);
+
+void defer_exit(uint8_t *site, uint64_t type, t_risc_addr target);
+
+t_cache_loc emit_entry_stub(t_risc_addr target);
 
 void setupInstrMem();
 
+void setupBlockMem(void);
+
+size_t get_code_cache_usage(void);
+
+void flush_code_cache(void);
+
+void check_code_cache_limit(void);
+
 #ifdef __cplusplus
 }
 #endif
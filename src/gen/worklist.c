@@ -0,0 +1,167 @@
+/**
+ * Worklist of blocks to translate ahead of their execution.
+ * While parsing a block, the statically known targets it may continue at (jump targets, return addresses) are not
+ * translated right away but queued here. The dispatcher translates a limited number of them each time it translates
+ * a block on demand (--translate-ahead), so the latency of reaching a new block stays bounded instead of depending
+ * on how much code is reachable from it.
+ * The exits towards queued blocks are linked as soon as these get translated (see chain.c), also if the guest
+ * reaches them first and they are translated on demand.
+ *
+ * With --aot, all code reachable from the entry point and the function symbols is translated before the guest runs:
+ * then the successors of every block (branch targets, fall-through after syscalls or length splits) are queued as
+ * well, as long as they lie within the executable sections, and the worklist is drained completely.
+ */
+
+#include "worklist.h"
+#include <common.h>
+#include <linux/mman.h>
+#include <gen/translate.h>
+#include <cache/cache.h>
+#include <env/exit.h>
+#include <env/opt.h>
+#include <util/arena.h>
+#include <util/log.h>
+#include <util/tools/profile.h>
+#include <env/flags.h>
+
+//pending blocks, targets discovered while the worklist is full are only translated once they are reached
+#define WORKLIST_SIZE 4096
+
+static t_risc_addr *worklist = NULL;
+static size_t worklist_size = WORKLIST_SIZE;
+//position of the oldest pending block and number of pending blocks
+static size_t worklist_head = 0;
+static size_t worklist_count = 0;
+
+//range of the executable sections while translating ahead of time, empty otherwise
+static t_risc_addr discover_start = 0;
+static t_risc_addr discover_end = 0;
+
+static t_risc_addr *alloc_worklist(size_t size) {
+    t_risc_addr *buf = mmap(NULL, size * sizeof(t_risc_addr), PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE,
+                            -1, 0);
+    if (BAD_ADDR(buf)) {
+        dprintf(2, "Bad. Worklist memory allocation failed.\n");
+        panic(FAIL_HEAP_ALLOC);
+    }
+    return buf;
+}
+
+/**
+ * Double the size of the worklist, only done while translating ahead of time so nothing gets lost.
+ */
+static void grow_worklist(void) {
+    t_risc_addr *grown = alloc_worklist(2 * worklist_size);
+    for (size_t i = 0; i < worklist_count; i++) {
+        grown[i] = worklist[(worklist_head + i) % worklist_size];
+    }
+    munmap(worklist, worklist_size * sizeof(t_risc_addr));
+    worklist = grown;
+    worklist_size <<= 1u;
+    worklist_head = 0;
+}
+
+/**
+ * Queue the block at the passed address for translation, if it has not been translated yet.
+ * @param risc_addr the RISC-V address of the block
+ */
+void enqueue_translation(t_risc_addr risc_addr) {
+    if (lookup_cache_entry(risc_addr) != UNSEEN_CODE) return;
+
+    if (worklist == NULL) {
+        worklist = alloc_worklist(worklist_size);
+    }
+    if (worklist_count == worklist_size) {
+        if (discover_end == 0) return;
+        grow_worklist();
+    }
+
+    log_asm_out("Queued (riscv)%p for translation\n", (void *) risc_addr);
+    worklist[(worklist_head + worklist_count) % worklist_size] = risc_addr;
+    worklist_count++;
+}
+
+/**
+ * Queue a block the block currently parsed may continue at other than by a jump, e.g. a branch target.
+ * This is only done while translating ahead of time, else such blocks are translated once they are reached.
+ * @param risc_addr the RISC-V address of the successor
+ */
+void enqueue_successor(t_risc_addr risc_addr) {
+    if (risc_addr >= discover_start && risc_addr < discover_end) {
+        enqueue_translation(risc_addr);
+    }
+}
+
+static bool code_cache_full(void) {
+    return code_cache_limit != 0 && get_code_cache_usage() >= code_cache_limit;
+}
+
+/**
+ * Translate pending blocks in the order they were discovered, including the blocks discovered meanwhile.
+ * Blocks that were translated on demand in the meantime are skipped.
+ * Stops early once the code cache limit (--cache-size) is reached.
+ * @param c_info the context info
+ * @param budget the maximum number of blocks to translate
+ * @return the number of blocks translated
+ */
+size_t translate_pending_blocks(const context_info *c_info, size_t budget) {
+    size_t translated = 0;
+    while (translated < budget && worklist_count > 0 && !code_cache_full()) {
+        t_risc_addr risc_addr = worklist[worklist_head];
+        worklist_head = (worklist_head + 1) % worklist_size;
+        worklist_count--;
+
+        if (lookup_cache_entry(risc_addr) != UNSEEN_CODE) continue;
+
+        set_cache_entry(risc_addr, translate_block(risc_addr, c_info));
+        translated++;
+    }
+    if (flag_do_profile) profile_translate_ahead(translated);
+    return translated;
+}
+
+/**
+ * Translate all code reachable from the entry point and the function symbols of the guest binary before running it
+ * (--aot). The blocks are chained among each other, so the guest only returns to the dispatcher for indirect jumps
+ * the inline lookup misses, syscalls and code that could not be discovered statically.
+ * @param file_path the path of the guest binary, for its symbol table
+ * @param map the result of mapping the binary
+ * @param c_info the context info
+ */
+void translate_ahead_of_time(const char *file_path, const t_risc_elf_map_result *map, const context_info *c_info) {
+    discover_start = map->execStart;
+    discover_end = map->execEnd;
+
+    t_arena_mark mark = arena_mark(&scratch_arena);
+    size_t count_symbols;
+    t_risc_addr *symbols = readFunctionSymbols(file_path, &count_symbols);
+
+    enqueue_successor(map->entry);
+    for (size_t i = 0; i < count_symbols; i++) {
+        enqueue_successor(symbols[i]);
+    }
+    arena_reset(&scratch_arena, mark);
+
+    size_t translated = translate_pending_blocks(c_info, SIZE_MAX);
+    log_general("Translated %lu blocks ahead of time (%lu function symbols, code cache %lu bytes).\n", translated,
+                count_symbols, get_code_cache_usage());
+    if (worklist_count > 0) {
+        dprintf(2, "Warning: Code cache limit reached, %lu blocks are translated once they are reached.\n",
+                worklist_count);
+    }
+
+    discover_start = 0;
+    discover_end = 0;
+}
+
+size_t get_pending_translation_count(void) {
+    return worklist_count;
+}
+
+/**
+ * Drop all pending blocks, e.g. because the code cache was flushed.
+ */
+void clear_pending_translations(void) {
+    worklist_head = 0;
+    worklist_count = 0;
+}
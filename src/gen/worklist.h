@@ -0,0 +1,28 @@
+#ifndef DYNAMICBINARYTRANSLATORRISCV64_X86_64_WORKLIST_H
+#define DYNAMICBINARYTRANSLATORRISCV64_X86_64_WORKLIST_H
+
+#include <util/typedefs.h>
+#include <main/context.h>
+#include <elf/loadElf.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void enqueue_translation(t_risc_addr risc_addr);
+
+void enqueue_successor(t_risc_addr risc_addr);
+
+size_t translate_pending_blocks(const context_info *c_info, size_t budget);
+
+void translate_ahead_of_time(const char *file_path, const t_risc_elf_map_result *map, const context_info *c_info);
+
+size_t get_pending_translation_count(void);
+
+void clear_pending_translations(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //DYNAMICBINARYTRANSLATORRISCV64_X86_64_WORKLIST_H
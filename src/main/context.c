@@ -10,12 +10,299 @@
 #include <common.h>
 #include <linux/mman.h>
 #include <util/util.h>
+#include <util/arena.h>
 #include <env/opt.h>
+#include <util/tools/profile.h>
+#include <gen/trace.h>
+#include <gen/instr/core/translate_other.h>
+#include <main/main.h>
 
 /*
  * Dynamically generated switching blocks should give us the freedom to change the mapping more flexibly.
  */
 
+/**
+ * Whether the mapped floating point registers currently hold the guest's values.
+ * The floating point context is switched lazily: loaded by the first block using floating point registers
+ * (see emit_load_fp_context()), and only stored back by save_context if it was loaded.
+ */
+bool fp_context_loaded = false;
+
+#define N_MAPPED_GP 12
+#define N_MAPPED_FP 14
+
+static const FeReg gp_hosts[N_MAPPED_GP] = {
+        FE_BX, FE_BP, FE_SI, FE_DI, FE_R8, FE_R9, FE_R10, FE_R11, FE_R12, FE_R13, FE_R14, FE_R15
+};
+
+static const FeReg fp_hosts[N_MAPPED_FP] = {
+        FE_XMM2, FE_XMM3, FE_XMM4, FE_XMM5, FE_XMM6, FE_XMM7, FE_XMM8, FE_XMM9, FE_XMM10, FE_XMM11, FE_XMM12,
+        FE_XMM13, FE_XMM14, FE_XMM15
+};
+
+/**
+ * We capture approximately 85 % of the register hits when we map the following registers:
+ * (by order of access frequency)
+ * x15, x14, x13, x10, x8, x2, x12, x11, x9,  x1,  x17, x18
+ * a5,  a4,  a3,  a0,  fp, sp, a2,  a1,  s1,  ra,  a7,  s2
+ *                             into
+ * BX,  BP,  SI,  DI,  R8, R9, R10, R11, R12, R13, R14, R15
+ */
+static const t_risc_reg_mnem default_gp_ranking[N_MAPPED_GP] = {a5, a4, a3, a0, fp, sp, a2, a1, s1, ra, a7, s2};
+
+/**
+ * We capture approximately 81,4 % of the register hits when we map the following registers:
+ * (by order of access frequency)
+ * f15, f14, f9, f13, f12, f10, f11, f1, f0, f3,  f2, f31, f20, f24
+ *                             into
+ * XMM2 - XMM15
+ */
+static const t_risc_fp_reg default_fp_ranking[N_MAPPED_FP] = {
+        f15, f14, f9, f13, f12, f10, f11, f1, f0, f3, f2, f31, f20, f24
+};
+
+/**
+ * Add the register named by the passed token to a ranking, unless it is full or contains the register already.
+ * @return false if the token names no register of the class
+ */
+static bool rank_register(const char *token, bool fp_class, int *ranking, size_t *count, size_t max) {
+    int reg = -1;
+    for (int i = fp_class ? f0 : x1; i <= (fp_class ? f31 : x31); i++) {
+        const char *name = fp_class ? fp_to_string(i) : gp_to_string(i);
+        const char *alias = fp_class ? fp_to_alias(i) : gp_to_alias(i);
+        if (strcmp(token, name) == 0 || strcmp(token, alias) == 0) {
+            reg = i;
+            break;
+        }
+    }
+    if (reg == -1) return false;
+
+    for (size_t i = 0; i < *count; i++) {
+        if (ranking[i] == reg) return true;
+    }
+    if (*count < max) ranking[(*count)++] = reg;
+    return true;
+}
+
+/**
+ * Fill up a ranking read from a mapping file with the default ranking's registers missing in it.
+ */
+static void complete_ranking(int *ranking, size_t count, const int *defaults, size_t max) {
+    for (size_t i = 0; i < max && count < max; i++) {
+        bool present = false;
+        for (size_t j = 0; j < count; j++) {
+            present |= ranking[j] == defaults[i];
+        }
+        if (!present) ranking[count++] = defaults[i];
+    }
+}
+
+/**
+ * Load the register ranking of a mapping file written by save_register_ranking() in an earlier profiled run.
+ * The file consists of a "gp:" and a "fp:" line, each listing register names by decreasing access frequency.
+ * The rankings stay unchanged if the file does not exist or is invalid.
+ * @param path the path of the mapping file
+ * @param gp_ranking the general purpose registers to map, N_MAPPED_GP big
+ * @param fp_ranking the floating point registers to map, N_MAPPED_FP big
+ */
+static void load_register_ranking(const char *path, t_risc_reg *gp_ranking, t_risc_fp_reg *fp_ranking) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0) {
+        log_general("No register mapping file %s yet, using the default mapping.\n", path);
+        return;
+    }
+    char contents[4096];
+    ssize_t size = read_full(fd, contents, sizeof(contents) - 1);
+    close(fd);
+    if (size < 0) {
+        dprintf(2, "Could not read register mapping file %s, using the default mapping.\n", path);
+        return;
+    }
+    contents[size] = '\0';
+
+    int gp[N_MAPPED_GP];
+    int fp[N_MAPPED_FP];
+    size_t gp_count = 0;
+    size_t fp_count = 0;
+    int line_class = -1; //0 for gp, 1 for fp, -1 for lines to ignore
+
+    char *pos = contents;
+    while (*pos != '\0') {
+        //split off the next token
+        while (*pos == ' ' || *pos == '\t') pos++;
+        char *token = pos;
+        while (*pos != '\0' && *pos != ' ' && *pos != '\t' && *pos != '\n') pos++;
+        bool line_end = *pos == '\n';
+        if (*pos != '\0') *pos++ = '\0';
+
+        if (*token == '#') {
+            //comment until the end of the line
+            while (!line_end && *pos != '\0' && *pos++ != '\n');
+            line_end = true;
+        } else if (strcmp(token, "gp:") == 0) {
+            line_class = 0;
+        } else if (strcmp(token, "fp:") == 0) {
+            line_class = 1;
+        } else if (*token != '\0') {
+            bool valid = line_class == 0 ? rank_register(token, false, gp, &gp_count, N_MAPPED_GP) :
+                    line_class == 1 && rank_register(token, true, fp, &fp_count, N_MAPPED_FP);
+            if (!valid) {
+                dprintf(2, "Invalid register %s in register mapping file %s, using the default mapping.\n", token,
+                        path);
+                return;
+            }
+        }
+        if (line_end) line_class = -1;
+    }
+
+    int defaults[N_MAPPED_FP];
+    for (size_t i = 0; i < N_MAPPED_GP; i++) defaults[i] = default_gp_ranking[i];
+    complete_ranking(gp, gp_count, defaults, N_MAPPED_GP);
+    for (size_t i = 0; i < N_MAPPED_FP; i++) defaults[i] = default_fp_ranking[i];
+    complete_ranking(fp, fp_count, defaults, N_MAPPED_FP);
+
+    for (size_t i = 0; i < N_MAPPED_GP; i++) gp_ranking[i] = gp[i];
+    for (size_t i = 0; i < N_MAPPED_FP; i++) fp_ranking[i] = fp[i];
+    log_general("Loaded register mapping from %s.\n", path);
+}
+
+/**
+ * Emit the entry of a context switching routine: store the callee-saved host registers and load the mapped
+ * RISC-V registers. The routine's arguments are moved to FIRST_REG and SECOND_REG.
+ */
+static void emit_context_load(const register_info *r_info) {
+    //store callee-saved host registers BX, BP, R12, R13, R14, R15
+    err |= fe_enc64(&current, FE_MOV64mr, SWAP_BX, FE_BX);
+    err |= fe_enc64(&current, FE_MOV64mr, SWAP_BP, FE_BP);
+    err |= fe_enc64(&current, FE_MOV64mr, SWAP_R12, FE_R12);
+    err |= fe_enc64(&current, FE_MOV64mr, SWAP_R13, FE_R13);
+    err |= fe_enc64(&current, FE_MOV64mr, SWAP_R14, FE_R14);
+    err |= fe_enc64(&current, FE_MOV64mr, SWAP_R15, FE_R15);
+
+    //move function arguments to scratch registers (would be overwritten by following guest context load)
+    err |= fe_enc64(&current, FE_MOV64rr, FIRST_REG, FE_DI);
+    err |= fe_enc64(&current, FE_MOV64rr, SECOND_REG, FE_SI);
+
+    //load by register mapping
+    for (int i = x0; i <= pc; ++i) {
+        if (r_info->gp_mapped[i]) {
+            err |= fe_enc64(&current, FE_MOV64rm, r_info->gp_map[i], FE_MEM_ADDR(r_info->base + 8 * i));
+        }
+    }
+    //the fp registers are loaded lazily by the blocks using them
+}
+
+/**
+ * Emit the native dispatcher: execute the block in FIRST_REG, then look up the block at the new pc and execute it,
+ * without leaving the guest context.
+ * The cache lookup mirrors lookup_cache_entry(): probe the tlb, then the cache table, refilling the tlb on a hit.
+ * Falls back to the main loop via save_context if the block has not been translated yet, or the translator has to
+ * act between blocks (guest exit, trace formation, code cache flush).
+ * Only the replacement registers are clobbered, which are free between blocks.
+ */
+static void emit_dispatch(const register_info *r_info, t_cache_loc save_context) {
+    uint8_t *loop = current;
+    err |= fe_enc64(&current, FE_CALLr, FIRST_REG);
+
+    ///leave to the main loop if it has to act
+    uint8_t *jmpLeave[4];
+    int leaves = 0;
+    err |= fe_enc64(&current, FE_CMP8mi, FE_MEM_ADDR((intptr_t) &finalize), 0);
+    jmpLeave[leaves++] = current;
+    err |= fe_enc64(&current, FE_JNZ | FE_JMPL, (intptr_t) current);                  //dummy
+    err |= fe_enc64(&current, FE_CMP8mi, FE_MEM_ADDR((intptr_t) &trace_requested), 0);
+    jmpLeave[leaves++] = current;
+    err |= fe_enc64(&current, FE_JNZ | FE_JMPL, (intptr_t) current);                  //dummy
+    err |= fe_enc64(&current, FE_CMP8mi, FE_MEM_ADDR((intptr_t) &code_cache_flush_requested), 0);
+    jmpLeave[leaves++] = current;
+    err |= fe_enc64(&current, FE_JNZ | FE_JMPL, (intptr_t) current);                  //dummy
+#ifndef NDEBUG
+    //the main loop checks for illegal x0 values
+    if (!r_info->gp_mapped[x0]) {
+        err |= fe_enc64(&current, FE_CMP64mi, FE_MEM_ADDR(r_info->base + 8 * x0), 0);
+        jmpLeave[leaves++] = current;
+        err |= fe_enc64(&current, FE_JNZ | FE_JMPL, (intptr_t) current);              //dummy
+    }
+#endif
+
+    ///load pc
+    if (r_info->gp_mapped[pc]) {
+        err |= fe_enc64(&current, FE_MOV64rr, FIRST_REG, r_info->gp_map[pc]);
+    } else {
+        err |= fe_enc64(&current, FE_MOV64rm, FIRST_REG, FE_MEM_ADDR(r_info->base + 8 * pc));
+    }
+
+    ///tlb: entry at smallhash(pc) * sizeof(t_cache_entry)
+    err |= fe_enc64(&current, FE_MOV32rr, THIRD_REG, FIRST_REG);
+    err |= fe_enc64(&current, FE_SHR32ri, THIRD_REG, 3);
+    err |= fe_enc64(&current, FE_AND32ri, THIRD_REG, SMALLTLB - 1);
+    err |= fe_enc64(&current, FE_SHL32ri, THIRD_REG, 4);
+    err |= fe_enc64(&current, FE_ADD64rm, THIRD_REG, FE_MEM_ADDR((intptr_t) &tlb));
+    err |= fe_enc64(&current, FE_CMP64rm, FIRST_REG, FE_MEM(THIRD_REG, 0, 0, 0));
+    uint8_t *jmpTlbMiss = current;
+    err |= fe_enc64(&current, FE_JNZ, (intptr_t) current);                            //dummy
+
+    if (flag_do_profile) {
+        err |= fe_enc64(&current, FE_INC64m, FE_MEM_ADDR((intptr_t) get_native_dispatch_counter()));
+    }
+    err |= fe_enc64(&current, FE_MOV64rm, FIRST_REG, FE_MEM(THIRD_REG, 0, 0, 8));
+    err |= fe_enc64(&current, FE_JMP | FE_JMPL, (intptr_t) loop);
+
+    ///cache table: linearly probe from hash(pc), SECOND_REG is the end of the table
+    err |= fe_enc64(&jmpTlbMiss, FE_JNZ, (intptr_t) current);                         //replace dummy
+    err |= fe_enc64(&current, FE_MOV64rm, SECOND_REG, FE_MEM_ADDR((intptr_t) &table_size));
+    err |= fe_enc64(&current, FE_MOV64rr, THIRD_REG, FIRST_REG);
+    err |= fe_enc64(&current, FE_SHR64ri, THIRD_REG, 2);
+    err |= fe_enc64(&current, FE_SUB64ri, SECOND_REG, 1);
+    err |= fe_enc64(&current, FE_AND64rr, THIRD_REG, SECOND_REG);
+    err |= fe_enc64(&current, FE_SHL64ri, THIRD_REG, 4);
+    err |= fe_enc64(&current, FE_ADD64rm, THIRD_REG, FE_MEM_ADDR((intptr_t) &cache_table));
+    err |= fe_enc64(&current, FE_ADD64ri, SECOND_REG, 1);
+    err |= fe_enc64(&current, FE_SHL64ri, SECOND_REG, 4);
+    err |= fe_enc64(&current, FE_ADD64rm, SECOND_REG, FE_MEM_ADDR((intptr_t) &cache_table));
+
+    uint8_t *probe = current;
+    err |= fe_enc64(&current, FE_CMP64mi, FE_MEM(THIRD_REG, 0, 0, 8), 0);
+    uint8_t *jmpMiss = current;
+    err |= fe_enc64(&current, FE_JZ | FE_JMPL, (intptr_t) current);                   //dummy
+    err |= fe_enc64(&current, FE_CMP64rm, FIRST_REG, FE_MEM(THIRD_REG, 0, 0, 0));
+    uint8_t *jmpFound = current;
+    err |= fe_enc64(&current, FE_JZ, (intptr_t) current);                             //dummy
+    err |= fe_enc64(&current, FE_ADD64ri, THIRD_REG, sizeof(t_cache_entry));
+    err |= fe_enc64(&current, FE_CMP64rr, THIRD_REG, SECOND_REG);
+    err |= fe_enc64(&current, FE_JC, (intptr_t) probe);
+    err |= fe_enc64(&current, FE_MOV64rm, THIRD_REG, FE_MEM_ADDR((intptr_t) &cache_table));  //wrap around
+    err |= fe_enc64(&current, FE_JMP, (intptr_t) probe);
+
+    ///found: refill the tlb and execute the block
+    err |= fe_enc64(&jmpFound, FE_JZ, (intptr_t) current);                            //replace dummy
+    err |= fe_enc64(&current, FE_MOV64rm, SECOND_REG, FE_MEM(THIRD_REG, 0, 0, 8));
+    err |= fe_enc64(&current, FE_MOV32rr, THIRD_REG, FIRST_REG);
+    err |= fe_enc64(&current, FE_SHR32ri, THIRD_REG, 3);
+    err |= fe_enc64(&current, FE_AND32ri, THIRD_REG, SMALLTLB - 1);
+    err |= fe_enc64(&current, FE_SHL32ri, THIRD_REG, 4);
+    err |= fe_enc64(&current, FE_ADD64rm, THIRD_REG, FE_MEM_ADDR((intptr_t) &tlb));
+    err |= fe_enc64(&current, FE_MOV64mr, FE_MEM(THIRD_REG, 0, 0, 0), FIRST_REG);
+    err |= fe_enc64(&current, FE_MOV64mr, FE_MEM(THIRD_REG, 0, 0, 8), SECOND_REG);
+    if (flag_do_profile) {
+        err |= fe_enc64(&current, FE_INC64m, FE_MEM_ADDR((intptr_t) get_native_dispatch_counter()));
+    }
+    err |= fe_enc64(&current, FE_MOV64rr, FIRST_REG, SECOND_REG);
+    err |= fe_enc64(&current, FE_JMP | FE_JMPL, (intptr_t) loop);
+
+    ///miss: the main loop translates the block
+    err |= fe_enc64(&jmpMiss, FE_JZ | FE_JMPL, (intptr_t) current);                  //replace dummy
+    if (flag_do_profile) {
+        err |= fe_enc64(&current, FE_INC64m, FE_MEM_ADDR((intptr_t) get_native_dispatch_miss_counter()));
+    }
+
+    ///Tail call save_context
+    for (int i = 0; i < leaves; i++) {
+        err |= fe_enc64(&jmpLeave[i], FE_JNZ | FE_JMPL, (intptr_t) current);         //replace dummy
+    }
+    err |= fe_enc64(&current, FE_JMP, (intptr_t) save_context);
+}
+
 context_info *init_map_context(bool floatBinary) {
     //register mapping as pulled from translate.c
     log_context("Initializing context...\n");
@@ -23,29 +310,9 @@ context_info *init_map_context(bool floatBinary) {
     /**
      * Allocation for general purpose register mapping.
      */
-    FeReg *gp_map = mmap(NULL,
-                         N_REG * sizeof(FeReg),
-                         PROT_READ | PROT_WRITE,
-                         MAP_ANONYMOUS | MAP_PRIVATE,
-                         -1,
-                         0);
-
-    if (BAD_ADDR(gp_map)) {
-        dprintf(2, "Failed to allocate gp_map for context. Error %li", -(intptr_t) gp_map);
-        panic(FAIL_HEAP_ALLOC);
-    }
-
-    bool *gp_mapped = mmap(NULL,
-                           N_REG * sizeof(bool),
-                           PROT_READ | PROT_WRITE,
-                           MAP_ANONYMOUS | MAP_PRIVATE,
-                           -1,
-                           0);
+    FeReg *gp_map = arena_alloc(&static_arena, N_REG * sizeof(FeReg));
 
-    if (BAD_ADDR(gp_mapped)) {
-        dprintf(2, "Failed to allocate gp_mapped for context. Error %li", -(intptr_t) gp_mapped);
-        panic(FAIL_HEAP_ALLOC);
-    }
+    bool *gp_mapped = arena_alloc(&static_arena, N_REG * sizeof(bool));
 
     //fill boolean array with 0
     for (int i = 0; i < N_REG; ++i) {
@@ -55,29 +322,9 @@ context_info *init_map_context(bool floatBinary) {
     /**
      * Allocation for floating point register mapping.
      */
-    FeReg *fp_map = mmap(NULL,
-                         N_REG * sizeof(FeReg),
-                         PROT_READ | PROT_WRITE,
-                         MAP_ANONYMOUS | MAP_PRIVATE,
-                         -1,
-                         0);
-
-    if (BAD_ADDR(fp_map)) {
-        dprintf(2, "Failed to allocate fp_map for context. Error %li", -(intptr_t) fp_map);
-        panic(FAIL_HEAP_ALLOC);
-    }
-
-    bool *fp_mapped = mmap(NULL,
-                           N_REG * sizeof(bool),
-                           PROT_READ | PROT_WRITE,
-                           MAP_ANONYMOUS | MAP_PRIVATE,
-                           -1,
-                           0);
+    FeReg *fp_map = arena_alloc(&static_arena, N_REG * sizeof(FeReg));
 
-    if (BAD_ADDR(fp_mapped)) {
-        dprintf(2, "Failed to allocate fp_mapped for context. Error %li", -(intptr_t) fp_mapped);
-        panic(FAIL_HEAP_ALLOC);
-    }
+    bool *fp_mapped = arena_alloc(&static_arena, N_REG * sizeof(bool));
 
     //fill boolean array with 0
     for (int i = 0; i < N_REG; ++i) {
@@ -88,34 +335,14 @@ context_info *init_map_context(bool floatBinary) {
      * Allocate memory for the dynamic translate-time replacement mapping.
      * These struct contents are used to lazily load values into replacement registers at translate time.
      */
-    t_risc_reg *replacement_content = mmap(NULL,
-                                           N_REPLACE * sizeof(t_risc_reg),
-                                           PROT_READ | PROT_WRITE,
-                                           MAP_ANONYMOUS | MAP_PRIVATE,
-                                           -1,
-                                           0);
-
-    if (BAD_ADDR(replacement_content)) {
-        dprintf(2, "Failed to allocate replacement_content for context. Error %li", -(intptr_t) replacement_content);
-        panic(FAIL_HEAP_ALLOC);
-    }
+    t_risc_reg *replacement_content = arena_alloc(&static_arena, N_REPLACE * sizeof(t_risc_reg));
 
     //fill with INVALID_REG to indicate unused
     for (size_t i = 0; i < N_REPLACE; i++) {
         replacement_content[i] = INVALID_REG;
     }
 
-    uint64_t *replacement_recency = mmap(NULL,
-                                         N_REPLACE * sizeof(uint64_t),
-                                         PROT_READ | PROT_WRITE,
-                                         MAP_ANONYMOUS | MAP_PRIVATE,
-                                         -1,
-                                         0);
-
-    if (BAD_ADDR(replacement_recency)) {
-        dprintf(2, "Failed to allocate replacement_recency for context. Error %li", -(intptr_t) replacement_recency);
-        panic(FAIL_HEAP_ALLOC);
-    }
+    uint64_t *replacement_recency = arena_alloc(&static_arena, N_REPLACE * sizeof(uint64_t));
 
     //fill with 0 to indicate clean (maybe not necessary?)
     for (size_t i = 0; i < N_REPLACE; i++) {
@@ -125,17 +352,7 @@ context_info *init_map_context(bool floatBinary) {
 
     //Allocating here to keep r_info const in all translator functions.
     //I am, however, aware this is not pretty. Maybe refactor in the future? todo?
-    uint64_t *current_recency = mmap(NULL,
-                                     sizeof(uint64_t),
-                                     PROT_READ | PROT_WRITE,
-                                     MAP_ANONYMOUS | MAP_PRIVATE,
-                                     -1,
-                                     0);
-
-    if (BAD_ADDR(current_recency)) {
-        dprintf(2, "Failed to allocate current_recency for context. Error %li", -(intptr_t) current_recency);
-        panic(FAIL_HEAP_ALLOC);
-    }
+    uint64_t *current_recency = arena_alloc(&static_arena, sizeof(uint64_t));
 
     //start count (across blocks?) at 1
     *current_recency = 1;
@@ -156,70 +373,28 @@ context_info *init_map_context(bool floatBinary) {
      * May be used: BX, BP, SI, DI, R8, R9, R10, R11, R12, R13, R14, R15
      * Of which are callee-saved: BX, BP, R12, R13, R14, R15
      */
-#define map_gp_reg(reg_risc, reg_x86)          \
-    {                                          \
-        gp_map[reg_risc] = reg_x86;            \
-        gp_mapped[reg_risc] = true;            \
+    t_risc_reg gp_ranking[N_MAPPED_GP];
+    t_risc_fp_reg fp_ranking[N_MAPPED_FP];
+    for (size_t i = 0; i < N_MAPPED_GP; i++) gp_ranking[i] = (t_risc_reg) default_gp_ranking[i];
+    for (size_t i = 0; i < N_MAPPED_FP; i++) fp_ranking[i] = default_fp_ranking[i];
+    if (register_map_path != NULL) {
+        load_register_ranking(register_map_path, gp_ranking, fp_ranking);
     }
 
-    /**
-     * We capture approximately 85 % of the register hits when we map the following registers:
-     * (by order of access frequency)
-     * x15, x14, x13, x10, x8, x2, x12, x11, x9,  x1,  x17, x18
-     * a5,  a4,  a3,  a0,  fp, sp, a2,  a1,  s1,  ra,  a7,  s2
-     *                             into
-     * BX,  BP,  SI,  DI,  R8, R9, R10, R11, R12, R13, R14, R15
-     */
-    map_gp_reg(a5, FE_BX)
-    map_gp_reg(a4, FE_BP)
-    map_gp_reg(a3, FE_SI)
-    map_gp_reg(a0, FE_DI)
-    map_gp_reg(fp, FE_R8)
-    map_gp_reg(sp, FE_R9)
-    map_gp_reg(a2, FE_R10)
-    map_gp_reg(a1, FE_R11)
-    map_gp_reg(s1, FE_R12)
-    map_gp_reg(ra, FE_R13)
-    map_gp_reg(a7, FE_R14)
-    map_gp_reg(s2, FE_R15)
-
-#undef map_gp_reg
-
+    for (size_t i = 0; i < N_MAPPED_GP; i++) {
+        gp_map[gp_ranking[i]] = gp_hosts[i];
+        gp_mapped[gp_ranking[i]] = true;
+    }
 
     /**
      * Floating point register mapping
      * ===============================
+     * Mapped into XMM2 - XMM15, as XMM0 and XMM1 are used as replacement registers.
      */
-#define map_fp_reg(reg_risc, reg_x86)          \
-    {                                       \
-        fp_map[reg_risc] = reg_x86;   \
-        fp_mapped[reg_risc] = true;            \
-    }                                          \
-
-    /**
-     * We capture approximately 81,4 % of the register hits when we map the following registers:
-     * (by order of access frequency)
-     * f15, f14, f9, f13, f12, f10, f11, f1, f0, f3,  f2, f31, f20, f24
-     *                             into
-     * XMM2 - XMM15
-     */
-    //can't map FE_XMM0 and FE_XMM1 as they are used as replacement
-    map_fp_reg(f15, FE_XMM2)
-    map_fp_reg(f14, FE_XMM3)
-    map_fp_reg(f9, FE_XMM4)
-    map_fp_reg(f13, FE_XMM5)
-    map_fp_reg(f12, FE_XMM6)
-    map_fp_reg(f10, FE_XMM7)
-    map_fp_reg(f11, FE_XMM8)
-    map_fp_reg(f1, FE_XMM9)
-    map_fp_reg(f0, FE_XMM10)
-    map_fp_reg(f3, FE_XMM11)
-    map_fp_reg(f2, FE_XMM12)
-    map_fp_reg(f31, FE_XMM13)
-    map_fp_reg(f20, FE_XMM14)
-    map_fp_reg(f24, FE_XMM15)
-
-#undef map_fp_reg
+    for (size_t i = 0; i < N_MAPPED_FP; i++) {
+        fp_map[fp_ranking[i]] = fp_hosts[i];
+        fp_mapped[fp_ranking[i]] = true;
+    }
 
     //log context setup
     if (flag_log_context) {
@@ -245,18 +420,7 @@ context_info *init_map_context(bool floatBinary) {
     }
 
     ///create info struct
-    register_info *r_info =
-            mmap(NULL,
-                 sizeof(register_info),
-                 PROT_READ | PROT_WRITE,
-                 MAP_ANONYMOUS | MAP_PRIVATE,
-                 -1,
-                 0);
-
-    if (BAD_ADDR(r_info)) {
-        dprintf(2, "Failed to allocate r_info for context. Error %li", -(intptr_t) r_info);
-        panic(FAIL_HEAP_ALLOC);
-    }
+    register_info *r_info = arena_alloc(&static_arena, sizeof(register_info));
 
     r_info->gp_map = gp_map;
     r_info->gp_mapped = gp_mapped;
@@ -280,12 +444,19 @@ context_info *init_map_context(bool floatBinary) {
         log_general("Generating context storing block...\n");
 
         if (floatBinary) {
-            //save by register mapping fp
+            //save by register mapping fp, if a block using them loaded them
+            err |= fe_enc64(&current, FE_CMP8mi, FE_MEM_ADDR((intptr_t) &fp_context_loaded), 0);
+            uint8_t *jmpBuf = current;
+            err |= fe_enc64(&current, FE_JZ | FE_JMPL, (intptr_t) current);
+
             for (int i = f0; i <= f31; ++i) {
                 if (r_info->fp_mapped[i]) {
                     err |= fe_enc64(&current, FE_SSE_MOVSDmr, FE_MEM_ADDR(r_info->fp_base + 8 * i), r_info->fp_map[i]);
                 }
             }
+            err |= fe_enc64(&current, FE_MOV8mi, FE_MEM_ADDR((intptr_t) &fp_context_loaded), 0);
+
+            err |= fe_enc64(&jmpBuf, FE_JZ | FE_JMPL, (intptr_t) current);
         }
 
         //save by register mapping gp
@@ -303,7 +474,7 @@ context_info *init_map_context(bool floatBinary) {
         err |= fe_enc64(&current, FE_MOV64rm, FE_R14, SWAP_R14);
         err |= fe_enc64(&current, FE_MOV64rm, FE_R15, SWAP_R15);
 
-        save_context = finalize_block(DONT_LINK, r_info);
+        save_context = finalize_block(r_info);
     }
 
     {
@@ -311,32 +482,7 @@ context_info *init_map_context(bool floatBinary) {
         init_block(r_info);
         log_general("Generating context executing block...\n");
 
-        //store callee-saved host registers BX, BP, R12, R13, R14, R15
-        err |= fe_enc64(&current, FE_MOV64mr, SWAP_BX, FE_BX);
-        err |= fe_enc64(&current, FE_MOV64mr, SWAP_BP, FE_BP);
-        err |= fe_enc64(&current, FE_MOV64mr, SWAP_R12, FE_R12);
-        err |= fe_enc64(&current, FE_MOV64mr, SWAP_R13, FE_R13);
-        err |= fe_enc64(&current, FE_MOV64mr, SWAP_R14, FE_R14);
-        err |= fe_enc64(&current, FE_MOV64mr, SWAP_R15, FE_R15);
-
-        //move function arguments to scratch registers (would be overwritten by following guest context load)
-        err |= fe_enc64(&current, FE_MOV64rr, FIRST_REG, FE_DI);
-        err |= fe_enc64(&current, FE_MOV64rr, SECOND_REG, FE_SI);
-
-        //load by register mapping
-        for (int i = x0; i <= pc; ++i) {
-            if (r_info->gp_mapped[i]) {
-                err |= fe_enc64(&current, FE_MOV64rm, r_info->gp_map[i], FE_MEM_ADDR(r_info->base + 8 * i));
-            }
-        }
-        if (floatBinary) {
-            //load by fp register mapping
-            for (int i = f0; i <= f31; ++i) {
-                if (r_info->fp_mapped[i]) {
-                    err |= fe_enc64(&current, FE_SSE_MOVSDrm, r_info->fp_map[i], FE_MEM_ADDR(r_info->fp_base + 8 * i));
-                }
-            }
-        }
+        emit_context_load(r_info);
 
         err |= fe_enc64(&current, FE_TEST32rr, SECOND_REG, SECOND_REG);
 
@@ -350,28 +496,72 @@ context_info *init_map_context(bool floatBinary) {
 
         err |= fe_enc64(&jmpBuf, FE_JZ, (intptr_t) current);
 
-        load_execute_save_context = finalize_block(DONT_LINK, r_info);
+        load_execute_save_context = finalize_block(r_info);
     }
 
-    //create context info struct
-    context_info *c_info = mmap(NULL,
-                                sizeof(context_info),
-                                PROT_READ | PROT_WRITE,
-                                MAP_ANONYMOUS | MAP_PRIVATE,
-                                -1,
-                                0);
-
-    if (BAD_ADDR(c_info)) {
-        dprintf(2, "Failed to allocate c_info for context. Error %li", -(intptr_t) c_info);
-        panic(FAIL_HEAP_ALLOC);
+    t_cache_loc load_dispatch_save_context = NULL;
+    if (flag_translate_opt_dispatch && !flag_single_step && !flag_log_reg_dump && !flag_log_general) {
+        //context loading and native dispatching, the blocks are inspected by the main loop otherwise
+        init_block(r_info);
+        log_general("Generating dispatching block...\n");
+
+        emit_context_load(r_info);
+        emit_dispatch(r_info, save_context);
+
+        load_dispatch_save_context = finalize_block(r_info);
     }
 
+    t_cache_loc fast_ecall = NULL;
+    if (flag_translate_opt_ecall && !flag_log_syscall) {
+        //issuing frequent syscalls directly, called by blocks whose syscall number is only known at runtime
+        init_block(r_info);
+        log_general("Generating fast syscall block...\n");
+
+        emit_fast_ecall_dispatch(r_info, floatBinary);
+
+        fast_ecall = finalize_block(r_info);
+    }
+
+    t_cache_loc load_fp_context = NULL;
+    if (floatBinary) {
+        //fp context loading, called by blocks using fp registers while they are not loaded
+        init_block(r_info);
+        log_general("Generating fp context loading block...\n");
+
+        if (flag_do_profile) {
+            err |= fe_enc64(&current, FE_INC64m, FE_MEM_ADDR((intptr_t) get_fp_context_load_counter()));
+        }
+        for (int i = f0; i <= f31; ++i) {
+            if (r_info->fp_mapped[i]) {
+                err |= fe_enc64(&current, FE_SSE_MOVSDrm, r_info->fp_map[i], FE_MEM_ADDR(r_info->fp_base + 8 * i));
+            }
+        }
+        err |= fe_enc64(&current, FE_MOV8mi, FE_MEM_ADDR((intptr_t) &fp_context_loaded), 1);
+
+        load_fp_context = finalize_block(r_info);
+    }
+
+    //create context info struct
+    context_info *c_info = arena_alloc(&static_arena, sizeof(context_info));
+
     c_info->r_info = r_info;
     c_info->load_execute_save_context = load_execute_save_context;
     c_info->save_context = save_context;
+    c_info->load_fp_context = load_fp_context;
+    c_info->load_dispatch_save_context = load_dispatch_save_context;
+    c_info->fast_ecall = fast_ecall;
     if (perfFd >= 0) {
         dprintf(perfFd, "%lx %lx context_switch_load_execute\n", (uintptr_t) load_execute_save_context, 4096lu);
         dprintf(perfFd, "%lx %lx context_switch_save\n", (uintptr_t) save_context, 4096lu);
+        if (load_fp_context != NULL) {
+            dprintf(perfFd, "%lx %lx context_switch_load_fp\n", (uintptr_t) load_fp_context, 4096lu);
+        }
+        if (fast_ecall != NULL) {
+            dprintf(perfFd, "%lx %lx context_fast_ecall\n", (uintptr_t) fast_ecall, 4096lu);
+        }
+        if (load_dispatch_save_context != NULL) {
+            dprintf(perfFd, "%lx %lx context_switch_dispatch\n", (uintptr_t) load_dispatch_save_context, 4096lu);
+        }
     }
 
     return c_info;
@@ -392,3 +582,20 @@ void execute_in_guest_context(const context_info *c_info, t_cache_loc loc) {
     ((void_asm) c_info->load_execute_save_context)(loc, true);
 }
 
+/**
+ * Loads the RISC-V guest program's context and executes the translated block at the given address, followed by the
+ * blocks it exits to, until a block is not translated yet or the main loop has to act. Stores the context back then.
+ * Falls back to executing just the given block if there is no native dispatcher (see init_map_context()).
+ *
+ * @param c_info the context_info to apply to (un)map the registers.
+ * @param loc the cached block to execute first.
+ */
+void dispatch_in_guest_context(const context_info *c_info, t_cache_loc loc) {
+    if (c_info->load_dispatch_save_context == NULL) {
+        execute_in_guest_context(c_info, loc);
+        return;
+    }
+    typedef void (*void_asm)(t_cache_loc);
+    ((void_asm) c_info->load_dispatch_save_context)(loc);
+}
+
@@ -28,10 +28,28 @@ typedef struct {
      */
     t_cache_loc load_execute_save_context;
     t_cache_loc save_context;
+    /**
+     * Call this to load the mapped fp registers, NULL if the guest does not use them.
+     */
+    t_cache_loc load_fp_context;
+    /**
+     * Call this with the location of the block to execute first, see dispatch_in_guest_context().
+     * NULL if the blocks are executed one at a time by the main loop.
+     */
+    t_cache_loc load_dispatch_save_context;
+    /**
+     * Call this to issue the syscall in a7 directly if it is one of the frequent ones, returns AL != 0 if it did.
+     * NULL if all syscalls are emulated by emulate_ecall().
+     */
+    t_cache_loc fast_ecall;
 } context_info;
 
+extern bool fp_context_loaded;
+
 void execute_in_guest_context(const context_info *c_info, t_cache_loc loc);
 
+void dispatch_in_guest_context(const context_info *c_info, t_cache_loc loc);
+
 context_info *init_map_context(bool floatBinary);
 
 #ifdef __cplusplus
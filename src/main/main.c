@@ -2,6 +2,7 @@
 // Created by flo on 24.04.20.
 //
 
+#include "main.h"
 #include <common.h>
 #include <stdbool.h>
 #include <util/log.h>
@@ -17,6 +18,11 @@
 #include <env/opt.h>
 #include <util/tools/analyze.h>
 #include <util/tools/profile.h>
+#include <cache/persist.h>
+#include <cache/chain.h>
+#include <cache/smc.h>
+#include <gen/trace.h>
+#include <gen/worklist.h>
 
 //just temporary - we need some way to control transcoding globally?
 bool finalize = false;
@@ -72,9 +78,18 @@ int transcode_loop(const char *file_path, int guestArgc, char **guestArgv) {
 
     init_hash_table();
     init_return_stack();
+    init_exit_table();
 
     setupInstrMem();
     context_info *c_info = init_map_context(result.floatBinary);
+    setupBlockMem();
+    init_persistent_cache(file_path, c_info, result.floatBinary);
+    if (flag_smc) {
+        init_smc(c_info);
+    }
+    if (flag_aot) {
+        translate_ahead_of_time(file_path, &result, c_info);
+    }
 
     set_value(pc, next_pc);
 
@@ -98,6 +113,15 @@ int transcode_loop(const char *file_path, int guestArgc, char **guestArgv) {
 
 
     while (!finalize) {
+        //make room for new translations if necessary
+        check_code_cache_limit();
+
+        //replace a block that just became hot by a trace
+        if (trace_requested) {
+            trace_requested = false;
+            form_trace(next_pc, c_info);
+        }
+
         //check our previously translated code
         t_cache_loc cache_loc = lookup_cache_entry(next_pc);
 
@@ -105,15 +129,13 @@ int transcode_loop(const char *file_path, int guestArgc, char **guestArgv) {
         if (cache_loc == UNSEEN_CODE) {
             cache_loc = translate_block(next_pc, c_info);
             set_cache_entry(next_pc, cache_loc);
-        }
 
-        ///chain last block to current (if chainable)
-        chain(cache_loc);
+            //translate some of the blocks it may continue at, the others are translated next time
+            translate_pending_blocks(c_info, translate_ahead);
+        }
 
         //execute the cached (or now newly generated code) and update the program counter
         if (!execute_cached(cache_loc, c_info)) break;
-        //printf("chain_end: %p\n"
-        // "cache_loc: %p\n\n", chain_end, cache_loc);
 
         //store pc from registers in pc
         next_pc = get_value(pc);
@@ -121,6 +143,8 @@ int transcode_loop(const char *file_path, int guestArgc, char **guestArgv) {
 
     log_general("Guest execution finalized. Cleaning up...\n");
 
+    save_persistent_cache();
+
     //finalize benchmark if necessary
     if (flag_do_benchmark) {
         end_display_measure(&begin);
@@ -130,6 +154,9 @@ int transcode_loop(const char *file_path, int guestArgc, char **guestArgv) {
     if (flag_do_profile) {
         log_profile("Profiler data collection finished.\n");
         dump_register_stats();
+        if (register_map_path != NULL) {
+            save_register_ranking(register_map_path);
+        }
         dump_cache_stats();
     }
 
@@ -138,6 +165,7 @@ int transcode_loop(const char *file_path, int guestArgc, char **guestArgv) {
 
 /**
  * Execute cached translated code at the passed location.
+ * Without logging, the native dispatcher keeps executing the following blocks until one needs to be translated.
  * @param loc the cache address of that code
  * @return
  */
@@ -146,7 +174,7 @@ bool execute_cached(t_cache_loc loc, context_info *c_info) {
         log_general("Execute block at %p, cache loc %p\n", (void *) get_value(pc), loc);
     }
 
-    execute_in_guest_context(c_info, loc);
+    dispatch_in_guest_context(c_info, loc);
 
     //dump registers to the log
     if (flag_log_reg_dump) {
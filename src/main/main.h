@@ -11,6 +11,9 @@
 extern "C" {
 #endif //__cplusplus
 
+//set by the syscall emulation once the guest exits, ends the main loop
+extern bool finalize;
+
 #ifdef __cplusplus
 }
 #endif //__cplusplus
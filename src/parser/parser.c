@@ -5,6 +5,8 @@
 //
 
 #include <util/log.h>
+#include <env/flags.h>
+#include <util/tools/profile.h>
 #include "parser.h"
 
 // extract rd register number bit[11:7]
@@ -66,720 +68,482 @@ int32_t set_error_message(t_risc_instr *p_instr_struct, int32_t error_code) {
 }
 
 /**
- *
- * @param p_instr_struct struct filled with the addr of the instruction to be translated
+ * Operand formats, selecting the fields an instruction takes from its raw encoding.
  */
-int32_t parse_instruction(t_risc_instr *p_instr_struct) {
-    // print out the line to parse in grouped binary as in the spec
-    int32_t raw_instr = *(int32_t *) p_instr_struct->addr; //cast and dereference
-    log_asm_in("Parsing 0x%x at %p\n", raw_instr, (void *) p_instr_struct->addr);
+typedef enum {
+    FORMAT_R,           //rs2
+    FORMAT_I,           //imm[11:0]
+    FORMAT_I_SHAMT,     //6 bit shift amount
+    FORMAT_I_SHAMT_W,   //5 bit shift amount
+    FORMAT_S,           //rs2, imm[11:5|4:0], no rd
+    FORMAT_S_FP,        //rs2, imm[11:5|4:0]
+    FORMAT_B,           //rs2, imm[12|10:5|4:1|11], no rd
+    FORMAT_U,           //imm[31:12], no rs1
+    FORMAT_J,           //imm[20|10:1|11|19:12], no rs1
+    FORMAT_R4,          //rs2, rs3, rounding mode
+    FORMAT_FP,          //rs2, rounding mode
+    FORMAT_AMO,         //rs2, funct7 (aq/rl) as imm
+} t_instr_format;
 
-    //fill basic struct
-    p_instr_struct->reg_dest = (t_risc_reg) extract_rd(raw_instr);
-    p_instr_struct->reg_src_1 = (t_risc_reg) extract_rs1(raw_instr);
-    p_instr_struct->reg_src_2 = INVALID_REG; //Set to not used value for analyzer to work correctly
+/**
+ * Size variants an entry of the description table stands for.
+ */
+typedef enum {
+    SIZE_ONE,           //just the entry itself
+    SIZE_FP,            //single (funct7[1:0] = 0) and double precision (funct7[1:0] = 1)
+    SIZE_AMO,           //word (funct3 = 2) and double word (funct3 = 3)
+} t_instr_size;
+
+typedef struct {
+    uint32_t mask;
+    uint32_t match;
+    t_risc_mnem mnem;
+    t_risc_optype optype;
+    t_instr_format format;
+    t_instr_size size;
+} t_instr_desc;
+
+//encoding fields for the description table
+#define OPC(op) ((uint32_t) (op) << 2)
+#define F3(f3) ((uint32_t) (f3) << 12)
+#define F7(f7) ((uint32_t) (f7) << 25)
+#define F5(f5) ((uint32_t) (f5) << 27)
+#define F2(f2) ((uint32_t) (f2) << 25)
+#define RS2(rs2) ((uint32_t) (rs2) << 20)
+#define BIT(n) ((uint32_t) 1 << (n))
+
+#define M_OPC OPC(0x1f)
+#define M_F3 F3(0x7)
+#define M_F7 F7(0x7f)
+#define M_F5 F5(0x1f)
+#define M_F2 F2(0x3)
+#define M_RS2 RS2(0x1f)
+
+/**
+ * Description of the supported instructions.
+ * An instruction matches an entry if its bits selected by mask equal match, at most one entry matches.
+ * Only the opcode bits [6:2] are looked at, like the bits [1:0] are not.
+ */
+static const t_instr_desc instr_descs[] = {
+        {M_OPC, OPC(OP_LUI), LUI, UPPER_IMMEDIATE, FORMAT_U, SIZE_ONE},
+        {M_OPC, OPC(OP_AUIPC), AUIPC, IMMEDIATE, FORMAT_U, SIZE_ONE},
+        {M_OPC, OPC(OP_JAL), JAL, JUMP, FORMAT_J, SIZE_ONE},
+        {M_OPC, OPC(OP_JALR), JALR, JUMP, FORMAT_I, SIZE_ONE},
+
+        {M_OPC | M_F3, OPC(OP_BRANCH) | F3(0), BEQ, BRANCH, FORMAT_B, SIZE_ONE},
+        {M_OPC | M_F3, OPC(OP_BRANCH) | F3(1), BNE, BRANCH, FORMAT_B, SIZE_ONE},
+        {M_OPC | M_F3, OPC(OP_BRANCH) | F3(4), BLT, BRANCH, FORMAT_B, SIZE_ONE},
+        {M_OPC | M_F3, OPC(OP_BRANCH) | F3(5), BGE, BRANCH, FORMAT_B, SIZE_ONE},
+        {M_OPC | M_F3, OPC(OP_BRANCH) | F3(6), BLTU, BRANCH, FORMAT_B, SIZE_ONE},
+        {M_OPC | M_F3, OPC(OP_BRANCH) | F3(7), BGEU, BRANCH, FORMAT_B, SIZE_ONE},
+
+        {M_OPC | M_F3, OPC(OP_LOAD) | F3(0), LB, IMMEDIATE, FORMAT_I, SIZE_ONE},
+        {M_OPC | M_F3, OPC(OP_LOAD) | F3(1), LH, IMMEDIATE, FORMAT_I, SIZE_ONE},
+        {M_OPC | M_F3, OPC(OP_LOAD) | F3(2), LW, IMMEDIATE, FORMAT_I, SIZE_ONE},
+        {M_OPC | M_F3, OPC(OP_LOAD) | F3(3), LD, IMMEDIATE, FORMAT_I, SIZE_ONE},
+        {M_OPC | M_F3, OPC(OP_LOAD) | F3(4), LBU, IMMEDIATE, FORMAT_I, SIZE_ONE},
+        {M_OPC | M_F3, OPC(OP_LOAD) | F3(5), LHU, IMMEDIATE, FORMAT_I, SIZE_ONE},
+        {M_OPC | M_F3, OPC(OP_LOAD) | F3(6), LWU, IMMEDIATE, FORMAT_I, SIZE_ONE},
+
+        {M_OPC | M_F3, OPC(OP_STORE) | F3(0), SB, STORE, FORMAT_S, SIZE_ONE},
+        {M_OPC | M_F3, OPC(OP_STORE) | F3(1), SH, STORE, FORMAT_S, SIZE_ONE},
+        {M_OPC | M_F3, OPC(OP_STORE) | F3(2), SW, STORE, FORMAT_S, SIZE_ONE},
+        {M_OPC | M_F3, OPC(OP_STORE) | F3(3), SD, STORE, FORMAT_S, SIZE_ONE},
+
+        {M_OPC | M_F3, OPC(OP_OP_IMM) | F3(0), ADDI, IMMEDIATE, FORMAT_I, SIZE_ONE},
+        {M_OPC | M_F3, OPC(OP_OP_IMM) | F3(1), SLLI, IMMEDIATE, FORMAT_I_SHAMT, SIZE_ONE},
+        {M_OPC | M_F3, OPC(OP_OP_IMM) | F3(2), SLTI, IMMEDIATE, FORMAT_I, SIZE_ONE},
+        {M_OPC | M_F3, OPC(OP_OP_IMM) | F3(3), SLTIU, IMMEDIATE, FORMAT_I, SIZE_ONE},
+        {M_OPC | M_F3, OPC(OP_OP_IMM) | F3(4), XORI, IMMEDIATE, FORMAT_I, SIZE_ONE},
+        {M_OPC | M_F3 | BIT(30), OPC(OP_OP_IMM) | F3(5), SRLI, IMMEDIATE, FORMAT_I_SHAMT, SIZE_ONE},
+        {M_OPC | M_F3 | BIT(30), OPC(OP_OP_IMM) | F3(5) | BIT(30), SRAI, IMMEDIATE, FORMAT_I_SHAMT, SIZE_ONE},
+        {M_OPC | M_F3, OPC(OP_OP_IMM) | F3(6), ORI, IMMEDIATE, FORMAT_I, SIZE_ONE},
+        {M_OPC | M_F3, OPC(OP_OP_IMM) | F3(7), ANDI, IMMEDIATE, FORMAT_I, SIZE_ONE},
+
+        {M_OPC | M_F3, OPC(OP_OP_IMM_32) | F3(0), ADDIW, IMMEDIATE, FORMAT_I, SIZE_ONE},
+        {M_OPC | M_F3, OPC(OP_OP_IMM_32) | F3(1), SLLIW, IMMEDIATE, FORMAT_I_SHAMT_W, SIZE_ONE},
+        {M_OPC | M_F3 | BIT(30), OPC(OP_OP_IMM_32) | F3(5), SRLIW, IMMEDIATE, FORMAT_I_SHAMT_W, SIZE_ONE},
+        {M_OPC | M_F3 | BIT(30), OPC(OP_OP_IMM_32) | F3(5) | BIT(30), SRAIW, IMMEDIATE, FORMAT_I_SHAMT_W, SIZE_ONE},
+
+        ///base integer register-register operations, bit 25 distinguishes the M extension
+        {M_OPC | M_F3 | BIT(25) | BIT(30), OPC(OP_OP) | F3(0), ADD, REG_REG, FORMAT_R, SIZE_ONE},
+        {M_OPC | M_F3 | BIT(25) | BIT(30), OPC(OP_OP) | F3(0) | BIT(30), SUB, REG_REG, FORMAT_R, SIZE_ONE},
+        {M_OPC | M_F3 | BIT(25), OPC(OP_OP) | F3(1), SLL, REG_REG, FORMAT_R, SIZE_ONE},
+        {M_OPC | M_F3 | BIT(25), OPC(OP_OP) | F3(2), SLT, REG_REG, FORMAT_R, SIZE_ONE},
+        {M_OPC | M_F3 | BIT(25), OPC(OP_OP) | F3(3), SLTU, REG_REG, FORMAT_R, SIZE_ONE},
+        {M_OPC | M_F3 | BIT(25), OPC(OP_OP) | F3(4), XOR, REG_REG, FORMAT_R, SIZE_ONE},
+        {M_OPC | M_F3 | BIT(25) | BIT(30), OPC(OP_OP) | F3(5), SRL, REG_REG, FORMAT_R, SIZE_ONE},
+        {M_OPC | M_F3 | BIT(25) | BIT(30), OPC(OP_OP) | F3(5) | BIT(30), SRA, REG_REG, FORMAT_R, SIZE_ONE},
+        {M_OPC | M_F3 | BIT(25), OPC(OP_OP) | F3(6), OR, REG_REG, FORMAT_R, SIZE_ONE},
+        {M_OPC | M_F3 | BIT(25), OPC(OP_OP) | F3(7), AND, REG_REG, FORMAT_R, SIZE_ONE},
+        {M_OPC | M_F3 | BIT(25), OPC(OP_OP) | F3(0) | BIT(25), MUL, REG_REG, FORMAT_R, SIZE_ONE},
+        {M_OPC | M_F3 | BIT(25), OPC(OP_OP) | F3(1) | BIT(25), MULH, REG_REG, FORMAT_R, SIZE_ONE},
+        {M_OPC | M_F3 | BIT(25), OPC(OP_OP) | F3(2) | BIT(25), MULHSU, REG_REG, FORMAT_R, SIZE_ONE},
+        {M_OPC | M_F3 | BIT(25), OPC(OP_OP) | F3(3) | BIT(25), MULHU, REG_REG, FORMAT_R, SIZE_ONE},
+        {M_OPC | M_F3 | BIT(25), OPC(OP_OP) | F3(4) | BIT(25), DIV, REG_REG, FORMAT_R, SIZE_ONE},
+        {M_OPC | M_F3 | BIT(25), OPC(OP_OP) | F3(5) | BIT(25), DIVU, REG_REG, FORMAT_R, SIZE_ONE},
+        {M_OPC | M_F3 | BIT(25), OPC(OP_OP) | F3(6) | BIT(25), REM, REG_REG, FORMAT_R, SIZE_ONE},
+        {M_OPC | M_F3 | BIT(25), OPC(OP_OP) | F3(7) | BIT(25), REMU, REG_REG, FORMAT_R, SIZE_ONE},
+
+        {M_OPC | M_F3 | BIT(25) | BIT(30), OPC(OP_OP_32) | F3(0), ADDW, REG_REG, FORMAT_R, SIZE_ONE},
+        {M_OPC | M_F3 | BIT(25) | BIT(30), OPC(OP_OP_32) | F3(0) | BIT(30), SUBW, REG_REG, FORMAT_R, SIZE_ONE},
+        {M_OPC | M_F3 | BIT(25), OPC(OP_OP_32) | F3(1), SLLW, REG_REG, FORMAT_R, SIZE_ONE},
+        {M_OPC | M_F3 | BIT(25) | BIT(30), OPC(OP_OP_32) | F3(5), SRLW, REG_REG, FORMAT_R, SIZE_ONE},
+        {M_OPC | M_F3 | BIT(25) | BIT(30), OPC(OP_OP_32) | F3(5) | BIT(30), SRAW, REG_REG, FORMAT_R, SIZE_ONE},
+        {M_OPC | M_F3 | BIT(25), OPC(OP_OP_32) | F3(0) | BIT(25), MULW, REG_REG, FORMAT_R, SIZE_ONE},
+        {M_OPC | M_F3 | BIT(25), OPC(OP_OP_32) | F3(4) | BIT(25), DIVW, REG_REG, FORMAT_R, SIZE_ONE},
+        {M_OPC | M_F3 | BIT(25), OPC(OP_OP_32) | F3(5) | BIT(25), DIVUW, REG_REG, FORMAT_R, SIZE_ONE},
+        {M_OPC | M_F3 | BIT(25), OPC(OP_OP_32) | F3(6) | BIT(25), REMW, REG_REG, FORMAT_R, SIZE_ONE},
+        {M_OPC | M_F3 | BIT(25), OPC(OP_OP_32) | F3(7) | BIT(25), REMUW, REG_REG, FORMAT_R, SIZE_ONE},
+
+        {M_OPC | M_F3, OPC(OP_MISC_MEM) | F3(0), FENCE, SYSTEM, FORMAT_I, SIZE_ONE},
+        {M_OPC | M_F3, OPC(OP_MISC_MEM) | F3(1), FENCE_I, SYSTEM, FORMAT_I, SIZE_ONE},
+
+        {M_OPC | M_F3 | BIT(20), OPC(OP_SYSTEM) | F3(0), ECALL, SYSTEM, FORMAT_I, SIZE_ONE},
+        {M_OPC | M_F3 | BIT(20), OPC(OP_SYSTEM) | F3(0) | BIT(20), EBREAK, SYSTEM, FORMAT_I, SIZE_ONE},
+        {M_OPC | M_F3, OPC(OP_SYSTEM) | F3(1), CSRRW, SYSTEM, FORMAT_I, SIZE_ONE},
+        {M_OPC | M_F3, OPC(OP_SYSTEM) | F3(2), CSRRS, SYSTEM, FORMAT_I, SIZE_ONE},
+        {M_OPC | M_F3, OPC(OP_SYSTEM) | F3(3), CSRRC, SYSTEM, FORMAT_I, SIZE_ONE},
+        {M_OPC | M_F3, OPC(OP_SYSTEM) | F3(5), CSRRWI, SYSTEM, FORMAT_I, SIZE_ONE},
+        {M_OPC | M_F3, OPC(OP_SYSTEM) | F3(6), CSRRSI, SYSTEM, FORMAT_I, SIZE_ONE},
+        {M_OPC | M_F3, OPC(OP_SYSTEM) | F3(7), CSRRCI, SYSTEM, FORMAT_I, SIZE_ONE},
+
+        ///atomics, the REG_REG optype lets the analyses see rs1, rs2 read and rd written
+        {M_OPC | M_F3 | M_F5, OPC(OP_AMO) | F3(2) | F5(0), AMOADDW, REG_REG, FORMAT_AMO, SIZE_AMO},
+        {M_OPC | M_F3 | M_F5, OPC(OP_AMO) | F3(2) | F5(1), AMOSWAPW, REG_REG, FORMAT_AMO, SIZE_AMO},
+        {M_OPC | M_F3 | M_F5, OPC(OP_AMO) | F3(2) | F5(2), LRW, REG_REG, FORMAT_AMO, SIZE_AMO},
+        {M_OPC | M_F3 | M_F5, OPC(OP_AMO) | F3(2) | F5(3), SCW, REG_REG, FORMAT_AMO, SIZE_AMO},
+        {M_OPC | M_F3 | M_F5, OPC(OP_AMO) | F3(2) | F5(4), AMOXORW, REG_REG, FORMAT_AMO, SIZE_AMO},
+        {M_OPC | M_F3 | M_F5, OPC(OP_AMO) | F3(2) | F5(8), AMOORW, REG_REG, FORMAT_AMO, SIZE_AMO},
+        {M_OPC | M_F3 | M_F5, OPC(OP_AMO) | F3(2) | F5(12), AMOANDW, REG_REG, FORMAT_AMO, SIZE_AMO},
+        {M_OPC | M_F3 | M_F5, OPC(OP_AMO) | F3(2) | F5(16), AMOMINW, REG_REG, FORMAT_AMO, SIZE_AMO},
+        {M_OPC | M_F3 | M_F5, OPC(OP_AMO) | F3(2) | F5(20), AMOMAXW, REG_REG, FORMAT_AMO, SIZE_AMO},
+        {M_OPC | M_F3 | M_F5, OPC(OP_AMO) | F3(2) | F5(24), AMOMINUW, REG_REG, FORMAT_AMO, SIZE_AMO},
+        {M_OPC | M_F3 | M_F5, OPC(OP_AMO) | F3(2) | F5(28), AMOMAXUW, REG_REG, FORMAT_AMO, SIZE_AMO},
+
+        {M_OPC | M_F3, OPC(OP_LOAD_FP) | F3(2), FLW, FLOAT, FORMAT_I, SIZE_ONE},
+        {M_OPC | M_F3, OPC(OP_LOAD_FP) | F3(3), FLD, FLOAT, FORMAT_I, SIZE_ONE},
+        {M_OPC | M_F3, OPC(OP_STORE_FP) | F3(2), FSW, FLOAT, FORMAT_S_FP, SIZE_ONE},
+        {M_OPC | M_F3, OPC(OP_STORE_FP) | F3(3), FSD, FLOAT, FORMAT_S_FP, SIZE_ONE},
+
+        {M_OPC | M_F2, OPC(OP_MADD) | F2(0), FMADDS, FLOAT, FORMAT_R4, SIZE_ONE},
+        {M_OPC | M_F2, OPC(OP_MADD) | F2(1), FMADDD, FLOAT, FORMAT_R4, SIZE_ONE},
+        {M_OPC | M_F2, OPC(OP_MSUB) | F2(0), FMSUBS, FLOAT, FORMAT_R4, SIZE_ONE},
+        {M_OPC | M_F2, OPC(OP_MSUB) | F2(1), FMSUBD, FLOAT, FORMAT_R4, SIZE_ONE},
+        {M_OPC | M_F2, OPC(OP_NMSUB) | F2(0), FNMSUBS, FLOAT, FORMAT_R4, SIZE_ONE},
+        {M_OPC | M_F2, OPC(OP_NMSUB) | F2(1), FNMSUBD, FLOAT, FORMAT_R4, SIZE_ONE},
+        {M_OPC | M_F2, OPC(OP_NMADD) | F2(0), FNMADDS, FLOAT, FORMAT_R4, SIZE_ONE},
+        {M_OPC | M_F2, OPC(OP_NMADD) | F2(1), FNMADDD, FLOAT, FORMAT_R4, SIZE_ONE},
+
+        ///floating point operations, funct7[6:2] selects the operation and funct7[1:0] the operand size
+        {M_OPC | M_F7, OPC(OP_OP_FP) | F5(0), FADDS, FLOAT, FORMAT_FP, SIZE_FP},
+        {M_OPC | M_F7, OPC(OP_OP_FP) | F5(1), FSUBS, FLOAT, FORMAT_FP, SIZE_FP},
+        {M_OPC | M_F7, OPC(OP_OP_FP) | F5(2), FMULS, FLOAT, FORMAT_FP, SIZE_FP},
+        {M_OPC | M_F7, OPC(OP_OP_FP) | F5(3), FDIVS, FLOAT, FORMAT_FP, SIZE_FP},
+        {M_OPC | M_F7 | M_F3, OPC(OP_OP_FP) | F5(4) | F3(0), FSGNJS, FLOAT, FORMAT_FP, SIZE_FP},
+        {M_OPC | M_F7 | M_F3, OPC(OP_OP_FP) | F5(4) | F3(1), FSGNJNS, FLOAT, FORMAT_FP, SIZE_FP},
+        {M_OPC | M_F7 | M_F3, OPC(OP_OP_FP) | F5(4) | F3(2), FSGNJXS, FLOAT, FORMAT_FP, SIZE_FP},
+        {M_OPC | M_F7 | M_F3, OPC(OP_OP_FP) | F5(5) | F3(0), FMINS, FLOAT, FORMAT_FP, SIZE_FP},
+        {M_OPC | M_F7 | M_F3, OPC(OP_OP_FP) | F5(5) | F3(1), FMAXS, FLOAT, FORMAT_FP, SIZE_FP},
+        {M_OPC | M_F5 | M_RS2, OPC(OP_OP_FP) | F5(8) | RS2(0), FCVTDS, FLOAT, FORMAT_FP, SIZE_ONE},
+        {M_OPC | M_F5 | M_RS2, OPC(OP_OP_FP) | F5(8) | RS2(1), FCVTSD, FLOAT, FORMAT_FP, SIZE_ONE},
+        {M_OPC | M_F7, OPC(OP_OP_FP) | F5(11), FSQRTS, FLOAT, FORMAT_FP, SIZE_FP},
+        {M_OPC | M_F7 | M_F3, OPC(OP_OP_FP) | F5(20) | F3(0), FLES, FLOAT, FORMAT_FP, SIZE_FP},
+        {M_OPC | M_F7 | M_F3, OPC(OP_OP_FP) | F5(20) | F3(1), FLTS, FLOAT, FORMAT_FP, SIZE_FP},
+        {M_OPC | M_F7 | M_F3, OPC(OP_OP_FP) | F5(20) | F3(2), FEQS, FLOAT, FORMAT_FP, SIZE_FP},
+        {M_OPC | M_F7 | M_RS2, OPC(OP_OP_FP) | F5(24) | RS2(0), FCVTWS, FLOAT, FORMAT_FP, SIZE_FP},
+        {M_OPC | M_F7 | M_RS2, OPC(OP_OP_FP) | F5(24) | RS2(1), FCVTWUS, FLOAT, FORMAT_FP, SIZE_FP},
+        {M_OPC | M_F7 | M_RS2, OPC(OP_OP_FP) | F5(24) | RS2(2), FCVTLS, FLOAT, FORMAT_FP, SIZE_FP},
+        {M_OPC | M_F7 | M_RS2, OPC(OP_OP_FP) | F5(24) | RS2(3), FCVTLUS, FLOAT, FORMAT_FP, SIZE_FP},
+        {M_OPC | M_F7 | M_RS2, OPC(OP_OP_FP) | F5(26) | RS2(0), FCVTSW, FLOAT, FORMAT_FP, SIZE_FP},
+        {M_OPC | M_F7 | M_RS2, OPC(OP_OP_FP) | F5(26) | RS2(1), FCVTSWU, FLOAT, FORMAT_FP, SIZE_FP},
+        {M_OPC | M_F7 | M_RS2, OPC(OP_OP_FP) | F5(26) | RS2(2), FCVTSL, FLOAT, FORMAT_FP, SIZE_FP},
+        {M_OPC | M_F7 | M_RS2, OPC(OP_OP_FP) | F5(26) | RS2(3), FCVTSLU, FLOAT, FORMAT_FP, SIZE_FP},
+        {M_OPC | M_F7 | M_F3, OPC(OP_OP_FP) | F5(28) | F3(0), FMVXW, FLOAT, FORMAT_FP, SIZE_FP},
+        {M_OPC | M_F7 | M_F3, OPC(OP_OP_FP) | F5(28) | F3(1), FCLASSS, FLOAT, FORMAT_FP, SIZE_FP},
+        {M_OPC | M_F7, OPC(OP_OP_FP) | F5(30), FMVWX, FLOAT, FORMAT_FP, SIZE_FP},
+};
+
+#define INSTR_DESC_COUNT (sizeof(instr_descs) / sizeof(t_instr_desc))
+//the size variants at most double the entries
+#define DECODER_ENTRIES (2 * INSTR_DESC_COUNT)
+//the entries are looked up by opcode bits [6:2] and funct3
+#define DECODER_BUCKETS (32 * 8)
+
+/**
+ * Decoder generated from the description table by build_decoder().
+ * The entries matching the instructions with a given opcode and funct3 are listed in decoder_buckets,
+ * so finding the entry matching an instruction only compares a few entries.
+ */
+static t_instr_desc decoder_entries[DECODER_ENTRIES];
+static size_t decoder_entry_count = 0;
+static struct {
+    uint16_t first;
+    uint16_t count;
+} decoder_buckets[DECODER_BUCKETS];
+//an entry possibly shows up in all 8 buckets of its opcode
+static uint16_t decoder_bucket_entries[8 * DECODER_ENTRIES];
+static bool decoder_built = false;
+
+static inline uint32_t bucket_of(uint32_t raw_instr) {
+    return (raw_instr >> 2 & 0x1f) << 3 | extract_funct3(raw_instr);
+}
+
+/**
+ * Expand the description table to the decoder entries and sort them into the buckets they may match.
+ */
+static void build_decoder(void) {
+    for (size_t i = 0; i < INSTR_DESC_COUNT; i++) {
+        const t_instr_desc *desc = &instr_descs[i];
+        decoder_entries[decoder_entry_count++] = *desc;
+        switch (desc->size) {
+            case SIZE_FP: {
+                t_instr_desc double_desc = *desc;
+                double_desc.match |= F7(1);
+                //because of our ordering of the mnems in typedef.h we can just add a constant factor
+                double_desc.mnem += FLD - FLW;
+                decoder_entries[decoder_entry_count++] = double_desc;
+                break;
+            }
+            case SIZE_AMO: {
+                t_instr_desc double_desc = *desc;
+                double_desc.match = (desc->match & ~M_F3) | F3(3);
+                double_desc.mnem += LRD - LRW;
+                decoder_entries[decoder_entry_count++] = double_desc;
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    size_t filled = 0;
+    for (uint32_t bucket = 0; bucket < DECODER_BUCKETS; bucket++) {
+        //the opcode and funct3 bits of the instructions in this bucket
+        uint32_t bits = OPC(bucket >> 3) | F3(bucket & 0x7);
+        decoder_buckets[bucket].first = filled;
+        for (size_t i = 0; i < decoder_entry_count; i++) {
+            uint32_t mask = decoder_entries[i].mask & (M_OPC | M_F3);
+            if ((bits & mask) == (decoder_entries[i].match & mask)) {
+                decoder_bucket_entries[filled++] = i;
+            }
+        }
+        decoder_buckets[bucket].count = filled - decoder_buckets[bucket].first;
+    }
+    decoder_built = true;
+}
+
+static const t_instr_desc *find_entry(uint32_t raw_instr) {
+    uint32_t bucket = bucket_of(raw_instr);
+    for (int i = 0; i < decoder_buckets[bucket].count; i++) {
+        const t_instr_desc *entry = &decoder_entries[decoder_bucket_entries[decoder_buckets[bucket].first + i]];
+        if ((raw_instr & entry->mask) == entry->match) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static void set_rounding_mode(t_risc_instr *p_instr_struct, int32_t raw_instr) {
+    p_instr_struct->rounding_mode = extract_funct3(raw_instr);
+    if (p_instr_struct->rounding_mode == RMM) {
+        //fallback RMM to RNE
+        not_yet_implemented("unsupported rounding mode RMM at 0x%lx, fallback to RNE", p_instr_struct->addr);
+        p_instr_struct->rounding_mode = RNE;
+    }
+}
 
-    //extract opcode bits[6:2]
+/**
+ * Handle an instruction not matching any entry of the description table.
+ * @return the error code, 0 for unimplemented floating point encodings (only reached with --fail-silently)
+ */
+static int32_t decode_unknown(t_risc_instr *p_instr_struct, int32_t raw_instr) {
     t_opcodes opcode = (t_opcodes) (raw_instr >> 2 & 0x1f);
+    if (opcode == OP_BRANCH || opcode == OP_STORE || opcode == OP_OP || opcode == OP_OP_32 || opcode == OP_AMO) {
+        p_instr_struct->reg_src_2 = (t_risc_reg) extract_rs2(raw_instr);
+    }
+
     switch (opcode) {
-        case OP_LUI:
-            p_instr_struct->optype = UPPER_IMMEDIATE;
-            p_instr_struct->mnem = LUI;
-            p_instr_struct->reg_src_1 = INVALID_REG; //Set to not used value for analyzer to work correctly
-            p_instr_struct->imm = extract_imm_U(raw_instr);
-            break;
-        case OP_AUIPC:
-            p_instr_struct->optype = IMMEDIATE;
-            p_instr_struct->mnem = AUIPC;
-            p_instr_struct->reg_src_1 = INVALID_REG; //Set to not used value for analyzer to work correctly
-            p_instr_struct->imm = extract_imm_U(raw_instr);
-            break;
-        case OP_JAL:
-            p_instr_struct->optype = JUMP;
-            p_instr_struct->mnem = JAL;
-            p_instr_struct->reg_src_1 = INVALID_REG; //Set to not used value for analyzer to work correctly
-            p_instr_struct->imm = extract_imm_J(raw_instr);
-            break;
-        case OP_JALR:
-            p_instr_struct->optype = JUMP;
-            p_instr_struct->mnem = JALR;
-            p_instr_struct->imm = extract_imm_I(raw_instr);
-            break;
         case OP_LOAD_FP:
-            p_instr_struct->optype = FLOAT;
-            p_instr_struct->imm = extract_imm_I(raw_instr);
-            switch (extract_funct3(raw_instr)) {
-                case 2:
-                    p_instr_struct->mnem = FLW;
-                    break;
-                case 3:
-                    p_instr_struct->mnem = FLD;
-                    break;
-                default:
-                    critical_not_yet_implemented("Invalid func3 for OP_LOAD_FP Opcode");
-            }
-            break;
         case OP_STORE_FP:
-            p_instr_struct->optype = FLOAT;
-            p_instr_struct->imm = extract_imm_S(raw_instr);
-            p_instr_struct->reg_src_2 = extract_rs2(raw_instr);
-            switch (extract_funct3(raw_instr)) {
-                case 2:
-                    p_instr_struct->mnem = FSW;
-                    break;
-                case 3:
-                    p_instr_struct->mnem = FSD;
-                    break;
-                default:
-                    critical_not_yet_implemented("Invalid func3 for OP_LOAD_FP Opcode");
-            }
+            critical_not_yet_implemented("Invalid func3 for OP_LOAD_FP Opcode");
             break;
-        case OP_MISC_MEM:
-            p_instr_struct->optype = SYSTEM;
-            p_instr_struct->imm = extract_imm_I(raw_instr);
-            switch (extract_funct3(raw_instr)) {
-                case 0:
-                    p_instr_struct->mnem = FENCE;
-                    break;
-                case 1:
-                    p_instr_struct->mnem = FENCE_I;
-                    break;
-                default:
-                    return set_error_message(p_instr_struct, E_f3_MISC_MEM);
-            }
+        case OP_MADD:
+        case OP_MSUB:
+        case OP_NMADD:
+        case OP_NMSUB:
+            critical_not_yet_implemented("unsupported operand size for fused multiply add");
             break;
-        case OP_BRANCH:
-            // BEQ, BNE...
-            p_instr_struct->optype = BRANCH;
-            p_instr_struct->reg_src_2 = (t_risc_reg) extract_rs2(raw_instr);
-            p_instr_struct->reg_dest = INVALID_REG; //Set to not used value for analyzer to work correctly
-            p_instr_struct->imm = extract_imm_B(raw_instr);
-            switch (extract_funct3(raw_instr)) {
-                case 0:
-                    p_instr_struct->mnem = BEQ;
-                    break;
-                case 1:
-                    p_instr_struct->mnem = BNE;
-                    break;
-                case 4:
-                    p_instr_struct->mnem = BLT;
-                    break;
-                case 5:
-                    p_instr_struct->mnem = BGE;
-                    break;
-                case 6:
-                    p_instr_struct->mnem = BLTU;
-                    break;
-                case 7:
-                    p_instr_struct->mnem = BGEU;
-                    break;
-                default:
-                    return set_error_message(p_instr_struct, E_f3_BRANCH);
+        case OP_OP_FP:
+            if (raw_instr & F7(2)) {
+                critical_not_yet_implemented("unsupported operand size for OP_OP_FP;\n"
+                                             " you are probably using the RV32Q/RV64Q extension");
+            } else {
+                critical_not_yet_implemented("unknown funct7 for OP_OP_FP");
             }
             break;
+        case OP_MISC_MEM:
+            return set_error_message(p_instr_struct, E_f3_MISC_MEM);
+        case OP_BRANCH:
+            return set_error_message(p_instr_struct, E_f3_BRANCH);
         case OP_LOAD:
-            p_instr_struct->optype = IMMEDIATE;
-            p_instr_struct->imm = extract_imm_I(raw_instr);
-            switch (extract_funct3(raw_instr)) {
-                case 0: {
-                    p_instr_struct->mnem = LB;
-                    break;
-                }
-                case 1: {
-                    p_instr_struct->mnem = LH;
-                    break;
-                }
-                case 2: {
-                    p_instr_struct->mnem = LW;
-                    break;
-                }
-                case 3: {
-                    p_instr_struct->mnem = LD;
-                    break;
-                }
-                case 4: {
-                    p_instr_struct->mnem = LBU;
-                    break;
-                }
-                case 5: {
-                    p_instr_struct->mnem = LHU;
-                    break;
-                }
-                case 6: {
-                    p_instr_struct->mnem = LWU;
-                    break;
-                }
-                default: {
-                    //int error = extract_funct3(raw_instr); (could potentially output this?)
-                    return set_error_message(p_instr_struct, E_f3_LOAD);
-                }
-            }
-            break;
+            return set_error_message(p_instr_struct, E_f3_LOAD);
         case OP_STORE:
-            p_instr_struct->optype = STORE;
-            p_instr_struct->imm = extract_imm_S(raw_instr);
-            p_instr_struct->reg_dest = INVALID_REG; //Set to not used value for analyzer to work correctly
-            p_instr_struct->reg_src_2 = (t_risc_reg) extract_rs2(raw_instr);
-            switch (extract_funct3(raw_instr)) {
-                case 0:
-                    p_instr_struct->mnem = SB;
-                    break;
-                case 1:
-                    p_instr_struct->mnem = SH;
-                    break;
-                case 2:
-                    p_instr_struct->mnem = SW;
-                    break;
-                case 3:
-                    p_instr_struct->mnem = SD;
-                    break;
-                default:
-                    return set_error_message(p_instr_struct, E_f3_STORE);
-            }
-            break;
+            return set_error_message(p_instr_struct, E_f3_STORE);
         case OP_OP:
-            p_instr_struct->optype = REG_REG;
-            p_instr_struct->reg_src_2 = (t_risc_reg) extract_rs2(raw_instr);
-            if (raw_instr & (1 << 25)) {
-                switch (extract_funct3(raw_instr)) {
-                    case 0:
-                        p_instr_struct->mnem = MUL;
-                        break;
-                    case 1:
-                        p_instr_struct->mnem = MULH;
-                        break;
-                    case 2:
-                        p_instr_struct->mnem = MULHSU;
-                        break;
-                    case 3:
-                        p_instr_struct->mnem = MULHU;
-                        break;
-                    case 4:
-                        p_instr_struct->mnem = DIV;
-                        break;
-                    case 5:
-                        p_instr_struct->mnem = DIVU;
-                        break;
-                    case 6:
-                        p_instr_struct->mnem = REM;
-                        break;
-                    case 7:
-                        p_instr_struct->mnem = REMU;
-                        break;
-                    default:
-                        return set_error_message(p_instr_struct, E_f3_OP);
-                }
-            } else {
-                switch (extract_funct3(raw_instr)) {
-                    case 0:
-                        if (raw_instr & (1 << 30)) {
-                            //SRAI
-                            p_instr_struct->mnem = SUB;
-                        } else {
-                            //SRLI
-                            p_instr_struct->mnem = ADD;
-                        }
-                        break;
-                    case 1:
-                        p_instr_struct->mnem = SLL;
-                        break;
-                    case 2:
-                        p_instr_struct->mnem = SLT;
-                        break;
-                    case 3:
-                        p_instr_struct->mnem = SLTU;
-                        break;
-                    case 4:
-                        p_instr_struct->mnem = XOR;
-                        break;
-                    case 5:
-                        if (raw_instr & (1 << 30)) {
-                            //SRAI
-                            p_instr_struct->mnem = SRA;
-                        } else {
-                            //SRLI
-                            p_instr_struct->mnem = SRL;
-                        }
-                        break;
-                    case 6:
-                        p_instr_struct->mnem = OR;
-                        break;
-                    case 7:
-                        p_instr_struct->mnem = AND;
-                        break;
-                    default:
-                        return set_error_message(p_instr_struct, E_f3_OP);
-                }
+            return set_error_message(p_instr_struct, E_f3_OP);
+        case OP_SYSTEM:
+            return set_error_message(p_instr_struct, E_f3_SYSTEM);
+        case OP_OP_IMM_32:
+            return set_error_message(p_instr_struct, E_f3_IMM_32);
+        case OP_OP_32:
+            return set_error_message(p_instr_struct, raw_instr & BIT(25) ? E_f3_RV64M : E_f3_32);
+        case OP_OP_IMM:
+            return set_error_message(p_instr_struct, E_f3_IMM);
+        case OP_AMO:
+            //the operation is checked before the operand size
+            if (find_entry((raw_instr & ~M_F3) | F3(2)) == NULL) {
+                return set_error_message(p_instr_struct, E_f7_AMO);
             }
+            return set_error_message(p_instr_struct, E_f3_AMO);
+        default:
+            return set_error_message(p_instr_struct, E_UNKNOWN);
+    }
+    p_instr_struct->optype = FLOAT;
+    p_instr_struct->mnem = INVALID_MNEM;
+    return 0;
+}
+
+/**
+ * Decode the raw instruction into the struct.
+ */
+static int32_t decode_instruction(t_risc_instr *p_instr_struct, int32_t raw_instr) {
+    if (!decoder_built) {
+        build_decoder();
+    }
+
+    //fill basic struct
+    p_instr_struct->reg_dest = (t_risc_reg) extract_rd(raw_instr);
+    p_instr_struct->reg_src_1 = (t_risc_reg) extract_rs1(raw_instr);
+    p_instr_struct->reg_src_2 = INVALID_REG; //Set to not used value for analyzer to work correctly
+
+    const t_instr_desc *entry = find_entry(raw_instr);
+    if (entry == NULL) {
+        return decode_unknown(p_instr_struct, raw_instr);
+    }
+
+    p_instr_struct->mnem = entry->mnem;
+    p_instr_struct->optype = entry->optype;
+
+    //INVALID_REG: Set to not used value for analyzer to work correctly
+    switch (entry->format) {
+        case FORMAT_R:
+            p_instr_struct->reg_src_2 = (t_risc_reg) extract_rs2(raw_instr);
+            p_instr_struct->imm = 0;
             break;
-        case OP_SYSTEM:
-            p_instr_struct->optype = SYSTEM;
+        case FORMAT_I:
             p_instr_struct->imm = extract_imm_I(raw_instr);
-            switch (extract_funct3(raw_instr)) {
-                case 0:
-                    if (raw_instr & (1 << 20)) {
-                        p_instr_struct->mnem = EBREAK;
-                    } else {
-                        p_instr_struct->mnem = ECALL;
-                    }
-                    break;
-                case 1:
-                    p_instr_struct->mnem = CSRRW;
-                    break;
-                case 2:
-                    p_instr_struct->mnem = CSRRS;
-                    break;
-                case 3:
-                    p_instr_struct->mnem = CSRRC;
-                    break;
-                case 5:
-                    p_instr_struct->mnem = CSRRWI;
-                    break;
-                case 6:
-                    p_instr_struct->mnem = CSRRSI;
-                    break;
-                case 7:
-                    p_instr_struct->mnem = CSRRCI;
-                    break;
-                default:
-                    return set_error_message(p_instr_struct, E_f3_SYSTEM);
-            }
             break;
-        case OP_OP_IMM_32:
-            p_instr_struct->optype = IMMEDIATE;
-            switch (extract_funct3(raw_instr)) {
-                case 0:
-                    p_instr_struct->mnem = ADDIW;
-                    p_instr_struct->imm = extract_imm_I(raw_instr);
-                    break;
-                case 1: //SLLIW opcode and func3 are unique
-                    p_instr_struct->mnem = SLLIW;
-                    p_instr_struct->imm = extract_small_shamt(raw_instr);
-                    break;
-                case 5: //SRAIW / SRLIW
-                    p_instr_struct->imm = extract_small_shamt(raw_instr);
-                    if (raw_instr & (1 << 30)) {
-                        //SRAI
-                        p_instr_struct->mnem = SRAIW;
-                    } else {
-                        //SRLI
-                        p_instr_struct->mnem = SRLIW;
-                    }
-                    break;
-                default: {
-                    return set_error_message(p_instr_struct, E_f3_IMM_32);
-                }
-            }
+        case FORMAT_I_SHAMT:
+            p_instr_struct->imm = extract_big_shamt(raw_instr);
             break;
-        case OP_OP_32:
-            p_instr_struct->optype = REG_REG;
-            p_instr_struct->reg_src_2 = (t_risc_reg) extract_rs2(raw_instr);
-            if (raw_instr & (1 << 25)) {
-                switch (extract_funct3(raw_instr)) {
-                    case 0:
-                        p_instr_struct->mnem = MULW;
-                        break;
-                    case 4:
-                        p_instr_struct->mnem = DIVW;
-                        break;
-                    case 5:
-                        p_instr_struct->mnem = DIVUW;
-                        break;
-                    case 6:
-                        p_instr_struct->mnem = REMW;
-                        break;
-                    case 7:
-                        p_instr_struct->mnem = REMUW;
-                        break;
-                    default:
-                        return set_error_message(p_instr_struct, E_f3_RV64M);
-                }
-            } else {
-                switch (extract_funct3(raw_instr)) {
-                    case 0:
-                        if (raw_instr & (1 << 30)) {
-                            //SRAI
-                            p_instr_struct->mnem = SUBW;
-                        } else {
-                            //SRLI
-                            p_instr_struct->mnem = ADDW;
-                        }
-                        break;
-                    case 1:
-                        p_instr_struct->mnem = SLLW;
-                        break;
-                    case 5:
-                        if (raw_instr & (1 << 30)) {
-                            //SRAI
-                            p_instr_struct->mnem = SRAW;
-                        } else {
-                            //SRLI
-                            p_instr_struct->mnem = SRLW;
-                        }
-                        break;
-                    default:
-                        return set_error_message(p_instr_struct, E_f3_32);
-                }
-            }
+        case FORMAT_I_SHAMT_W:
+            p_instr_struct->imm = extract_small_shamt(raw_instr);
             break;
-        case OP_OP_IMM:
-            p_instr_struct->optype = IMMEDIATE;
-            switch (extract_funct3(raw_instr)) {
-                case 0: //ADDI
-                    p_instr_struct->mnem = ADDI;
-                    p_instr_struct->imm = extract_imm_I(raw_instr);
-                    break;
-                case 1: //SLLI opcode and func3 are unique
-                    p_instr_struct->mnem = SLLI;
-                    p_instr_struct->imm = extract_big_shamt(raw_instr);
-                    break;
-                case 2: //SLTI
-                    p_instr_struct->mnem = SLTI;
-                    p_instr_struct->imm = extract_imm_I(raw_instr);
-                    break;
-                case 3: //SLTIU
-                    p_instr_struct->mnem = SLTIU;
-                    p_instr_struct->imm = extract_imm_I(raw_instr);
-                    break;
-                case 4:
-                    p_instr_struct->mnem = XORI;
-                    p_instr_struct->imm = extract_imm_I(raw_instr);
-                    break;
-                case 5: //SRAI / SRLI
-                    p_instr_struct->imm = extract_big_shamt(raw_instr);
-                    if (raw_instr & (1 << 30)) {
-                        //SRAI
-                        p_instr_struct->mnem = SRAI;
-                    } else {
-                        //SRLI
-                        p_instr_struct->mnem = SRLI;
-                    }
-                    break;
-                case 6:
-                    p_instr_struct->mnem = ORI;
-                    p_instr_struct->imm = extract_imm_I(raw_instr);
-                    break;
-                case 7:
-                    p_instr_struct->mnem = ANDI;
-                    p_instr_struct->imm = extract_imm_I(raw_instr);
-                    break;
-                default: {
-                    return set_error_message(p_instr_struct, E_f3_IMM);
-                }
-            }
+        case FORMAT_S:
+            p_instr_struct->reg_dest = INVALID_REG;
+            //fallthrough
+        case FORMAT_S_FP:
+            p_instr_struct->reg_src_2 = (t_risc_reg) extract_rs2(raw_instr);
+            p_instr_struct->imm = extract_imm_S(raw_instr);
             break;
-        case OP_MADD:
-            p_instr_struct->optype = FLOAT;
-            p_instr_struct->mnem = FMADDS;
-            p_instr_struct->reg_src_2 = extract_rs2(raw_instr);
-            p_instr_struct->reg_src_3 = extract_rs3(raw_instr);
-            p_instr_struct->rounding_mode = extract_funct3(raw_instr);
-            if(p_instr_struct->rounding_mode == RMM) {
-                //fallback RMM to RNE
-                not_yet_implemented("unsupported rounding mode RMM at 0x%lx, fallback to RNE",
-                                             p_instr_struct->addr);
-                p_instr_struct->rounding_mode = RNE;
-            }
-            switch (extract_funct2(raw_instr)) {
-                case 0:
-                    p_instr_struct->mnem = FMADDS;
-                    break;
-                case 1:
-                    p_instr_struct->mnem = FMADDD;
-                    break;
-                default:
-                    critical_not_yet_implemented("unsupported operand size FMADD");
-            }
+        case FORMAT_B:
+            p_instr_struct->reg_dest = INVALID_REG;
+            p_instr_struct->reg_src_2 = (t_risc_reg) extract_rs2(raw_instr);
+            p_instr_struct->imm = extract_imm_B(raw_instr);
             break;
-        case OP_MSUB:
-            p_instr_struct->optype = FLOAT;
-            p_instr_struct->reg_src_2 = extract_rs2(raw_instr);
-            p_instr_struct->reg_src_3 = extract_rs3(raw_instr);
-            p_instr_struct->rounding_mode = extract_funct3(raw_instr);
-            if(p_instr_struct->rounding_mode == RMM) {
-                //fallback RMM to RNE
-                not_yet_implemented("unsupported rounding mode RMM at 0x%lx, fallback to RNE",
-                                             p_instr_struct->addr);
-                p_instr_struct->rounding_mode = RNE;
-            }
-            switch (extract_funct2(raw_instr)) {
-                case 0:
-                    p_instr_struct->mnem = FMSUBS;
-                    break;
-                case 1:
-                    p_instr_struct->mnem = FMSUBD;
-                    break;
-                default:
-                    critical_not_yet_implemented("unsupported operand size FMSUB");
-            }
+        case FORMAT_U:
+            p_instr_struct->reg_src_1 = INVALID_REG;
+            p_instr_struct->imm = extract_imm_U(raw_instr);
             break;
-        case OP_NMADD:
-            p_instr_struct->optype = FLOAT;
-            p_instr_struct->reg_src_2 = extract_rs2(raw_instr);
-            p_instr_struct->reg_src_3 = extract_rs3(raw_instr);
-            p_instr_struct->rounding_mode = extract_funct3(raw_instr);
-            if(p_instr_struct->rounding_mode == RMM) {
-                //fallback RMM to RNE
-                not_yet_implemented("unsupported rounding mode RMM at 0x%lx, fallback to RNE",
-                                             p_instr_struct->addr);
-                p_instr_struct->rounding_mode = RNE;
-            }
-            switch (extract_funct2(raw_instr)) {
-                case 0:
-                    p_instr_struct->mnem = FNMADDS;
-                    break;
-                case 1:
-                    p_instr_struct->mnem = FNMADDD;
-                    break;
-                default:
-                    critical_not_yet_implemented("unsupported operand size FNMADD");
-            }
+        case FORMAT_J:
+            p_instr_struct->reg_src_1 = INVALID_REG;
+            p_instr_struct->imm = extract_imm_J(raw_instr);
             break;
-        case OP_NMSUB:
-            p_instr_struct->optype = FLOAT;
-            p_instr_struct->reg_src_2 = extract_rs2(raw_instr);
+        case FORMAT_R4:
+            p_instr_struct->reg_src_2 = (t_risc_reg) extract_rs2(raw_instr);
             p_instr_struct->reg_src_3 = extract_rs3(raw_instr);
-            p_instr_struct->rounding_mode = extract_funct3(raw_instr);
-            if(p_instr_struct->rounding_mode == RMM) {
-                //fallback RMM to RNE
-                not_yet_implemented("unsupported rounding mode RMM at 0x%lx, fallback to RNE",
-                                             p_instr_struct->addr);
-                p_instr_struct->rounding_mode = RNE;
-            }
-            switch (extract_funct2(raw_instr)) {
-                case 0:
-                    p_instr_struct->mnem = FNMSUBS;
-                    break;
-                case 1:
-                    p_instr_struct->mnem = FNMSUBD;
-                    break;
-                default:
-                    critical_not_yet_implemented("unsupported operand size FNMSUB");
-            }
+            set_rounding_mode(p_instr_struct, raw_instr);
             break;
-        case OP_OP_FP: {
-            p_instr_struct->optype = FLOAT;
-            int funct7 = extract_funct7(raw_instr);
-            int funct3 = extract_funct3(raw_instr);
-            int rs2 = extract_rs2(raw_instr);
-            int operandSize = funct7 & 0x3; // lower two bits determine operand size
-            // it looks like this bit determines if the rs2 field is used as a rounding mode, or as a funct code
-            if ((funct7 & 0x0100000) == 0) {
-                p_instr_struct->reg_src_2 = rs2;
-            }
-
-            // furthermore the 5 bit determines if the funct3 field is used as a rounding mode, or as a funct code
-            if ((funct7 & 0x0010000) == 0) {
-                p_instr_struct->rounding_mode = funct3;
-                if(p_instr_struct->rounding_mode == RMM) {
-                    //fallback RMM to RNE
-                    not_yet_implemented("unsupported rounding mode RMM at 0x%lx, fallback to RNE",
-                                                 p_instr_struct->addr);
-                    p_instr_struct->rounding_mode = RNE;
-                }
-            }
-
-            //ignore lower two bits which only set operand size
-            funct7 = funct7 >> 2;
-            switch (funct7) {
-                case 0:
-                    p_instr_struct->mnem = FADDS;
-                    break;
-                case 1:
-                    p_instr_struct->mnem = FSUBS;
-                    break;
-                case 2:
-                    p_instr_struct->mnem = FMULS;
-                    break;
-                case 3:
-                    p_instr_struct->mnem = FDIVS;
-                    break;
-                case 4:
-                    switch (funct3) {
-                        case 0:
-                            p_instr_struct->mnem = FSGNJS;
-                            break;
-                        case 1:
-                            p_instr_struct->mnem = FSGNJNS;
-                            break;
-                        case 2:
-                            p_instr_struct->mnem = FSGNJXS;
-                            break;
-                        default:
-                            critical_not_yet_implemented("unknown funct3 for FSGNJ");
-                    }
-                    break;
-                case 5:
-                    switch (funct3) {
-                        case 0:
-                            p_instr_struct->mnem = FMINS;
-                            break;
-                        case 1:
-                            p_instr_struct->mnem = FMAXS;
-                            break;
-                        default:
-                            critical_not_yet_implemented("unknown funct3 for funct7=5");
-                    }
-                    break;
-                case 8:
-                    switch (rs2) {
-                        case 0:
-                            p_instr_struct->mnem = FCVTDS;
-                            break;
-                        case 1:
-                            p_instr_struct->mnem = FCVTSD;
-                            break;
-                        default:
-                            critical_not_yet_implemented("unknown funct3 for funct7=8");
-                    }
-                    break;
-                case 11:
-                    p_instr_struct->mnem = FSQRTS;
-                    break;
-                case 20:
-                    switch (funct3) {
-                        case 0:
-                            p_instr_struct->mnem = FLES;
-                            break;
-                        case 1:
-                            p_instr_struct->mnem = FLTS;
-                            break;
-                        case 2:
-                            p_instr_struct->mnem = FEQS;
-                            break;
-                        default:
-                            critical_not_yet_implemented("unknown funct3 for FSGNJ");
-                    }
-                    break;
-                case 24:
-                    switch (rs2) {
-                        case 0:
-                            p_instr_struct->mnem = FCVTWS;
-                            break;
-                        case 1:
-                            p_instr_struct->mnem = FCVTWUS;
-                            break;
-                        case 2:
-                            p_instr_struct->mnem = FCVTLS;
-                            break;
-                        case 3:
-                            p_instr_struct->mnem = FCVTLUS;
-                            break;
-                        default:
-                            critical_not_yet_implemented("unknown funct3 for FCVTW");
-                    }
-                    break;
-                case 26:
-                    switch (rs2) {
-                        case 0:
-                            p_instr_struct->mnem = FCVTSW;
-                            break;
-                        case 1:
-                            p_instr_struct->mnem = FCVTSWU;
-                            break;
-                        case 2:
-                            p_instr_struct->mnem = FCVTSL;
-                            break;
-                        case 3:
-                            p_instr_struct->mnem = FCVTSLU;
-                            break;
-                        default:
-                            critical_not_yet_implemented("unknown funct3 for FCVTS");
-                    }
-                    break;
-                case 28:
-                    switch (funct3) {
-                        case 0:
-                            p_instr_struct->mnem = FMVXW;
-                            break;
-                        case 1:
-                            p_instr_struct->mnem = FCLASSS;
-                            break;
-                        default:
-                            critical_not_yet_implemented("unknown funct3 for funct7=28");
-                    }
-                    break;
-                case 30:
-                    p_instr_struct->mnem = FMVWX;
-                    break;
-                default:
-                    critical_not_yet_implemented("unknown funct7 for OP_OP_FP");
-                    break;
-            }
-            if (funct7 != 8) {
-                //fit mnem to the operand size
-                switch (operandSize) {
-                    case 0:
-                        //default 16 bit nothing to do
-                        break;
-                    case 1:
-                        //because of our ordering of the mnems in typedef.h we can just add a constant factor
-                        p_instr_struct->mnem += FLD - FLW;
-                        break;
-                    default:
-                        critical_not_yet_implemented("unsupported operand size for OP_OP_FP;\n"
-                                                     " you are probably using the RV32Q/RV64Q extension");
-                }
-            }
-        }
+        case FORMAT_FP:
+            p_instr_struct->reg_src_2 = (t_risc_reg) extract_rs2(raw_instr);
+            p_instr_struct->reg_src_3 = 0;
+            set_rounding_mode(p_instr_struct, raw_instr);
             break;
-        case OP_AMO:
+        case FORMAT_AMO:
             p_instr_struct->reg_src_2 = (t_risc_reg) extract_rs2(raw_instr);
             p_instr_struct->imm = extract_funct7(raw_instr);
-            // switch between different OP_AMO types, which are decoded in upper bytes of funct7
-            switch (p_instr_struct->imm >> 2) {
-                case 0:
-                    p_instr_struct->mnem = AMOADDW;
-                    break;
-                case 1:
-                    p_instr_struct->mnem = AMOSWAPW;
-                    break;
-                case 2:
-                    p_instr_struct->mnem = LRW;
-                    break;
-                case 3:
-                    p_instr_struct->mnem = SCW;
-                    break;
-                case 4:
-                    p_instr_struct->mnem = AMOXORW;
-                    break;
-                case 8:
-                    p_instr_struct->mnem = AMOORW;
-                    break;
-                case 12:
-                    p_instr_struct->mnem = AMOANDW;
-                    break;
-                case 16:
-                    p_instr_struct->mnem = AMOMINW;
-                    break;
-                case 20:
-                    p_instr_struct->mnem = AMOMAXW;
-                    break;
-                case 24:
-                    p_instr_struct->mnem = AMOMINUW;
-                    break;
-                case 28:
-                    p_instr_struct->mnem = AMOMAXUW;
-                    break;
-                default:
-                    return set_error_message(p_instr_struct, E_f7_AMO);
-            }
-            // funct3 differentiates between RV32A and RV64A
-            switch (extract_funct3(raw_instr)) {
-                case 2:
-                    //RV32A
-                    break;
-                case 3:
-                    //RV64A
-                    p_instr_struct->mnem += LRD - LRW;
-                    break;
-                default:
-                    return set_error_message(p_instr_struct, E_f3_AMO);
-            }
-
             break;
-        default:
-            return set_error_message(p_instr_struct, E_UNKNOWN);
     }
     return 0;
 }
+
+/**
+ * Parse given raw_instruction and save all data in the struct.
+ * @param p_instr_struct struct filled with the addr of the instruction to be translated
+ * @return 0 or the error code if the instruction is invalid
+ */
+int32_t parse_instruction(t_risc_instr *p_instr_struct) {
+    int32_t raw_instr = *(int32_t *) p_instr_struct->addr; //cast and dereference
+    log_asm_in("Parsing 0x%x at %p\n", raw_instr, (void *) p_instr_struct->addr);
+
+    return decode_instruction(p_instr_struct, raw_instr);
+}
+
+/**
+ * Cache of decoded instructions, direct mapped by address.
+ * An entry is valid as long as the raw instruction at its address has not changed (e.g. by self-modifying code).
+ */
+#define DECODE_CACHE_SIZE 4096
+
+typedef struct {
+    t_risc_addr addr;
+    int32_t raw_instr;
+    int32_t result;
+    t_risc_instr instr;
+} t_decode_cache_entry;
+
+static t_decode_cache_entry decode_cache[DECODE_CACHE_SIZE];
+
+/**
+ * Parse the instruction at the given address like parse_instruction(), reusing the result of an earlier decoding of the
+ * same instruction if it is in the decode cache (--optimize=no-decode-cache disables the cache).
+ * Used by the translator, which decodes instructions repeatedly (e.g. jump targets, block summaries, retranslation).
+ * @param p_instr_struct struct filled with the addr of the instruction to be translated
+ * @return 0 or the error code if the instruction is invalid
+ */
+int32_t parse_instruction_cached(t_risc_instr *p_instr_struct) {
+    if (!flag_translate_opt_decode_cache) {
+        return parse_instruction(p_instr_struct);
+    }
+
+    int32_t raw_instr = *(int32_t *) p_instr_struct->addr; //cast and dereference
+    log_asm_in("Parsing 0x%x at %p\n", raw_instr, (void *) p_instr_struct->addr);
+
+    t_decode_cache_entry *entry = &decode_cache[(p_instr_struct->addr >> 2) & (DECODE_CACHE_SIZE - 1)];
+    t_trace_follow trace_follow = p_instr_struct->trace_follow;
+
+    if (entry->addr == p_instr_struct->addr && entry->raw_instr == raw_instr) {
+        if (flag_do_profile) profile_decode(true);
+    } else {
+        if (flag_do_profile) profile_decode(false);
+        entry->instr = *p_instr_struct;
+        entry->result = decode_instruction(&entry->instr, raw_instr);
+        entry->addr = p_instr_struct->addr;
+        entry->raw_instr = raw_instr;
+    }
+
+    *p_instr_struct = entry->instr;
+    p_instr_struct->trace_follow = trace_follow;
+    return entry->result;
+}
@@ -42,6 +42,8 @@ typedef enum {
  */
 int32_t parse_instruction(t_risc_instr *instr_struct);
 
+int32_t parse_instruction_cached(t_risc_instr *instr_struct);
+
 #ifdef __cplusplus
 }
 #endif
@@ -4,9 +4,15 @@
 
 #include <asm/stat.h>
 #include <linux/mman.h>
+#include <linux/sysinfo.h>
+#include <linux/utsname.h>
 #include <common.h>
 #include <runtime/register.h>
 #include <elf/loadElf.h>
+#include <env/flags.h>
+#include <gen/translate.h>
+#include <cache/smc.h>
+#include <main/main.h>
 #include "emulateEcall.h"
 
 //for potentially required syscalls see https://github.com/aengelke/instrew/blob/master/client/emulate.c
@@ -34,8 +40,6 @@ typedef struct {
     unsigned int __unused5;
 } statRiscV;
 
-extern bool finalize;
-
 static t_risc_addr lastHint;
 
 int guest_exit_status;
@@ -115,6 +119,22 @@ static size_t syscall6(int syscall_number, size_t a1, size_t a2, size_t a3,
     return retval;
 }
 
+//bound on the size of the structures written by commands of ioctl and fcntl
+#define COMMAND_OUTPUT_SIZE 4096lu
+
+/**
+ * Invalidate the translations in guest memory that the passed syscall output is written to, with --smc.
+ * Pages with translated code are write protected: stores of the translator are caught by the fault handler
+ * (see smc.c), but the kernel would fail the syscall with -EFAULT instead.
+ * @param buffer the guest address of the output, may also be NULL or an argument that is not used as pointer
+ * @param length the length of the output in bytes
+ */
+static void invalidate_output(t_risc_addr buffer, size_t length) {
+    if (flag_smc && buffer != 0) {
+        smc_invalidate_range(buffer, length);
+    }
+}
+
 __attribute__((force_align_arg_pointer))
 void emulate_ecall(t_risc_addr addr, t_risc_reg_val *registerValues) {
     ///Increment PC, if the syscall needs to modify it just overwrite it in the specific branch.
@@ -123,18 +143,21 @@ void emulate_ecall(t_risc_addr addr, t_risc_reg_val *registerValues) {
         case 17: //getcwd
         {
             log_syscall("Emulate syscall getcwd (17)...\n");
+            invalidate_output(registerValues[a0], registerValues[a1]);
             registerValues[a0] = syscall2(__NR_getcwd, registerValues[a0], registerValues[a1]);
         }
             break;
         case 25: //fcntl
         {
             log_syscall("Emulate syscall fcntl (25)...\n");
+            invalidate_output(registerValues[a2], COMMAND_OUTPUT_SIZE);
             registerValues[a0] = syscall3(__NR_fcntl, registerValues[a0], registerValues[a1], registerValues[a2]);
         }
             break;
         case 29: //ioctl
         {
             log_syscall("Emulate syscall ioctl (29)...\n");
+            invalidate_output(registerValues[a2], COMMAND_OUTPUT_SIZE);
             registerValues[a0] = syscall3(__NR_ioctl, registerValues[a0], registerValues[a1], registerValues[a2]);
         }
             break;
@@ -178,6 +201,7 @@ void emulate_ecall(t_risc_addr addr, t_risc_reg_val *registerValues) {
         case 59: //pipe2
         {
             log_syscall("Emulate syscall pipe2 (59)...\n");
+            invalidate_output(registerValues[a0], 2 * sizeof(int));
             registerValues[a0] = syscall2(__NR_pipe2, registerValues[a0], registerValues[a1]);
         }
             break;
@@ -197,6 +221,7 @@ void emulate_ecall(t_risc_addr addr, t_risc_reg_val *registerValues) {
         case 61: //getdents64
         {
             log_syscall("Emulate syscall getdents64 (61)...\n");
+            invalidate_output(registerValues[a1], registerValues[a2]);
             registerValues[a0] = syscall3(__NR_getdents64, registerValues[a0], registerValues[a1], registerValues[a2]);
         }
             break;
@@ -209,6 +234,7 @@ void emulate_ecall(t_risc_addr addr, t_risc_reg_val *registerValues) {
         case 63: //read
         {
             log_syscall("Emulate syscall read (63)...\n");
+            invalidate_output(registerValues[a1], registerValues[a2]);
             registerValues[a0] = syscall3(__NR_read, registerValues[a0], registerValues[a1], registerValues[a2]);
         }
             break;
@@ -227,6 +253,7 @@ void emulate_ecall(t_risc_addr addr, t_risc_reg_val *registerValues) {
         case 78: //readlinkat
         {
             log_syscall("Emulate syscall readlinkat (78)...\n");
+            invalidate_output(registerValues[a2], registerValues[a3]);
             registerValues[a0] = syscall4(__NR_readlinkat, registerValues[a0], registerValues[a1], registerValues[a2],
                                           registerValues[a3]);
         }
@@ -235,6 +262,7 @@ void emulate_ecall(t_risc_addr addr, t_risc_reg_val *registerValues) {
         {
             log_syscall("Emulate syscall fstat (80)...\n");
             statRiscV *pStatRiscV = (statRiscV *) registerValues[a2];
+            invalidate_output(registerValues[a2], sizeof(statRiscV));
             struct stat buf = {0};
             registerValues[a0] = syscall4(__NR_newfstatat, registerValues[a0], registerValues[a1], (size_t) &buf,
                                           registerValues[a3]);
@@ -260,6 +288,7 @@ void emulate_ecall(t_risc_addr addr, t_risc_reg_val *registerValues) {
         {
             log_syscall("Emulate syscall fstat (80)...\n");
             statRiscV *pStatRiscV = (statRiscV *) registerValues[a1];
+            invalidate_output(registerValues[a1], sizeof(statRiscV));
             struct stat buf = {0};
             registerValues[a0] = syscall2(__NR_fstat, registerValues[a0], (size_t) &buf);
             pStatRiscV->st_blksize = buf.st_blksize;
@@ -314,6 +343,8 @@ void emulate_ecall(t_risc_addr addr, t_risc_reg_val *registerValues) {
         case 98: //futex
         {
             log_syscall("Emulate syscall futex (98)...\n");
+            invalidate_output(registerValues[a0], sizeof(uint32_t));
+            invalidate_output(registerValues[a4], sizeof(uint32_t));
             registerValues[a0] = syscall6(__NR_futex, registerValues[a0], registerValues[a1], registerValues[a2],
                                           registerValues[a3], registerValues[a4], registerValues[a5]);
         }
@@ -327,7 +358,12 @@ void emulate_ecall(t_risc_addr addr, t_risc_reg_val *registerValues) {
         case 113: //clock_gettime
         {
             log_syscall("Emulate syscall clock_gettime (113)...\n");
-            registerValues[a0] = syscall2(__NR_clock_gettime, registerValues[a0], registerValues[a1]);
+            invalidate_output(registerValues[a1], sizeof(struct timespec));
+            if (vdso_clock_gettime != NULL) {
+                registerValues[a0] = vdso_clock_gettime(registerValues[a0], (struct timespec *) registerValues[a1]);
+            } else {
+                registerValues[a0] = syscall2(__NR_clock_gettime, registerValues[a0], registerValues[a1]);
+            }
         }
             break;
         case 131: //tgkill
@@ -348,6 +384,7 @@ void emulate_ecall(t_risc_addr addr, t_risc_reg_val *registerValues) {
         case 135: //rt_sigprocmask
         {
             log_syscall("Emulate syscall rt_sigprocmask (135)...\n");
+            invalidate_output(registerValues[a2], registerValues[a3]);
             registerValues[a0] =
                     syscall4(__NR_rt_sigprocmask, registerValues[a0], registerValues[a1], registerValues[a2],
                              registerValues[a3]);
@@ -356,13 +393,21 @@ void emulate_ecall(t_risc_addr addr, t_risc_reg_val *registerValues) {
         case 160: //uname
         {
             log_syscall("Emulate syscall uname (160)...\n");
+            invalidate_output(registerValues[a0], sizeof(struct new_utsname));
             registerValues[a0] = syscall1(__NR_uname, registerValues[a0]);
         }
             break;
         case 169: //gettimeofday
         {
             log_syscall("Emulate syscall gettimeofday (169)...\n");
-            registerValues[a0] = syscall2(__NR_gettimeofday, registerValues[a0], registerValues[a1]);
+            invalidate_output(registerValues[a0], sizeof(struct timeval));
+            invalidate_output(registerValues[a1], sizeof(struct timezone));
+            if (vdso_gettimeofday != NULL) {
+                registerValues[a0] = vdso_gettimeofday((struct timeval *) registerValues[a0],
+                                                       (struct timezone *) registerValues[a1]);
+            } else {
+                registerValues[a0] = syscall2(__NR_gettimeofday, registerValues[a0], registerValues[a1]);
+            }
         }
             break;
         case 172: //getpid
@@ -404,6 +449,7 @@ void emulate_ecall(t_risc_addr addr, t_risc_reg_val *registerValues) {
         case 179: //sysinfo
         {
             log_syscall("Emulate syscall sysinfo (179)...\n");
+            invalidate_output(registerValues[a0], sizeof(struct sysinfo));
             registerValues[a0] = syscall1(__NR_sysinfo, registerValues[a0]);
         }
             break;
@@ -455,6 +501,9 @@ void emulate_ecall(t_risc_addr addr, t_risc_reg_val *registerValues) {
                 log_general("Prevented munmap in translator region.");
                 registerValues[a0] = -EINVAL; //Is this a fitting error code to return?
             } else {
+                if (flag_smc) {
+                    smc_invalidate_range(munmapAddr, size);
+                }
                 registerValues[a0] = syscall2(__NR_munmap, registerValues[a0], registerValues[a1]);
             }
         }
@@ -494,15 +543,47 @@ void emulate_ecall(t_risc_addr addr, t_risc_reg_val *registerValues) {
                 }
             } else {
                 //Fixed mapping that does not interfere with translator region
+                if (flag_smc) {
+                    smc_invalidate_range(mmapAddr, registerValues[a1]);
+                }
                 registerValues[a0] =
                         syscall6(__NR_mmap, mmapAddr, registerValues[a1], registerValues[a2],
                                  flags, registerValues[a4], registerValues[a5]);
             }
         }
             break;
+        case 226: //mprotect
+        {
+            log_syscall("Emulate syscall mprotect (226)...\n");
+            t_risc_reg_val mprotectAddr = registerValues[a0];
+            t_risc_reg_val size = registerValues[a1];
+            if (mprotectAddr + size > (TRANSLATOR_BASE - STACK_OFFSET)) {
+                log_general("Prevented mprotect in translator region.");
+                registerValues[a0] = -EINVAL;
+            } else {
+                //the new protection replaces our write protection, so forget the translations in the range
+                if (flag_smc) {
+                    smc_invalidate_range(mprotectAddr, size);
+                }
+                registerValues[a0] = syscall3(__NR_mprotect, mprotectAddr, size, registerValues[a2]);
+            }
+        }
+            break;
+        case 259: //riscv_flush_icache
+        {
+            log_syscall("Emulate syscall riscv_flush_icache (259)...\n");
+            //with --smc, modified code has already been invalidated, otherwise flush everything
+            if (!flag_smc) {
+                code_cache_flush_requested = true;
+            }
+            registerValues[a0] = 0;
+        }
+            break;
         case 260: //wait4
         {
             log_syscall("Emulate syscall wait4 (260)...\n");
+            invalidate_output(registerValues[a1], sizeof(int));
+            invalidate_output(registerValues[a3], sizeof(struct rusage));
             registerValues[a0] = syscall4(__NR_wait4, registerValues[a0], registerValues[a1], registerValues[a2],
                                           registerValues[a3]);
         }
@@ -510,6 +591,7 @@ void emulate_ecall(t_risc_addr addr, t_risc_reg_val *registerValues) {
         case 261: //prlimit64
         {
             log_syscall("Emulate syscall prlimit64 (261)...\n");
+            invalidate_output(registerValues[a3], sizeof(struct rlimit64));
             registerValues[a0] = syscall4(__NR_prlimit64, registerValues[a0], registerValues[a1], registerValues[a2],
                                           registerValues[a3]);
         }
@@ -524,6 +606,7 @@ void emulate_ecall(t_risc_addr addr, t_risc_reg_val *registerValues) {
         case 278: //getrandom
         {
             log_syscall("Emulate syscall getrandom (278)...\n");
+            invalidate_output(registerValues[a0], registerValues[a1]);
             registerValues[a0] = syscall3(__NR_getrandom, registerValues[a0], registerValues[a1], registerValues[a2]);
         }
             break;
@@ -0,0 +1,96 @@
+/**
+ * Arena (bump) allocation of the translator's internal memory.
+ * Each arena reserves one range of address space on first use, which the kernel only backs with memory once it is
+ * touched. Allocating is then just moving the arena's fill level, without a syscall.
+ * Memory is freed in LIFO order by returning to a mark taken before: the translation of a block takes a mark and
+ * resets the scratch arena to it when done, which also works for nested allocations in between.
+ */
+
+#include "arena.h"
+#include <common.h>
+#include <linux/mman.h>
+#include <env/exit.h>
+
+#define SCRATCH_ARENA_SIZE (64lu << 20)
+#define STATIC_ARENA_SIZE (4lu << 20)
+#define ARENA_ALIGNMENT 16lu
+
+t_arena scratch_arena = {"scratch", NULL, SCRATCH_ARENA_SIZE, 0};
+t_arena static_arena = {"static", NULL, STATIC_ARENA_SIZE, 0};
+
+static void reserve_arena(t_arena *arena) {
+    arena->base = mmap(NULL, arena->size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE | MAP_NORESERVE, -1, 0);
+
+    if (BAD_ADDR(arena->base)) {
+        dprintf(2, "Failed to reserve the %s arena. Error %li", arena->name, -(intptr_t) arena->base);
+        panic(FAIL_HEAP_ALLOC);
+    }
+}
+
+static inline size_t align_size(size_t size) {
+    return (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+}
+
+static void *bump(t_arena *arena, size_t size) {
+    if (arena->base == NULL) {
+        reserve_arena(arena);
+    }
+
+    size = align_size(size);
+    if (arena->size - arena->used < size) {
+        dprintf(2, "The %s arena is exhausted (%lu bytes).", arena->name, arena->size);
+        panic(FAIL_HEAP_ALLOC);
+    }
+
+    void *memory = arena->base + arena->used;
+    arena->used += size;
+    return memory;
+}
+
+/**
+ * Allocate zeroed memory from the passed arena, aligned to 16 bytes.
+ * @param arena the arena
+ * @param size the size in bytes
+ * @return the memory
+ */
+void *arena_alloc(t_arena *arena, size_t size) {
+    void *memory = bump(arena, size);
+    memset(memory, 0, size);
+    return memory;
+}
+
+/**
+ * Grow an allocation from the passed arena, keeping its content.
+ * The allocation is extended in place if nothing was allocated behind it (anymore), else it is moved.
+ * @param arena the arena
+ * @param memory the allocation, from arena_alloc() or arena_grow()
+ * @param size the current size of the allocation in bytes
+ * @param new_size the new size in bytes, the added memory is zeroed
+ * @return the grown allocation
+ */
+void *arena_grow(t_arena *arena, void *memory, size_t size, size_t new_size) {
+    if ((uint8_t *) memory + align_size(size) == arena->base + arena->used) {
+        arena->used -= align_size(size);
+        bump(arena, new_size);
+    } else {
+        void *grown = bump(arena, new_size);
+        memcpy(grown, memory, size);
+        memory = grown;
+    }
+    memset((uint8_t *) memory + size, 0, new_size - size);
+    return memory;
+}
+
+/**
+ * Get the current fill level of the passed arena, to free everything allocated after this with arena_reset().
+ */
+t_arena_mark arena_mark(const t_arena *arena) {
+    return arena->used;
+}
+
+/**
+ * Free everything allocated from the passed arena since the mark was taken.
+ */
+void arena_reset(t_arena *arena, t_arena_mark mark) {
+    arena->used = mark;
+}
@@ -0,0 +1,41 @@
+#ifndef DYNAMICBINARYTRANSLATORRISCV64_X86_64_ARENA_H
+#define DYNAMICBINARYTRANSLATORRISCV64_X86_64_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Bump allocator over one reserved memory range, see arena.c.
+ */
+typedef struct {
+    const char *name;
+    uint8_t *base;
+    size_t size;
+    size_t used;
+} t_arena;
+
+//allocation position to return to with arena_reset()
+typedef size_t t_arena_mark;
+
+//scratch data of the translation of a block or trace, reset when it is done
+extern t_arena scratch_arena;
+//data living as long as the translator, e.g. the context
+extern t_arena static_arena;
+
+void *arena_alloc(t_arena *arena, size_t size);
+
+void *arena_grow(t_arena *arena, void *memory, size_t size, size_t new_size);
+
+t_arena_mark arena_mark(const t_arena *arena);
+
+void arena_reset(t_arena *arena, t_arena_mark mark);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //DYNAMICBINARYTRANSLATORRISCV64_X86_64_ARENA_H
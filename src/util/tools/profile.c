@@ -3,6 +3,11 @@
 //
 
 #include <cache/cache.h>
+#include <cache/chain.h>
+#include <gen/translate.h>
+#include <gen/worklist.h>
+#include <env/opt.h>
+#include <common.h>
 #include "profile.h"
 
 /**
@@ -10,6 +15,69 @@
  */
 static size_t count_cache_lookups = 0;
 
+/**
+ * Count of instructions decoded by the translator, and of those served from the decode cache.
+ */
+static size_t count_decodes = 0;
+static size_t count_cached_decodes = 0;
+
+/**
+ * Count of code cache flushes and the highest code cache usage in bytes seen at a flush.
+ */
+static size_t count_cache_flushes = 0;
+static size_t max_code_cache_usage = 0;
+
+/**
+ * Count of write faults on write-protected guest code pages and of blocks invalidated because of them (--smc).
+ */
+static size_t count_smc_faults = 0;
+static size_t count_smc_invalidations = 0;
+
+/**
+ * Count of blocks translated by the baseline tier (of which some ahead of their execution), of traces translated by
+ * the optimizing tier and of the blocks these contain.
+ */
+static size_t count_baseline_blocks = 0;
+static size_t count_ahead_blocks = 0;
+static size_t count_traces = 0;
+static size_t count_trace_blocks = 0;
+
+/**
+ * Count of baseline blocks and of traces that were split only because they reached their length limit
+ * (--block-length, --trace-length).
+ */
+static size_t count_split_blocks = 0;
+static size_t count_split_traces = 0;
+
+/**
+ * Count of registers promoted into host registers for a region of an optimized trace, and of the references
+ * by the translated instructions that thereby hit a host register instead of the register file (in sum, without the
+ * references to the displaced registers).
+ */
+static size_t count_promotions = 0;
+static size_t count_promoted_references = 0;
+
+/**
+ * Count of write-backs of replacement registers left out of the translated code as the register was dead.
+ */
+static size_t count_dead_writebacks = 0;
+
+/**
+ * Count of instructions rewritten by the block optimizations (constant/copy propagation), of branches fused with the
+ * comparison feeding them, and of dead instructions dropped, see propagate.c and optimize.c.
+ */
+static size_t count_rewritten_instructions = 0;
+static size_t count_forwarded_accesses = 0;
+static size_t count_fused_branches = 0;
+static size_t count_eliminated_instructions = 0;
+
+/**
+ * Count of guest instructions translated and of the bytes of host code emitted for them (including the code of the
+ * blocks around them, e.g. exits).
+ */
+static size_t count_translated_instructions = 0;
+static size_t count_emitted_bytes = 0;
+
 /**
  * Usage array for profiler.
  * Used to count general purpose register accesses during program execution.
@@ -22,6 +90,43 @@ uint64_t gp_usage[N_REG];
  */
 uint64_t fp_usage[N_FP_REG];
 
+/**
+ * Hit and miss counters of the inline indirect branch lookup.
+ * Incremented directly by the generated code of unchained JALR instructions.
+ */
+uint64_t ibl_hits = 0;
+uint64_t ibl_misses = 0;
+
+/**
+ * Counter of block exits taken while still unlinked, i.e. returns to the dispatcher through an exit's fallback.
+ */
+uint64_t unlinked_exits_taken = 0;
+
+/**
+ * Counter of lazy loads of the fp registers, incremented by the generated loading routine (see context.c).
+ */
+uint64_t fp_context_loads = 0;
+
+/**
+ * Hit and miss counters of the cache lookups done by the native dispatcher (see context.c).
+ * A miss returns to the main loop to translate the block.
+ */
+uint64_t native_dispatches = 0;
+uint64_t native_dispatch_misses = 0;
+
+/**
+ * Counter of syscalls issued directly by the translated code, without the context switch (see translate_ECALL()).
+ */
+uint64_t fast_ecalls = 0;
+
+/**
+ * Counters of the return address stack, incremented by the generated code of calls and returns
+ * (see return_stack.c): returns predicted or not, and calls overwriting a valid entry.
+ */
+uint64_t ras_hits = 0;
+uint64_t ras_misses = 0;
+uint64_t ras_overflows = 0;
+
 __attribute__((unused))
 uint64_t *get_gp_usage_file(void) {
     return gp_usage;
@@ -32,15 +137,181 @@ uint64_t *get_fp_usage_file(void) {
     return fp_usage;
 }
 
+uint64_t *get_ibl_hit_counter(void) {
+    return &ibl_hits;
+}
+
+uint64_t *get_ibl_miss_counter(void) {
+    return &ibl_misses;
+}
+
+uint64_t *get_unlinked_exit_counter(void) {
+    return &unlinked_exits_taken;
+}
+
+uint64_t *get_fp_context_load_counter(void) {
+    return &fp_context_loads;
+}
+
+uint64_t *get_native_dispatch_counter(void) {
+    return &native_dispatches;
+}
+
+uint64_t *get_native_dispatch_miss_counter(void) {
+    return &native_dispatch_misses;
+}
+
+uint64_t *get_fast_ecall_counter(void) {
+    return &fast_ecalls;
+}
+
+uint64_t *get_ras_hit_counter(void) {
+    return &ras_hits;
+}
+
+uint64_t *get_ras_miss_counter(void) {
+    return &ras_misses;
+}
+
+uint64_t *get_ras_overflow_counter(void) {
+    return &ras_overflows;
+}
+
 void profile_cache_access(void) {
     count_cache_lookups++;
 }
 
+void profile_decode(bool cached) {
+    count_decodes++;
+    if (cached) count_cached_decodes++;
+}
+
+void profile_code_cache_flush(size_t used) {
+    count_cache_flushes++;
+    if (used > max_code_cache_usage) max_code_cache_usage = used;
+}
+
+void profile_smc_fault(void) {
+    count_smc_faults++;
+}
+
+void profile_smc_invalidation(void) {
+    count_smc_invalidations++;
+}
+
+void profile_baseline_block(void) {
+    count_baseline_blocks++;
+}
+
+void profile_translate_ahead(size_t blocks) {
+    count_ahead_blocks += blocks;
+}
+
+void profile_trace(int blocks) {
+    count_traces++;
+    count_trace_blocks += blocks;
+}
+
+void profile_block_split(bool trace, bool split) {
+    if (!split) return;
+    if (trace) {
+        count_split_traces++;
+    } else {
+        count_split_blocks++;
+    }
+}
+
+void profile_register_promotion(size_t reference_gain) {
+    count_promotions++;
+    count_promoted_references += reference_gain;
+}
+
+void profile_dead_writeback(void) {
+    count_dead_writebacks++;
+}
+
+void profile_block_optimization(int rewritten, int forwarded, int fused, int eliminated) {
+    count_rewritten_instructions += rewritten;
+    count_forwarded_accesses += forwarded;
+    count_fused_branches += fused;
+    count_eliminated_instructions += eliminated;
+}
+
+void profile_emitted_code(int instructions, size_t bytes) {
+    count_translated_instructions += instructions;
+    count_emitted_bytes += bytes;
+}
+
 /**
  * Dump the profiler's cache data.
  */
 void dump_cache_stats(void) {
     log_profile("Logged %lu cache lookups, total block count %lu.\n", count_cache_lookups, get_cache_entry_count());
+    log_profile("Decoded %lu instructions, %lu from the decode cache.\n", count_decodes, count_cached_decodes);
+    log_profile("Inline indirect branch lookup: %lu hits, %lu misses.\n", ibl_hits, ibl_misses);
+    log_profile("Native dispatcher: %lu hits, %lu misses.\n", native_dispatches, native_dispatch_misses);
+    log_profile("Return address stack: %lu hits, %lu misses, %lu overflows.\n", ras_hits, ras_misses, ras_overflows);
+
+    log_profile("Block exits: %lu linked, %lu unlinked; unlinked exits taken %lu times.\n",
+                get_linked_exit_count(), get_exit_count() - get_linked_exit_count(), unlinked_exits_taken);
+
+    size_t used = get_code_cache_usage();
+    if (code_cache_limit != 0) {
+        log_profile("Code cache occupancy: %lu of %lu bytes (%lu%%).\n", used, code_cache_limit,
+                    100 * used / code_cache_limit);
+    } else {
+        log_profile("Code cache occupancy: %lu bytes (unlimited).\n", used);
+    }
+    log_profile("Code cache flushes: %lu, peak occupancy %lu bytes.\n", count_cache_flushes,
+                used > max_code_cache_usage ? used : max_code_cache_usage);
+    log_profile("Blocks per tier: %lu baseline, %lu optimized (traces spanning %lu blocks).\n",
+                count_baseline_blocks, count_traces, count_trace_blocks);
+    log_profile("Blocks translated ahead of execution: %lu, %lu still pending.\n", count_ahead_blocks,
+                get_pending_translation_count());
+    log_profile("Split at the length limit: %lu baseline blocks (limit %d), %lu traces (limit %d).\n",
+                count_split_blocks, get_block_length_limit(false), count_split_traces, get_block_length_limit(true));
+    log_profile("Dynamic register allocation: %lu registers promoted, saving %lu register file references.\n",
+                count_promotions, count_promoted_references);
+    log_profile("Dead register write-backs left out: %lu.\n", count_dead_writebacks);
+    log_profile("Block optimization: %lu instructions rewritten by constant/copy propagation, %lu redundant loads/stores "
+                "eliminated, %lu branches fused with their comparison, %lu dead instructions eliminated.\n",
+                count_rewritten_instructions, count_forwarded_accesses, count_fused_branches,
+                count_eliminated_instructions);
+    size_t per_hundred = count_translated_instructions == 0 ? 0 : 100 * count_emitted_bytes /
+                                                                  count_translated_instructions;
+    log_profile("Emitted code: %lu bytes for %lu guest instructions (%lu.%02lu bytes per instruction).\n",
+                count_emitted_bytes, count_translated_instructions, per_hundred / 100, per_hundred % 100);
+    log_profile("Lazy fp context loads: %lu.\n", fp_context_loads);
+    log_profile("Syscalls issued without context switch: %lu.\n", fast_ecalls);
+    log_profile("Self-modifying code: %lu write faults, %lu blocks invalidated.\n", count_smc_faults,
+                count_smc_invalidations);
+}
+
+/**
+ * Rank the registers by decreasing usage.
+ * @param usage the usage array
+ * @param count the number of registers in usage
+ * @param ranked returns the ranked register indices, count big
+ */
+static void rank_by_usage(const uint64_t *usage, int count, int *ranked) {
+    for (int i = 0; i < count; i++) {
+        ranked[i] = i;
+    }
+    ///insertion sort:
+    int key, j;
+    for (int i = 1; i < count; i++) {
+        key = ranked[i];
+        j = i - 1;
+
+        ///move move elements with index < i && element > i one to the left
+        while (j >= 0 && usage[ranked[j]] < usage[key]) {
+            ranked[j + 1] = ranked[j];
+            j--;
+        }
+
+        ///insert former element i to correct position
+        ranked[j + 1] = key;
+    }
 }
 
 /**
@@ -59,26 +330,7 @@ void dump_register_stats(void) {
 
         //ranked by usage
         int regRanked[N_REG];
-        for (int i = 0; i < N_REG; i++) {
-            regRanked[i] = i;
-        }
-        ///insertion sort:
-        {
-            int key, j;
-            for (int i = 1; i < N_REG; i++) {
-                key = regRanked[i];
-                j = i - 1;
-
-                ///move move elements with index < i && element > i one to the left
-                while (j >= 0 && gp_usage[regRanked[j]] < gp_usage[key]) {
-                    regRanked[j + 1] = regRanked[j];
-                    j--;
-                }
-
-                ///insert former element i to correct position
-                regRanked[j + 1] = key;
-            }
-        }
+        rank_by_usage(gp_usage, N_REG, regRanked);
 
         log_profile("General purpose register hits (ranked):\n");
         log_profile("==============\n");
@@ -102,26 +354,7 @@ void dump_register_stats(void) {
 
         //ranked by usage
         int regRanked[N_FP_REG];
-        for (int i = 0; i < N_FP_REG; i++) {
-            regRanked[i] = i;
-        }
-        ///insertion sort:
-        {
-            int key, j;
-            for (int i = 1; i < N_FP_REG; i++) {
-                key = regRanked[i];
-                j = i - 1;
-
-                ///move move elements with index < i && element > i one to the left
-                while (j >= 0 && fp_usage[regRanked[j]] < fp_usage[key]) {
-                    regRanked[j + 1] = regRanked[j];
-                    j--;
-                }
-
-                ///insert former element i to correct position
-                regRanked[j + 1] = key;
-            }
-        }
+        rank_by_usage(fp_usage, N_FP_REG, regRanked);
 
         log_profile("Floating point register hits (ranked):\n");
         log_profile("==============\n");
@@ -133,3 +366,37 @@ void dump_register_stats(void) {
         }
     }
 }
+
+/**
+ * Write the profiled register ranking to a mapping file, to be loaded by init_map_context() in later runs
+ * (--register-map).
+ * Lists the general purpose and floating point registers that were accessed, by decreasing access frequency.
+ * @param path the path of the mapping file
+ */
+void save_register_ranking(const char *path) {
+    int fd = open(path, O_CREAT | O_TRUNC | O_WRONLY | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        dprintf(2, "Could not write register mapping file %s, error %i\n", path, -fd);
+        return;
+    }
+
+    int gpRanked[N_REG];
+    rank_by_usage(gp_usage, N_REG, gpRanked);
+    int fpRanked[N_FP_REG];
+    rank_by_usage(fp_usage, N_FP_REG, fpRanked);
+
+    dprintf(fd, "# register ranking by access frequency, written by --profile\ngp:");
+    for (int i = 0; i < N_REG && gp_usage[gpRanked[i]] != 0; i++) {
+        //x0 and pc are never mapped
+        if (gpRanked[i] == x0 || gpRanked[i] > x31) continue;
+        dprintf(fd, " %s", gp_to_alias(gpRanked[i]));
+    }
+    dprintf(fd, "\nfp:");
+    for (int i = 0; i < N_FP_REG && fp_usage[fpRanked[i]] != 0; i++) {
+        dprintf(fd, " %s", fp_to_alias(fpRanked[i]));
+    }
+    dprintf(fd, "\n");
+    close(fd);
+
+    log_profile("Register ranking written to %s.\n", path);
+}
@@ -14,10 +14,56 @@ uint64_t  *get_gp_usage_file(void);
 __attribute__((unused))
 uint64_t  *get_fp_usage_file(void);
 
+uint64_t *get_ibl_hit_counter(void);
+
+uint64_t *get_ibl_miss_counter(void);
+
+uint64_t *get_unlinked_exit_counter(void);
+
+uint64_t *get_fp_context_load_counter(void);
+
+uint64_t *get_native_dispatch_counter(void);
+
+uint64_t *get_native_dispatch_miss_counter(void);
+
+uint64_t *get_fast_ecall_counter(void);
+
+uint64_t *get_ras_hit_counter(void);
+
+uint64_t *get_ras_miss_counter(void);
+
+uint64_t *get_ras_overflow_counter(void);
+
 void profile_cache_access(void);
 
+void profile_decode(bool cached);
+
+void profile_code_cache_flush(size_t used);
+
+void profile_smc_fault(void);
+
+void profile_smc_invalidation(void);
+
+void profile_baseline_block(void);
+
+void profile_translate_ahead(size_t blocks);
+
+void profile_trace(int blocks);
+
+void profile_block_split(bool trace, bool split);
+
+void profile_register_promotion(size_t reference_gain);
+
+void profile_dead_writeback(void);
+
+void profile_block_optimization(int rewritten, int forwarded, int fused, int eliminated);
+
+void profile_emitted_code(int instructions, size_t bytes);
+
 void dump_register_stats(void);
 
+void save_register_ranking(const char *path);
+
 void dump_cache_stats(void);
 
 #endif //DYNAMICBINARYTRANSLATORRISCV64_X86_64_PROFILE_H
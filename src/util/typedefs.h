@@ -402,6 +402,11 @@ typedef int64_t t_risc_imm;
 //carry a pointer to the raw instruction in the struct
 typedef uintptr_t t_risc_addr;
 
+//direction a trace continues in behind a branch (see gen/trace.c)
+typedef enum {
+    TRACE_NONE, TRACE_TAKEN, TRACE_NOT_TAKEN
+} t_trace_follow;
+
 typedef struct {
     t_risc_addr addr;
     t_risc_mnem mnem;
@@ -418,6 +423,8 @@ typedef struct {
             uint32_t rounding_mode;
         };
     };
+    //only for BRANCH instructions inside of traces, TRACE_NONE otherwise
+    t_trace_follow trace_follow;
 } t_risc_instr;
 
 /**
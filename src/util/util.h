@@ -12,6 +12,7 @@
 #include <common.h>
 #include <env/flags.h>
 #include <env/exit.h>
+#include <gen/liveness.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -34,6 +35,22 @@ extern "C" {
  * Helper functions to extract FeRegs without handling every mapping case.
  */
 
+/**
+ * Whether the value of the passed RISC-V register may still be read, so it has to be written back from a replacement
+ * register (see liveness.c). Notes skipped write-backs in the profiler's data.
+ * @param reg the RISC-V register held by the replacement register
+ * @return false if the register is overwritten before being read again
+ */
+static inline bool needsWriteback(t_risc_reg reg) {
+    if (reg > x31 || (live_registers >> reg) & 1u) {
+        return true;
+    }
+    if (flag_do_profile) {
+        profile_dead_writeback();
+    }
+    return false;
+}
+
 /**
  * Convert the r_info index to the respective FeReg.
  * @param index the r_info index
@@ -90,7 +107,7 @@ static inline void invalidateReplacement(const register_info *r_info, FeReg repl
                 gp_to_string(currentContent));
 
     //write back to register file
-    if (writeback && currentContent != x0 && currentContent != INVALID_REG) {
+    if (writeback && currentContent != x0 && currentContent != INVALID_REG && needsWriteback(currentContent)) {
         log_context("Writing back %s from %s...\n",
                     gp_to_string(currentContent),
                     reg_x86_to_string(replacement));
@@ -103,15 +120,18 @@ static inline void invalidateReplacement(const register_info *r_info, FeReg repl
 }
 
 /**
- * See above. Invalidates and cleans the oldest replacement register,
- * or does nothing if there is already a free register.
- * In any case, after this call, at least one replacement register will be free to use.
- * One of these free registers is returned for convenience, and can be safely used as scratch.
- * Keep in mind future load calls may overwrite that value again.
+ * Select the replacement register to evict for loading another RISC-V register:
+ * the least recently used one (or some clean register), or in blocks of the optimizing tier
+ * the one referenced again the latest (see select_replacement_by_next_use()).
  * @param r_info containing the dynamic allocation info
- * @return a free replacement register for convenience (may be ignored safely)
+ * @return the index of the selected replacement register
  */
-static inline FeReg invalidateOldest(const register_info *r_info) {
+static inline size_t selectReplacement(const register_info *r_info) {
+    int nextUse = select_replacement_by_next_use(r_info);
+    if (nextUse >= 0) {
+        return nextUse;
+    }
+
     //find minimum of recency (or some clean register with value 0)
     size_t min = 0;
     for (size_t i = 1; i < N_REPLACE; i++) {
@@ -119,6 +139,20 @@ static inline FeReg invalidateOldest(const register_info *r_info) {
             min = i;
         }
     }
+    return min;
+}
+
+/**
+ * See invalidateReplacement(). Invalidates and cleans the oldest replacement register,
+ * or does nothing if there is already a free register.
+ * In any case, after this call, at least one replacement register will be free to use.
+ * One of these free registers is returned for convenience, and can be safely used as scratch.
+ * Keep in mind future load calls may overwrite that value again.
+ * @param r_info containing the dynamic allocation info
+ * @return a free replacement register for convenience (may be ignored safely)
+ */
+static inline FeReg invalidateOldest(const register_info *r_info) {
+    size_t min = selectReplacement(r_info);
 
     //if the oldest replacement contains a RISC-V register, invalidate that before returning
     FeReg oldest = getRegForIndex(min);
@@ -225,13 +259,7 @@ static inline FeReg loadIntoReplacement(const register_info *r_info, const t_ris
     }
 
     //it is not already present, so we load it into the least recently used replacement register (lowest age)
-    //find minimum of recency (or some clean register with value 0)
-    size_t min = 0;
-    for (size_t i = 1; i < N_REPLACE; i++) {
-        if (r_info->replacement_recency[i] < r_info->replacement_recency[min]) {
-            min = i;
-        }
-    }
+    size_t min = selectReplacement(r_info);
 
 
     //write back that register to the file, if there is a valid value present
@@ -239,7 +267,7 @@ static inline FeReg loadIntoReplacement(const register_info *r_info, const t_ris
     FeReg selectedReplacement = getRegForIndex(min);
     log_context("Selected %s for %s (oldest or free).\n", reg_x86_to_string(selectedReplacement),
                 gp_to_string(requested));
-    if (currentlyPresent != x0 && currentlyPresent != INVALID_REG) {
+    if (currentlyPresent != x0 && currentlyPresent != INVALID_REG && needsWriteback(currentlyPresent)) {
         err |= fe_enc64(&current,
                         FE_MOV64mr,
                         FE_MEM_ADDR(r_info->base + 8 * currentlyPresent),
@@ -360,7 +388,8 @@ loadIntoSpecific(const register_info *r_info, t_risc_reg candidate, FeReg destin
         //if it's not mapped, we need to load it into this specific register
         // (if it's dirty, we potentially need to write back)
         if (r_info->replacement_recency[index] != 0 &&
-                (r_info->replacement_content[index] != x0 || r_info->replacement_content[index] != INVALID_REG)) {
+                (r_info->replacement_content[index] != x0 || r_info->replacement_content[index] != INVALID_REG) &&
+                needsWriteback(r_info->replacement_content[index])) {
             //write back if we don't have x0 or invalid in there
             log_context("Writing back %s from %s to free specific replacement...\n",
                         gp_to_string(r_info->replacement_content[index]),
@@ -458,6 +487,22 @@ static inline FeReg getRd(const t_risc_instr *instr, const register_info *r_info
     }
 }
 
+/**
+ * Get the memory operand of the passed load or store, addressing rs1 + imm.
+ * This call may load rs1 from the register file in memory.
+ * Without a base (rs1 is x0, e.g. when the block optimizations folded a constant base, see propagate.c), the immediate
+ * is the absolute address, which fits into a 32-bit displacement.
+ * @param instr the instruction in question
+ * @param r_info current register info
+ * @return the memory operand
+ */
+static inline FeOp getMemOperand(const t_risc_instr *instr, const register_info *r_info) {
+    if (instr->reg_src_1 == x0) {
+        return FE_MEM(0, 0, 0, instr->imm);
+    }
+    return FE_MEM(getRs1(instr, r_info), 0, 0, instr->imm);
+}
+
 /**
  * Get or load the rs1 of the passed instruction, hinted with a hardware register.
  * This call may load the value from the register file in memory.
@@ -4,7 +4,11 @@
 
 #include <gtest/gtest.h>
 #include <cache/cache.h>
+#include <cache/chain.h>
+#include <gen/trace.h>
 #include <util/log.h>
+#include <fadec/fadec-enc.h>
+#include <cstring>
 
 /**
  * Stores some values in the cache and reads them back to verify.
@@ -52,3 +56,105 @@ TEST(CodeCache, ResizesTableCorrectly) {
 
     printf("Checked...\n");
 }
+
+/**
+ * Clears the table as done by a code cache flush and checks that no stale entries remain, including the tlb.
+ */
+TEST(CodeCache, ClearsTableCorrectly) {
+    //initialize the cache
+    init_hash_table();
+
+    for (size_t i = 1; i <= 100; i++) {
+        set_cache_entry((t_risc_addr) (i << 3u), (t_cache_loc) (i << 4u));
+    }
+
+    clear_cache_table();
+    EXPECT_EQ(0u, get_cache_entry_count());
+
+    for (size_t i = 1; i <= 100; i++) {
+        ASSERT_EQ(UNSEEN_CODE, lookup_cache_entry((t_risc_addr) (i << 3u)));
+    }
+
+    //the table is still usable afterwards
+    set_cache_entry((t_risc_addr) 8, (t_cache_loc) 0x80);
+    EXPECT_EQ((t_cache_loc) 0x80, lookup_cache_entry((t_risc_addr) 8));
+}
+
+/**
+ * Removes the first of several entries colliding in the same slot and checks that the others are still found.
+ */
+TEST(CodeCache, RemovesEntryCorrectly) {
+    //initialize the cache
+    init_hash_table();
+
+    //all hash to the same slot of the default sized table
+    for (size_t i = 0; i < 3; i++) {
+        set_cache_entry((t_risc_addr) (4 + (i << 14u)), (t_cache_loc) (0x100 * (i + 1)));
+    }
+
+    remove_cache_entry(4);
+    EXPECT_EQ(2u, get_cache_entry_count());
+    EXPECT_EQ(UNSEEN_CODE, lookup_cache_entry(4));
+    EXPECT_EQ((t_cache_loc) 0x200, lookup_cache_entry((t_risc_addr) (4 + (1u << 14u))));
+    EXPECT_EQ((t_cache_loc) 0x300, lookup_cache_entry((t_risc_addr) (4 + (2u << 14u))));
+}
+
+/**
+ * Registers two unlinked exits to the same target and checks that both get linked once the target is cached.
+ */
+TEST(CodeCache, LinksAllExitsToTarget) {
+    init_hash_table();
+    init_exit_table();
+
+    static uint8_t code[64];
+    static uint8_t target_block[16];
+    uint8_t *sites[2] = {code, code + 16};
+
+    for (uint8_t *site : sites) {
+        uint8_t *pos = site;
+        ASSERT_EQ(0, fe_enc64(&pos, FE_JMP | FE_JMPL, (intptr_t) pos));
+        register_exit(0x1000, site, pos, FE_JMP, false);
+    }
+    EXPECT_EQ(2u, get_exit_count());
+    EXPECT_EQ(0u, get_linked_exit_count());
+
+    set_cache_entry(0x1000, (t_cache_loc) target_block);
+    EXPECT_EQ(2u, get_linked_exit_count());
+
+    for (uint8_t *site : sites) {
+        int32_t rel;
+        memcpy(&rel, site + 1, sizeof(rel));
+        EXPECT_EQ(target_block, site + 5 + rel);
+    }
+
+    //replacing the block (e.g. by a trace) redirects the linked exits
+    static uint8_t replacement_block[16];
+    set_cache_entry(0x1000, (t_cache_loc) replacement_block);
+    EXPECT_EQ(2u, get_linked_exit_count());
+
+    for (uint8_t *site : sites) {
+        int32_t rel;
+        memcpy(&rel, site + 1, sizeof(rel));
+        EXPECT_EQ(replacement_block, site + 5 + rel);
+    }
+}
+
+/**
+ * Counts down a block's execution counter as the generated code does and checks the derived execution count.
+ */
+TEST(CodeCache, CountsBlockExecutions) {
+    clear_block_counters();
+
+    int64_t *counter = get_block_counter(0x2000);
+    ASSERT_NE(nullptr, counter);
+    EXPECT_EQ(0u, get_execution_count(0x2000));
+    EXPECT_EQ(0u, get_execution_count(0x3000));
+
+    *counter -= 5;
+    EXPECT_EQ(5u, get_execution_count(0x2000));
+
+    //retranslating the block restarts counting in the same counter
+    EXPECT_EQ(counter, get_block_counter(0x2000));
+    EXPECT_EQ(0u, get_execution_count(0x2000));
+    EXPECT_EQ(1u, get_block_counter_count());
+}
@@ -0,0 +1,69 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <vector>
+#include <parser/parser.h>
+#include "test_programs.h"
+
+#define DECODE_ROUNDS 10
+//instructions decoded repeatedly, fitting into the decode cache
+#define DECODE_WINDOW 4096
+
+/**
+ * Decodes the .text of the bundled test binaries.
+ */
+class Decode : public ProgramText<> {
+};
+
+/**
+ * Checks that the decode cache yields the same results as decoding, also after the instruction at an address changed.
+ */
+TEST_F(Decode, CacheMatchesDecoder) {
+    uint32_t memory[1];
+    for (int round = 0; round < 2; round++) {
+        for (uint32_t raw : text) {
+            memory[0] = raw;
+            t_risc_instr decoded{};
+            t_risc_instr cached{};
+            decoded.addr = cached.addr = (t_risc_addr) memory;
+            int32_t decoded_result = parse_instruction(&decoded);
+            int32_t cached_result = parse_instruction_cached(&cached);
+
+            ASSERT_EQ(decoded_result, cached_result) << std::hex << raw;
+            ASSERT_EQ(decoded.mnem, cached.mnem) << std::hex << raw;
+            ASSERT_EQ(decoded.optype, cached.optype) << std::hex << raw;
+            ASSERT_EQ(decoded.reg_dest, cached.reg_dest) << std::hex << raw;
+            ASSERT_EQ(decoded.reg_src_1, cached.reg_src_1) << std::hex << raw;
+            ASSERT_EQ(decoded.reg_src_2, cached.reg_src_2) << std::hex << raw;
+            ASSERT_EQ(decoded.imm, cached.imm) << std::hex << raw;
+        }
+    }
+}
+
+/**
+ * Micro-benchmark of the decode throughput: decoding the instructions at their place in memory, and decoding
+ * a window of them repeatedly like the translator does (e.g. jump targets), with and without the decode cache.
+ * Disabled by default, run with --gtest_also_run_disabled_tests.
+ */
+TEST_F(Decode, DISABLED_Throughput) {
+    auto run = [&](int32_t (*parse)(t_risc_instr *), size_t count) {
+        auto begin = std::chrono::steady_clock::now();
+        for (int round = 0; round < DECODE_ROUNDS; round++) {
+            for (size_t i = 0; i < count; i++) {
+                instrs[i].addr = (t_risc_addr) &text[i];
+                parse(&instrs[i]);
+            }
+        }
+        auto end = std::chrono::steady_clock::now();
+        //integral, the minilibc linked into the tests formats no floating point numbers
+        return (size_t) (DECODE_ROUNDS * count / std::chrono::duration<double>(end - begin).count() / 1e3);
+    };
+
+    size_t window = std::min(text.size(), (size_t) DECODE_WINDOW);
+    size_t all = run(parse_instruction, text.size());
+    size_t repeated = run(parse_instruction, window);
+    size_t cached = run(parse_instruction_cached, window);
+
+    printf("Decode throughput over %lu instructions: %lu k instructions/s\n", text.size(), all);
+    printf("Repeated decoding of %lu instructions: %lu k instructions/s, with decode cache %lu k instructions/s\n",
+           window, repeated, cached);
+}
@@ -0,0 +1,91 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <util/typedefs.h>
+#include <main/context.h>
+#include <gen/translate.h>
+#include <runtime/register.h>
+#include <env/flags.h>
+
+static const t_risc_reg NO_REG = (t_risc_reg) INVALID_REG;
+
+#define LOOP_ADDR 0x1000
+#define ROUNDS 100000
+
+/**
+ * Runs a loop whose single block exits to itself without being chained (--optimize=no-chain),
+ * so every iteration is a round trip through the dispatcher.
+ */
+class Dispatch : public ::testing::Test {
+protected:
+    static context_info *c_info;
+    static t_cache_loc loop;
+
+public:
+    static void SetUpTestSuite() {
+        //the block is neither chained nor looked at by the liveness analysis (its guest code is not in memory)
+        bool chain = flag_translate_opt_chain;
+        bool liveness = flag_translate_opt_liveness;
+        flag_translate_opt_chain = false;
+        flag_translate_opt_liveness = false;
+
+        init_hash_table();
+        c_info = init_map_context(false);
+
+        //addi t0, t0, -1; bnez t0, -4
+        t_risc_instr block[] = {
+                {LOOP_ADDR, ADDI, IMMEDIATE, x5, NO_REG, x5, {{-1}}, TRACE_NONE},
+                {LOOP_ADDR + 4, BNE, BRANCH, x5, x0, NO_REG, {{-4}}, TRACE_NONE}
+        };
+        loop = translate_block_instructions(block, 2, c_info);
+        set_cache_entry(LOOP_ADDR, loop);
+
+        flag_translate_opt_chain = chain;
+        flag_translate_opt_liveness = liveness;
+    }
+};
+
+context_info *Dispatch::c_info = nullptr;
+t_cache_loc Dispatch::loop = nullptr;
+
+/**
+ * Checks that the native dispatcher keeps executing translated blocks and returns once it reaches an unseen one.
+ */
+TEST_F(Dispatch, FollowsBlocksUntilUnseen) {
+    ASSERT_NE(nullptr, c_info->load_dispatch_save_context);
+
+    set_value(x5, 10);
+    set_value(pc, LOOP_ADDR);
+    dispatch_in_guest_context(c_info, loop);
+
+    EXPECT_EQ(0u, get_value(x5));
+    EXPECT_EQ((t_risc_reg_val) LOOP_ADDR + 8, get_value(pc));
+}
+
+/**
+ * Micro-benchmark of a dispatcher round trip: the main loop (cache lookup and full context switch per block)
+ * against the native dispatcher.
+ * Disabled by default, run with --gtest_also_run_disabled_tests.
+ */
+TEST_F(Dispatch, DISABLED_RoundTripCost) {
+    set_value(x5, ROUNDS);
+    set_value(pc, LOOP_ADDR);
+    auto begin = std::chrono::steady_clock::now();
+    while (get_value(pc) == LOOP_ADDR) {
+        execute_in_guest_context(c_info, lookup_cache_entry(get_value(pc)));
+    }
+    auto end = std::chrono::steady_clock::now();
+    //integral, the minilibc linked into the tests formats no floating point numbers
+    auto main_loop = (size_t) (std::chrono::duration<double, std::pico>(end - begin).count() / ROUNDS);
+    EXPECT_EQ(0u, get_value(x5));
+
+    set_value(x5, ROUNDS);
+    set_value(pc, LOOP_ADDR);
+    begin = std::chrono::steady_clock::now();
+    dispatch_in_guest_context(c_info, loop);
+    end = std::chrono::steady_clock::now();
+    auto native = (size_t) (std::chrono::duration<double, std::pico>(end - begin).count() / ROUNDS);
+    EXPECT_EQ(0u, get_value(x5));
+    EXPECT_EQ((t_risc_reg_val) LOOP_ADDR + 8, get_value(pc));
+
+    printf("Dispatcher round trip: main loop %lu ps, native dispatcher %lu ps\n", main_loop, native);
+}
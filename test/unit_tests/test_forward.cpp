@@ -0,0 +1,97 @@
+#include <gtest/gtest.h>
+#include <gen/forward.h>
+
+static const t_risc_reg NO_REG = (t_risc_reg) INVALID_REG;
+
+/**
+ * Checks that loads of known locations read the register holding their content instead.
+ */
+TEST(Forward, ReplacesLoads) {
+    t_risc_instr block[] = {
+            {0x1000, LD, IMMEDIATE, x2, NO_REG, x10, {{8}}, TRACE_NONE},
+            {0x1004, LD, IMMEDIATE, x2, NO_REG, x11, {{8}}, TRACE_NONE},
+            {0x1008, SW, STORE, x2, x12, NO_REG, {{16}}, TRACE_NONE},
+            {0x100c, LW, IMMEDIATE, x2, NO_REG, x13, {{16}}, TRACE_NONE},
+            {0x1010, SB, STORE, x8, x14, NO_REG, {{-1}}, TRACE_NONE},
+            {0x1014, LBU, IMMEDIATE, x8, NO_REG, x15, {{-1}}, TRACE_NONE},
+            {0x1018, LB, IMMEDIATE, x8, NO_REG, x16, {{-1}}, TRACE_NONE},
+            {0x101c, SD, STORE, x2, x17, NO_REG, {{24}}, TRACE_NONE},
+            {0x1020, LD, IMMEDIATE, x2, NO_REG, x17, {{24}}, TRACE_NONE},
+            {0x1024, JALR, JUMP, x1, NO_REG, x0, {{0}}, TRACE_NONE}
+    };
+    EXPECT_EQ(4, forward_memory_values(block, 10));
+
+    EXPECT_EQ(LD, block[0].mnem);
+    EXPECT_EQ(ADDI, block[1].mnem);
+    EXPECT_EQ(IMMEDIATE, block[1].optype);
+    EXPECT_EQ(x10, block[1].reg_src_1);
+    EXPECT_EQ(0, block[1].imm);
+    EXPECT_EQ(ADDIW, block[3].mnem);
+    EXPECT_EQ(x12, block[3].reg_src_1);
+    EXPECT_EQ(ANDI, block[5].mnem);
+    EXPECT_EQ(x14, block[5].reg_src_1);
+    EXPECT_EQ(0xff, block[5].imm);
+    //sign extending a byte needs more than one instruction
+    EXPECT_EQ(LB, block[6].mnem);
+    //the register still holds the stored value
+    EXPECT_EQ(SILENT_NOP, block[8].mnem);
+}
+
+/**
+ * Checks that the known content of a location is forgotten when the location may be overwritten, or the registers
+ * addressing it or holding its content change.
+ */
+TEST(Forward, ForgetsOverwrittenLocations) {
+    t_risc_instr block[] = {
+            {0x1000, LD, IMMEDIATE, x2, NO_REG, x10, {{8}}, TRACE_NONE},
+            {0x1004, LW, IMMEDIATE, x2, NO_REG, x11, {{0}}, TRACE_NONE},
+            {0x1008, SW, STORE, x2, x12, NO_REG, {{12}}, TRACE_NONE},
+            {0x100c, LD, IMMEDIATE, x2, NO_REG, x13, {{8}}, TRACE_NONE},
+            {0x1010, LW, IMMEDIATE, x2, NO_REG, x14, {{0}}, TRACE_NONE},
+            {0x1014, SD, STORE, x8, x12, NO_REG, {{64}}, TRACE_NONE},
+            {0x1018, LW, IMMEDIATE, x2, NO_REG, x15, {{0}}, TRACE_NONE},
+            {0x101c, ADDI, IMMEDIATE, x15, NO_REG, x15, {{1}}, TRACE_NONE},
+            {0x1020, LW, IMMEDIATE, x2, NO_REG, x16, {{0}}, TRACE_NONE},
+            {0x1024, ADDI, IMMEDIATE, x2, NO_REG, x2, {{-16}}, TRACE_NONE},
+            {0x1028, LW, IMMEDIATE, x2, NO_REG, x17, {{0}}, TRACE_NONE},
+            {0x102c, ECALL, SYSTEM, NO_REG, NO_REG, NO_REG, {{0}}, TRACE_NONE},
+            {0x1030, LW, IMMEDIATE, x2, NO_REG, x18, {{0}}, TRACE_NONE},
+            {0x1034, JALR, JUMP, x1, NO_REG, x0, {{0}}, TRACE_NONE}
+    };
+    EXPECT_EQ(1, forward_memory_values(block, 14));
+
+    //the store overlaps the upper half of the doubleword, but not the word below it
+    EXPECT_EQ(LD, block[3].mnem);
+    EXPECT_EQ(ADDI, block[4].mnem);
+    EXPECT_EQ(x11, block[4].reg_src_1);
+    //a store through another base register may alias
+    EXPECT_EQ(LW, block[6].mnem);
+    //the register holding the content changed
+    EXPECT_EQ(LW, block[8].mnem);
+    //the base register changed
+    EXPECT_EQ(LW, block[10].mnem);
+    //the syscall may write memory
+    EXPECT_EQ(LW, block[12].mnem);
+}
+
+/**
+ * Checks that storing an unchanged register to the location it was stored to before is dropped.
+ */
+TEST(Forward, DropsRedundantStores) {
+    t_risc_instr block[] = {
+            {0x1000, SD, STORE, x2, x10, NO_REG, {{8}}, TRACE_NONE},
+            {0x1004, LW, IMMEDIATE, x2, NO_REG, x11, {{8}}, TRACE_NONE},
+            {0x1008, SD, STORE, x2, x10, NO_REG, {{8}}, TRACE_NONE},
+            {0x100c, SW, STORE, x2, x10, NO_REG, {{8}}, TRACE_NONE},
+            {0x1010, LD, IMMEDIATE, x2, NO_REG, x12, {{16}}, TRACE_NONE},
+            {0x1014, SD, STORE, x2, x12, NO_REG, {{16}}, TRACE_NONE},
+            {0x1018, JALR, JUMP, x1, NO_REG, x0, {{0}}, TRACE_NONE}
+    };
+    EXPECT_EQ(1, forward_memory_values(block, 7));
+
+    EXPECT_EQ(SILENT_NOP, block[2].mnem);
+    //a store of another width is kept
+    EXPECT_EQ(SW, block[3].mnem);
+    //storing what was loaded is kept, the location may not be writable
+    EXPECT_EQ(SD, block[5].mnem);
+}
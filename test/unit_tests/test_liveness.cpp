@@ -0,0 +1,47 @@
+#include <gtest/gtest.h>
+#include <gen/liveness.h>
+#include <util/log.h>
+
+static const t_risc_reg NO_REG = (t_risc_reg) INVALID_REG;
+
+static bool contains(t_reg_set set, t_risc_reg reg) {
+    return (set >> reg) & 1u;
+}
+
+/**
+ * Checks that a register overwritten before being read again is dead in between, but live everywhere else.
+ */
+TEST(Liveness, OverwrittenRegisterIsDead) {
+    t_risc_instr block[] = {
+            {0x1000, ADDI, IMMEDIATE, x10, NO_REG, x5, {{1}}, TRACE_NONE},
+            {0x1004, ADD, REG_REG, x5, x11, x11, {{0}}, TRACE_NONE},
+            {0x1008, ADDI, IMMEDIATE, x0, NO_REG, x5, {{5}}, TRACE_NONE},
+            {0x100c, ADD, REG_REG, x5, x12, x12, {{0}}, TRACE_NONE},
+            {0x1010, JALR, JUMP, x1, NO_REG, x0, {{0}}, TRACE_NONE}
+    };
+    t_reg_set live[5];
+    analyze_liveness(block, 5, live);
+
+    //the value of x5 computed by the first instruction is dead once read by the second
+    EXPECT_TRUE(contains(live[1], x5));
+    EXPECT_FALSE(contains(live[2], x5));
+    EXPECT_TRUE(contains(live[2], x11));
+    EXPECT_TRUE(contains(live[3], x5));
+
+    //everything may be read behind an indirect jump
+    EXPECT_EQ(ALL_LIVE, live[4]);
+}
+
+/**
+ * Checks the summary of a block's entry: registers written before being read are dead.
+ */
+TEST(Liveness, SummarizesBlockEntry) {
+    alignas(16) static uint32_t memory[] = {
+            0x00038537, //lui a0,0x38
+            0xab75051b, //addiw a0,a0,-1353
+            0x00000073  //ecall
+    };
+
+    t_reg_set killed = get_killed_on_entry((t_risc_addr) memory);
+    EXPECT_EQ((t_reg_set) 1 << x10, killed);
+}
@@ -0,0 +1,278 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <gen/optimize.h>
+#include <gen/instr/patterns.h>
+#include <parser/parser.h>
+#include "test_programs.h"
+
+//instructions per block matched from the bundled binaries
+#define MATCH_BLOCK_LENGTH 32
+#define MATCH_ROUNDS 20
+
+static const t_risc_reg NO_REG = (t_risc_reg) INVALID_REG;
+
+static int64_t get_field(const t_risc_instr &instr, unsigned char field) {
+    switch (field) {
+        case F_RS1:
+            return instr.reg_src_1;
+        case F_RS2:
+            return instr.reg_src_2;
+        case F_RD:
+            return instr.reg_dest;
+        default:
+            return instr.imm;
+    }
+}
+
+static bool satisfies(const t_risc_instr *start, int k, unsigned char field, const pattern_constraint &c) {
+    switch (c.match) {
+        case MATCH_ANY:
+            return true;
+        case MATCH_VALUE:
+            return get_field(start[k], field) == c.value;
+        case MATCH_FIELD:
+            return get_field(start[k], field) == get_field(start[c.pos], c.field);
+        default:
+            return get_field(start[k], field) != get_field(start[c.pos], c.field);
+    }
+}
+
+/**
+ * Reference matcher: tries every pattern in priority order at every position, as the matcher did before the trie.
+ */
+static void match_naive(const pattern *table, t_risc_instr *block, int len) {
+    for (int i = 0; table[i].len > 0; i++) {
+        const pattern &p = table[i];
+        for (int j = 0; j < len - p.len; j++) {
+            bool match = true;
+            for (int k = 0; k < p.len && match; k++) {
+                const pattern_element &e = p.elements[k];
+                match = block[j + k].mnem == e.mnem && satisfies(&block[j], k, F_RS1, e.rs1) &&
+                        satisfies(&block[j], k, F_RS2, e.rs2) && satisfies(&block[j], k, F_RD, e.rd) &&
+                        satisfies(&block[j], k, F_IMM, e.imm);
+            }
+            if (match) {
+                block[j].mnem = PATTERN_EMIT;
+                block[j].optype = (t_risc_optype) i;
+                j += p.len - 1;
+            }
+        }
+    }
+}
+
+/**
+ * Builds a pattern table with the patterns repeated the passed number of times, for the benchmark.
+ */
+static std::vector<pattern> repeat_patterns(int times) {
+    std::vector<pattern> table;
+    for (int t = 0; t < times; t++) {
+        for (int i = 0; patterns[i].len > 0; i++) {
+            table.push_back(patterns[i]);
+        }
+    }
+    table.push_back({nullptr, 0, nullptr});
+    return table;
+}
+
+/**
+ * Matches the patterns on blocks of the .text of the bundled test binaries.
+ */
+class Optimize : public ProgramText<> {
+};
+
+/**
+ * Checks that the compiled matcher takes the same matches as trying the patterns one by one.
+ */
+TEST_F(Optimize, MatchesNaiveMatcher) {
+    for (int times : {1, 2}) {
+        std::vector<pattern> table = repeat_patterns(times);
+        pattern_matcher *matcher = compile_patterns(table.data());
+        for (size_t start = 0; start < instrs.size(); start += MATCH_BLOCK_LENGTH / 2) {
+            int len = (int) std::min((size_t) MATCH_BLOCK_LENGTH, instrs.size() - start);
+            std::vector<t_risc_instr> expected(&instrs[start], &instrs[start] + len);
+            std::vector<t_risc_instr> actual = expected;
+            match_naive(table.data(), expected.data(), len);
+            match_patterns(matcher, actual.data(), len);
+
+            for (int i = 0; i < len; i++) {
+                ASSERT_EQ(expected[i].mnem, actual[i].mnem) << "at " << start + i;
+                ASSERT_EQ(expected[i].optype, actual[i].optype) << "at " << start + i;
+            }
+        }
+    }
+}
+
+/**
+ * Micro-benchmark of the pattern matching time per block, with the current patterns and 2x and 5x as many.
+ * Disabled by default, run with --gtest_also_run_disabled_tests.
+ */
+TEST_F(Optimize, DISABLED_Throughput) {
+    for (int times : {1, 2, 5}) {
+        std::vector<pattern> table = repeat_patterns(times);
+        pattern_matcher *matcher = compile_patterns(table.data());
+        std::vector<t_risc_instr> block(MATCH_BLOCK_LENGTH);
+
+        auto run = [&](auto match) {
+            size_t blocks = 0;
+            auto begin = std::chrono::steady_clock::now();
+            for (int round = 0; round < MATCH_ROUNDS; round++) {
+                for (size_t start = 0; start + MATCH_BLOCK_LENGTH <= instrs.size(); start += MATCH_BLOCK_LENGTH) {
+                    std::copy(&instrs[start], &instrs[start] + MATCH_BLOCK_LENGTH, block.begin());
+                    match(block.data());
+                    blocks++;
+                }
+            }
+            auto end = std::chrono::steady_clock::now();
+            //integral, the minilibc linked into the tests formats no floating point numbers
+            return (size_t) (std::chrono::duration<double, std::nano>(end - begin).count() / blocks);
+        };
+
+        size_t naive = run([&](t_risc_instr *b) { match_naive(table.data(), b, MATCH_BLOCK_LENGTH); });
+        size_t compiled = run([&](t_risc_instr *b) { match_patterns(matcher, b, MATCH_BLOCK_LENGTH); });
+        printf("%lu patterns: %lu ns per block of %d instructions, %lu ns trying the patterns one by one\n",
+               table.size() - 1, compiled, MATCH_BLOCK_LENGTH, naive);
+    }
+}
+
+/**
+ * Checks the constraints of a pattern and that an earlier pattern takes precedence over overlapping later ones.
+ */
+TEST(PatternMatcher, ConstraintsAndPriority) {
+    const pattern_element not_same[] = {
+            {ADDI, P_ANY, P_ANY, P_ANY, P_IS(1)},
+            {ADD, P_SAME(0, F_RD), P_NOT_SAME(0, F_RD), P_SAME(1, F_RS2), P_ANY}
+    };
+    const pattern_element single[] = {
+            {ADD, P_ANY, P_ANY, P_ANY, P_ANY}
+    };
+    const pattern_element any[] = {
+            {ADDI, P_ANY, P_ANY, P_ANY, P_ANY},
+            {ADD, P_ANY, P_ANY, P_ANY, P_ANY}
+    };
+    const pattern table[] = {
+            {not_same, 2, nullptr},
+            {single, 1, nullptr},
+            {any, 2, nullptr},
+            {nullptr, 0, nullptr}
+    };
+    pattern_matcher *matcher = compile_patterns(table);
+
+    t_risc_instr block[] = {
+            {0x1000, ADDI, IMMEDIATE, x10, NO_REG, x5, {{1}}, TRACE_NONE},
+            {0x1004, ADD, REG_REG, x5, x6, x6, {{0}}, TRACE_NONE},
+            {0x1008, ADDI, IMMEDIATE, x10, NO_REG, x5, {{1}}, TRACE_NONE},
+            {0x100c, ADD, REG_REG, x5, x5, x5, {{0}}, TRACE_NONE},
+            {0x1010, ADD, REG_REG, x5, x6, x7, {{0}}, TRACE_NONE},
+            {0x1014, JALR, JUMP, x1, NO_REG, x0, {{0}}, TRACE_NONE}
+    };
+    match_patterns(matcher, block, 6);
+
+    EXPECT_EQ(PATTERN_EMIT, block[0].mnem);
+    EXPECT_EQ(0, block[0].optype);
+    //later patterns may start within an earlier match, its instructions are skipped when translating it
+    EXPECT_EQ(PATTERN_EMIT, block[1].mnem);
+    EXPECT_EQ(1, block[1].optype);
+    //rs2 is the same register as rd of the ADDI, and the last pattern would include the start of a match before it
+    EXPECT_EQ(ADDI, block[2].mnem);
+    EXPECT_EQ(PATTERN_EMIT, block[3].mnem);
+    EXPECT_EQ(1, block[3].optype);
+    EXPECT_EQ(PATTERN_EMIT, block[4].mnem);
+    EXPECT_EQ(1, block[4].optype);
+    //patterns never include the last instruction
+    EXPECT_EQ(JALR, block[5].mnem);
+}
+
+static bool compare(t_risc_mnem mnem, uint64_t a, uint64_t b) {
+    switch (mnem) {
+        case SLT:
+        case SLTI:
+        case BLT:
+            return (int64_t) a < (int64_t) b;
+        case SLTU:
+        case SLTIU:
+        case BLTU:
+            return a < b;
+        case BGE:
+            return (int64_t) a >= (int64_t) b;
+        case BGEU:
+            return a >= b;
+        case BEQ:
+            return a == b;
+        default:
+            return a != b;
+    }
+}
+
+/**
+ * Checks that the fused branches are taken exactly when the original ones are, for each comparison and branch.
+ */
+TEST(CompareBranch, MatchesUnfused) {
+    const t_risc_instr compares[] = {
+            {0x1000, SLT, REG_REG, x10, x11, x5, {{0}}, TRACE_NONE},
+            {0x1000, SLTU, REG_REG, x10, x11, x5, {{0}}, TRACE_NONE},
+            {0x1000, SLTU, REG_REG, x0, x11, x5, {{0}}, TRACE_NONE},
+            {0x1000, SLTI, IMMEDIATE, x10, NO_REG, x5, {{0}}, TRACE_NONE},
+            {0x1000, SLTIU, IMMEDIATE, x10, NO_REG, x5, {{1}}, TRACE_NONE}
+    };
+    const uint64_t values[] = {0, 1, 2, (uint64_t) -1, (uint64_t) -2, 1ul << 63, (1ul << 63) - 1};
+
+    for (const t_risc_instr &c : compares) {
+        for (t_risc_mnem mnem : {BEQ, BNE}) {
+            for (bool swapped : {false, true}) {
+                t_risc_instr block[] = {
+                        c,
+                        {0x1004, mnem, BRANCH, swapped ? x0 : x5, swapped ? x5 : x0, NO_REG, {{0x40}}, TRACE_NONE}
+                };
+                ASSERT_EQ(1, fuse_compare_branches(block, 2)) << mnem_to_string(c.mnem);
+                EXPECT_EQ(c.mnem, block[0].mnem);
+
+                for (uint64_t a : values) {
+                    for (uint64_t b : values) {
+                        uint64_t x[N_REG] = {0};
+                        x[x10] = a;
+                        x[x11] = b;
+                        bool result = compare(c.mnem, x[c.reg_src_1], c.optype == REG_REG ? x[c.reg_src_2] : c.imm);
+                        bool taken = mnem == BNE ? result : !result;
+                        EXPECT_EQ(taken, compare(block[1].mnem, x[block[1].reg_src_1], x[block[1].reg_src_2]))
+                                            << mnem_to_string(c.mnem) << " " << mnem_to_string(mnem) << " " << a << " "
+                                            << b;
+                    }
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Checks that branches are only fused while the operands of the comparison are unchanged.
+ */
+TEST(CompareBranch, OperandsUnchanged) {
+    t_risc_instr block[] = {
+            {0x1000, SLT, REG_REG, x10, x11, x5, {{0}}, TRACE_NONE},
+            {0x1004, ADDI, IMMEDIATE, x12, NO_REG, x12, {{1}}, TRACE_NONE},
+            {0x1008, SD, STORE, x2, x5, NO_REG, {{8}}, TRACE_NONE},
+            {0x100c, BNE, BRANCH, x5, x0, NO_REG, {{0x40}}, TRACE_NONE},
+            {0x1010, SLTU, REG_REG, x10, x11, x5, {{0}}, TRACE_NONE},
+            {0x1014, ADDI, IMMEDIATE, x11, NO_REG, x11, {{1}}, TRACE_NONE},
+            {0x1018, BEQ, BRANCH, x5, x0, NO_REG, {{0x40}}, TRACE_NONE},
+            {0x101c, SLT, REG_REG, x10, x5, x5, {{0}}, TRACE_NONE},
+            {0x1020, BNE, BRANCH, x5, x0, NO_REG, {{0x40}}, TRACE_NONE},
+            {0x1024, SLTI, IMMEDIATE, x10, NO_REG, x5, {{4}}, TRACE_NONE},
+            {0x1028, BNE, BRANCH, x5, x0, NO_REG, {{0x40}}, TRACE_NONE}
+    };
+    EXPECT_EQ(1, fuse_compare_branches(block, 11));
+
+    //unrelated instructions in between, the result may still be read elsewhere
+    EXPECT_EQ(BLT, block[3].mnem);
+    EXPECT_EQ(x10, block[3].reg_src_1);
+    EXPECT_EQ(x11, block[3].reg_src_2);
+    EXPECT_EQ(0x40, block[3].imm);
+    //an operand is overwritten in between
+    EXPECT_EQ(BEQ, block[6].mnem);
+    //the comparison overwrites its own operand
+    EXPECT_EQ(BNE, block[8].mnem);
+    //no branch compares against the immediate
+    EXPECT_EQ(BNE, block[10].mnem);
+}
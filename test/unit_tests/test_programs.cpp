@@ -0,0 +1,30 @@
+#include "test_programs.h"
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <elf.h>
+
+/**
+ * Read the .text section of the given bundled test binary.
+ * @param name the path of the binary within test/test_programs
+ * @return the raw instructions, empty if the binary could not be read
+ */
+std::vector<uint32_t> read_text(const char *name) {
+    std::ifstream file(std::string(TEST_PROGRAMS_DIR "/") + name, std::ios::binary);
+    std::vector<char> elf((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    std::vector<uint32_t> text;
+    if (elf.size() < sizeof(Elf64_Ehdr)) {
+        return text;
+    }
+
+    auto *header = (const Elf64_Ehdr *) elf.data();
+    auto *sections = (const Elf64_Shdr *) (elf.data() + header->e_shoff);
+    const char *names = elf.data() + sections[header->e_shstrndx].sh_offset;
+    for (int i = 0; i < header->e_shnum; i++) {
+        if (strcmp(names + sections[i].sh_name, ".text") == 0) {
+            auto *begin = (const uint32_t *) (elf.data() + sections[i].sh_offset);
+            text.assign(begin, begin + sections[i].sh_size / 4);
+        }
+    }
+    return text;
+}
@@ -0,0 +1,53 @@
+#ifndef DYNAMICBINARYTRANSLATORRISCV64_X86_64_TEST_PROGRAMS_H
+#define DYNAMICBINARYTRANSLATORRISCV64_X86_64_TEST_PROGRAMS_H
+
+#include <gtest/gtest.h>
+#include <vector>
+#include <parser/parser.h>
+#include <env/flags.h>
+
+std::vector<uint32_t> read_text(const char *name);
+
+/**
+ * Fixture over the .text of the bundled test binaries (which do not use compressed instructions), parsed at its
+ * place in memory. Data in between the code may decode to unimplemented floating point instructions, which only warn
+ * with --fail-silently, so that is set for the duration of the test.
+ * Tests are skipped if the binaries are not available.
+ * @tparam Base the fixture to extend
+ */
+template<typename Base = ::testing::Test>
+class ProgramText : public Base {
+protected:
+    std::vector<uint32_t> text;
+    std::vector<t_risc_instr> instrs;
+    bool fail_silently = false;
+
+    void SetUp() override {
+        Base::SetUp();
+        for (const char *name : {"sort_example/sort", "benchmarks/mandelbrot-riscv", "add_test/add_test",
+                                 "arithmetic_test/arithm"}) {
+            std::vector<uint32_t> binary = read_text(name);
+            text.insert(text.end(), binary.begin(), binary.end());
+        }
+        if (text.empty()) {
+            GTEST_SKIP();
+        }
+        fail_silently = flag_fail_silently;
+        flag_fail_silently = true;
+
+        instrs.resize(text.size());
+        for (size_t i = 0; i < text.size(); i++) {
+            instrs[i].addr = (t_risc_addr) &text[i];
+            parse_instruction(&instrs[i]);
+        }
+    }
+
+    void TearDown() override {
+        if (!text.empty()) {
+            flag_fail_silently = fail_silently;
+        }
+        Base::TearDown();
+    }
+};
+
+#endif //DYNAMICBINARYTRANSLATORRISCV64_X86_64_TEST_PROGRAMS_H
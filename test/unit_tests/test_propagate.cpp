@@ -0,0 +1,398 @@
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+#include <gen/propagate.h>
+#include <gen/liveness.h>
+#include <gen/optimize.h>
+#include <gen/translate.h>
+#include <main/context.h>
+#include <parser/parser.h>
+#include <env/flags.h>
+#include "test_programs.h"
+
+static const t_risc_reg NO_REG = (t_risc_reg) INVALID_REG;
+
+//longest run of straight-line instructions optimized as one block
+#define MAX_RUN_LENGTH 32
+
+/**
+ * Execute the passed integer computation or memory access on the register values.
+ * Memory accesses are recorded instead of performed, loads yield a value derived from their address.
+ * @param accesses returns the addresses accessed, and the values stored
+ * @return false if the instruction is neither
+ */
+static bool execute(const t_risc_instr &instr, uint64_t *x, std::vector<uint64_t> &accesses) {
+    uint64_t a = instr.reg_src_1 <= x31 ? x[instr.reg_src_1] : 0;
+    uint64_t b = instr.reg_src_2 <= x31 ? x[instr.reg_src_2] : 0;
+    uint64_t imm = instr.imm;
+    uint64_t r;
+    switch (instr.mnem) {
+        case SILENT_NOP:
+            return true;
+        case LB:
+        case LH:
+        case LW:
+        case LBU:
+        case LHU:
+        case LWU:
+        case LD:
+            accesses.push_back(a + imm);
+            r = (a + imm) * 0x9e3779b97f4a7c15;
+            break;
+        case SB:
+        case SH:
+        case SW:
+        case SD:
+            accesses.push_back(a + imm);
+            accesses.push_back(b);
+            return true;
+        case FLW:
+        case FSW:
+        case FLD:
+        case FSD:
+            accesses.push_back(a + imm);
+            return true;
+        case LUI:
+            r = imm;
+            break;
+        case AUIPC:
+            r = instr.addr + imm;
+            break;
+        case ADDI:
+            r = a + imm;
+            break;
+        case SLTI:
+            r = (int64_t) a < (int64_t) imm;
+            break;
+        case SLTIU:
+            r = a < imm;
+            break;
+        case XORI:
+            r = a ^ imm;
+            break;
+        case ORI:
+            r = a | imm;
+            break;
+        case ANDI:
+            r = a & imm;
+            break;
+        case SLLI:
+            r = a << (imm & 0x3f);
+            break;
+        case SRLI:
+            r = a >> (imm & 0x3f);
+            break;
+        case SRAI:
+            r = (int64_t) a >> (imm & 0x3f);
+            break;
+        case ADDIW:
+            r = (int32_t) (a + imm);
+            break;
+        case SLLIW:
+            r = (int32_t) ((uint32_t) a << (imm & 0x1f));
+            break;
+        case SRLIW:
+            r = (int32_t) ((uint32_t) a >> (imm & 0x1f));
+            break;
+        case SRAIW:
+            r = (int32_t) a >> (imm & 0x1f);
+            break;
+        case ADD:
+            r = a + b;
+            break;
+        case SUB:
+            r = a - b;
+            break;
+        case SLL:
+            r = a << (b & 0x3f);
+            break;
+        case SLT:
+            r = (int64_t) a < (int64_t) b;
+            break;
+        case SLTU:
+            r = a < b;
+            break;
+        case XOR:
+            r = a ^ b;
+            break;
+        case SRL:
+            r = a >> (b & 0x3f);
+            break;
+        case SRA:
+            r = (int64_t) a >> (b & 0x3f);
+            break;
+        case OR:
+            r = a | b;
+            break;
+        case AND:
+            r = a & b;
+            break;
+        case ADDW:
+            r = (int32_t) (a + b);
+            break;
+        case SUBW:
+            r = (int32_t) (a - b);
+            break;
+        case SLLW:
+            r = (int32_t) ((uint32_t) a << (b & 0x1f));
+            break;
+        case SRLW:
+            r = (int32_t) ((uint32_t) a >> (b & 0x1f));
+            break;
+        case SRAW:
+            r = (int32_t) a >> (b & 0x1f);
+            break;
+        case MUL:
+            r = a * b;
+            break;
+        case MULW:
+            r = (int32_t) (a * b);
+            break;
+        default:
+            return false;
+    }
+    if (instr.reg_dest != x0) x[instr.reg_dest] = r;
+    return true;
+}
+
+static bool is_straight_line(const t_risc_instr &instr) {
+    switch (instr.optype) {
+        case REG_REG:
+            return instr.mnem < LRW || instr.mnem > AMOMAXUD;
+        case IMMEDIATE:
+        case UPPER_IMMEDIATE:
+        case STORE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static void optimize(t_risc_instr *instrs, int count, const register_info *r_info) {
+    propagate_block(instrs, count, r_info);
+    eliminate_dead_instructions(instrs, count);
+}
+
+class Propagate : public ::testing::Test {
+protected:
+    bool mapped[N_REG];
+    register_info r_info{};
+
+    void SetUp() override {
+        for (bool &m : mapped) m = true;
+        r_info.gp_mapped = mapped;
+    }
+};
+
+/**
+ * Checks that constants built by LUI/ADDI chains are loaded directly and their parts dropped.
+ */
+TEST_F(Propagate, FoldsConstants) {
+    t_risc_instr block[] = {
+            {0x1000, LUI, UPPER_IMMEDIATE, NO_REG, NO_REG, x5, {{0x1000}}, TRACE_NONE},
+            {0x1004, ADDIW, IMMEDIATE, x5, NO_REG, x5, {{1}}, TRACE_NONE},
+            {0x1008, SLLI, IMMEDIATE, x5, NO_REG, x5, {{32}}, TRACE_NONE},
+            {0x100c, ADDI, IMMEDIATE, x5, NO_REG, x5, {{5}}, TRACE_NONE},
+            {0x1010, ADD, REG_REG, x10, x6, x11, {{0}}, TRACE_NONE},
+            {0x1014, JALR, JUMP, x1, NO_REG, x0, {{0}}, TRACE_NONE}
+    };
+    optimize(block, 6, &r_info);
+
+    EXPECT_EQ(SILENT_NOP, block[0].mnem);
+    EXPECT_EQ(SILENT_NOP, block[1].mnem);
+    EXPECT_EQ(SILENT_NOP, block[2].mnem);
+    EXPECT_EQ(LUI, block[3].mnem);
+    EXPECT_EQ(0x100100000005, block[3].imm);
+    //unknown operands are left alone
+    EXPECT_EQ(ADD, block[4].mnem);
+}
+
+/**
+ * Checks that register operands with known values become immediates, and copies are read from the copied register.
+ */
+TEST_F(Propagate, FoldsOperandsAndCopies) {
+    t_risc_instr block[] = {
+            {0x1000, ADDI, IMMEDIATE, x0, NO_REG, x6, {{40}}, TRACE_NONE},
+            {0x1004, SUB, REG_REG, x10, x6, x11, {{0}}, TRACE_NONE},
+            {0x1008, ADDI, IMMEDIATE, x11, NO_REG, x12, {{0}}, TRACE_NONE},
+            {0x100c, SD, STORE, x2, x12, NO_REG, {{8}}, TRACE_NONE},
+            {0x1010, ADDI, IMMEDIATE, x0, NO_REG, x12, {{1}}, TRACE_NONE},
+            {0x1014, JALR, JUMP, x1, NO_REG, x0, {{0}}, TRACE_NONE}
+    };
+    optimize(block, 6, &r_info);
+
+    EXPECT_EQ(ADDI, block[1].mnem);
+    EXPECT_EQ(x10, block[1].reg_src_1);
+    EXPECT_EQ(-40, block[1].imm);
+    //the store reads the copied register, so the copy is dead
+    EXPECT_EQ(SILENT_NOP, block[2].mnem);
+    EXPECT_EQ(x11, block[3].reg_src_2);
+    //x0 operands and plain constants stay as they are
+    EXPECT_EQ(ADDI, block[0].mnem);
+    EXPECT_EQ(ADDI, block[4].mnem);
+}
+
+/**
+ * Checks that loads and stores through a base register with a known value address the absolute address instead.
+ */
+TEST_F(Propagate, FoldsAddresses) {
+    t_risc_instr block[] = {
+            {0x1000, AUIPC, UPPER_IMMEDIATE, NO_REG, NO_REG, x5, {{0x2000}}, TRACE_NONE},
+            {0x1004, LW, IMMEDIATE, x5, NO_REG, x10, {{8}}, TRACE_NONE},
+            {0x1008, SB, STORE, x5, x10, NO_REG, {{-3}}, TRACE_NONE},
+            {0x100c, FLD, FLOAT, x5, NO_REG, (t_risc_reg) 1, {{16}}, TRACE_NONE},
+            {0x1010, LUI, UPPER_IMMEDIATE, NO_REG, NO_REG, x6, {{0x100000000}}, TRACE_NONE},
+            {0x1014, SD, STORE, x6, x10, NO_REG, {{8}}, TRACE_NONE},
+            {0x1018, ADDI, IMMEDIATE, x0, NO_REG, x5, {{1}}, TRACE_NONE},
+            {0x101c, JALR, JUMP, x1, NO_REG, x0, {{0}}, TRACE_NONE}
+    };
+    optimize(block, 8, &r_info);
+
+    //all accesses through the AUIPC are folded, before it is overwritten
+
+    EXPECT_EQ(SILENT_NOP, block[0].mnem);
+    EXPECT_EQ(x0, block[1].reg_src_1);
+    EXPECT_EQ(0x3008, block[1].imm);
+    EXPECT_EQ(x0, block[2].reg_src_1);
+    EXPECT_EQ(0x2ffd, block[2].imm);
+    EXPECT_EQ(x0, block[3].reg_src_1);
+    EXPECT_EQ(0x3010, block[3].imm);
+    //the address does not fit into a displacement
+    EXPECT_EQ(LUI, block[4].mnem);
+    EXPECT_EQ(x6, block[5].reg_src_1);
+    EXPECT_EQ(8, block[5].imm);
+}
+
+/**
+ * Checks that increments of memory addressed through AUIPC are still fused once their address is folded.
+ */
+TEST_F(Propagate, FusesFoldedIncrements) {
+    t_risc_instr block[] = {
+            {0x1000, AUIPC, UPPER_IMMEDIATE, NO_REG, NO_REG, x5, {{0x2000}}, TRACE_NONE},
+            {0x1004, ADDI, IMMEDIATE, x5, NO_REG, x5, {{0x10}}, TRACE_NONE},
+            {0x1008, LW, IMMEDIATE, x5, NO_REG, x10, {{8}}, TRACE_NONE},
+            {0x100c, ADDIW, IMMEDIATE, x10, NO_REG, x10, {{1}}, TRACE_NONE},
+            {0x1010, SW, STORE, x5, x10, NO_REG, {{8}}, TRACE_NONE},
+            {0x1014, LD, IMMEDIATE, x5, NO_REG, x11, {{16}}, TRACE_NONE},
+            {0x1018, ADDI, IMMEDIATE, x11, NO_REG, x11, {{-1}}, TRACE_NONE},
+            {0x101c, SD, STORE, x5, x11, NO_REG, {{16}}, TRACE_NONE},
+            {0x1020, JALR, JUMP, x1, NO_REG, x0, {{0}}, TRACE_NONE}
+    };
+    optimize(block, 9, &r_info);
+    optimize_patterns(block, 9);
+
+    EXPECT_EQ(PATTERN_EMIT, block[2].mnem);
+    EXPECT_EQ(x0, block[2].reg_src_1);
+    EXPECT_EQ(0x3018, block[2].imm);
+    EXPECT_EQ(PATTERN_EMIT, block[5].mnem);
+    EXPECT_EQ(x0, block[5].reg_src_1);
+    EXPECT_EQ(0x3020, block[5].imm);
+}
+
+/**
+ * Checks that a mapped copy of an unmapped register is not exchanged for it, which would load it from memory.
+ */
+TEST_F(Propagate, KeepsMappedCopies) {
+    mapped[x11] = false;
+    t_risc_instr block[] = {
+            {0x1000, ADDI, IMMEDIATE, x11, NO_REG, x12, {{0}}, TRACE_NONE},
+            {0x1004, ADD, REG_REG, x12, x12, x13, {{0}}, TRACE_NONE},
+            {0x1008, JALR, JUMP, x1, NO_REG, x0, {{0}}, TRACE_NONE}
+    };
+    optimize(block, 3, &r_info);
+
+    EXPECT_EQ(ADDI, block[0].mnem);
+    EXPECT_EQ(x12, block[1].reg_src_1);
+    EXPECT_EQ(x12, block[1].reg_src_2);
+}
+
+/**
+ * Optimizes the straight-line code of the bundled test binaries.
+ */
+class PropagateText : public ProgramText<Propagate> {
+protected:
+    /**
+     * Call the passed function with each run of straight-line instructions satisfying the passed predicate.
+     */
+    template<typename P, typename F>
+    void for_each_run(P predicate, F function) {
+        size_t start = 0;
+        while (start < instrs.size()) {
+            size_t end = start;
+            while (end < instrs.size() && end - start < MAX_RUN_LENGTH && predicate(instrs[end])) end++;
+            if (end - start >= 2) {
+                function(&instrs[start], (int) (end - start));
+            }
+            start = end == start ? end + 1 : end;
+        }
+    }
+};
+
+/**
+ * Checks that the optimized runs of integer computations and memory accesses yield the same register values and
+ * access the same addresses as the original ones, with random register values and mappings.
+ */
+TEST_F(PropagateText, PreservesResults) {
+    std::mt19937_64 random(17);
+    size_t count = 0;
+    size_t eliminated = 0;
+    size_t folded = 0;
+    for_each_run([](const t_risc_instr &instr) {
+        uint64_t x[N_REG] = {0};
+        std::vector<uint64_t> accesses;
+        return execute(instr, x, accesses);
+    }, [&](t_risc_instr *run, int length) {
+        for (bool &m : mapped) m = random() & 1;
+        uint64_t expected[N_REG] = {0};
+        uint64_t actual[N_REG] = {0};
+        for (int reg = x1; reg <= x31; reg++) {
+            expected[reg] = actual[reg] = random();
+        }
+        std::vector<uint64_t> expected_accesses;
+        std::vector<uint64_t> actual_accesses;
+
+        std::vector<t_risc_instr> optimized(run, run + length);
+        optimize(optimized.data(), length, &r_info);
+        for (int i = 0; i < length; i++) {
+            execute(run[i], expected, expected_accesses);
+            ASSERT_TRUE(execute(optimized[i], actual, actual_accesses)) << mnem_to_string(optimized[i].mnem);
+            eliminated += optimized[i].mnem == SILENT_NOP;
+            folded += run[i].reg_src_1 != x0 && optimized[i].reg_src_1 == x0 && optimized[i].mnem != SILENT_NOP &&
+                    optimized[i].mnem != LUI;
+        }
+        for (int reg = x1; reg <= x31; reg++) {
+            ASSERT_EQ(expected[reg], actual[reg]) << "x" << reg << " in run at 0x" << std::hex << run[0].addr;
+        }
+        ASSERT_EQ(expected_accesses, actual_accesses) << "in run at 0x" << std::hex << run[0].addr;
+        count += length;
+    });
+    printf("Optimized %lu instructions in straight-line runs, %lu dead instructions eliminated, %lu constant "
+           "operands or addresses folded\n", count, eliminated, folded);
+}
+
+/**
+ * Reports the host code emitted per guest instruction for the straight-line code of the bundled binaries,
+ * with and without the block optimizations.
+ * Disabled by default, run with --gtest_also_run_disabled_tests.
+ */
+TEST_F(PropagateText, DISABLED_EmittedBytes) {
+    context_info *c_info = init_map_context(false);
+    bool propagate = flag_translate_opt_propagate;
+    size_t count = 0;
+    size_t bytes[2] = {0, 0};
+    for (int enabled = 0; enabled <= 1; enabled++) {
+        flag_translate_opt_propagate = enabled;
+        for_each_run(is_straight_line, [&](t_risc_instr *run, int length) {
+            std::vector<t_risc_instr> block(run, run + length);
+            t_cache_loc loc = translate_block_instructions(block.data(), length, c_info);
+            bytes[enabled] += (uint8_t *) currentPos - (uint8_t *) loc;
+            count += enabled ? length : 0;
+        });
+    }
+    flag_translate_opt_propagate = propagate;
+
+    EXPECT_LE(bytes[1], bytes[0]);
+    //the minilibc linked into the tests formats no floating point numbers
+    printf("Emitted bytes for %lu instructions: %lu without, %lu with block optimizations\n", count, bytes[0],
+           bytes[1]);
+}
@@ -0,0 +1,122 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include <fadec/fadec-enc.h>
+#include <gen/regalloc.h>
+#include <gen/translate.h>
+#include <main/context.h>
+
+static const t_risc_reg NO_REG = (t_risc_reg) INVALID_REG;
+
+/**
+ * Promotes the registers of regions translated into a fresh block, without finishing the block.
+ */
+class RegionAllocation : public ::testing::Test {
+protected:
+    static context_info *c_info;
+    register_info *r_info = nullptr;
+    //the first unmapped register, and the first mapped one
+    t_risc_reg unmapped = NO_REG;
+    t_risc_reg mapped = NO_REG;
+
+public:
+    static void SetUpTestSuite() {
+        c_info = init_map_context(false);
+    }
+
+protected:
+    void SetUp() override {
+        r_info = c_info->r_info;
+        for (int reg = x1; reg <= x31; reg++) {
+            if (r_info->gp_mapped[reg] && mapped == NO_REG) mapped = (t_risc_reg) reg;
+            if (!r_info->gp_mapped[reg] && unmapped == NO_REG) unmapped = (t_risc_reg) reg;
+        }
+        ASSERT_NE(NO_REG, mapped);
+        ASSERT_NE(NO_REG, unmapped);
+        init_block(r_info);
+    }
+
+    /**
+     * Get the code emitted by the passed function, and where it starts.
+     */
+    template<typename F>
+    static std::vector<uint8_t> emitted_by(F function, uint8_t **start) {
+        *start = current;
+        function();
+        return {*start, current};
+    }
+
+    /**
+     * Get the glue storing the passed register from the host register and loading the other one into it, encoded at
+     * the passed position like the translator does (FE_MEM_ADDR() is relative to current), overwriting the code there.
+     */
+    std::vector<uint8_t> glue(uint8_t *at, t_risc_reg stored, t_risc_reg loaded, FeReg host) const {
+        uint8_t *end = current;
+        current = at;
+        EXPECT_EQ(0, fe_enc64(&current, FE_MOV64mr, FE_MEM_ADDR(r_info->base + 8 * stored), host));
+        EXPECT_EQ(0, fe_enc64(&current, FE_MOV64rm, host, FE_MEM_ADDR(r_info->base + 8 * loaded)));
+        std::vector<uint8_t> code(at, current);
+        current = end;
+        return code;
+    }
+};
+
+context_info *RegionAllocation::c_info = nullptr;
+
+/**
+ * Checks that an unmapped register referenced often takes over the host register of an unreferenced mapped one
+ * for the region, with glue code exchanging them on entry and back on exit.
+ */
+TEST_F(RegionAllocation, PromotesAndRestores) {
+    std::vector<t_risc_instr> region(8, {0x1000, ADDI, IMMEDIATE, unmapped, NO_REG, unmapped, {{1}}, TRACE_NONE});
+    FeReg host = r_info->gp_map[mapped];
+    FeReg unmapped_map = r_info->gp_map[unmapped];
+
+    uint8_t *entry_start;
+    std::vector<uint8_t> entry_glue = emitted_by([&] {
+        begin_region_allocation(region.data(), (int) region.size(), r_info);
+    }, &entry_start);
+    ASSERT_TRUE(region_allocation_active());
+    EXPECT_TRUE(r_info->gp_mapped[unmapped]);
+    EXPECT_EQ(host, r_info->gp_map[unmapped]);
+    EXPECT_FALSE(r_info->gp_mapped[mapped]);
+    EXPECT_EQ(glue(entry_start, mapped, unmapped, host), entry_glue);
+
+    uint8_t *exit_start;
+    std::vector<uint8_t> exit_glue = emitted_by([&] {
+        end_region_allocation(r_info);
+    }, &exit_start);
+    EXPECT_FALSE(region_allocation_active());
+    EXPECT_FALSE(r_info->gp_mapped[unmapped]);
+    EXPECT_EQ(unmapped_map, r_info->gp_map[unmapped]);
+    EXPECT_TRUE(r_info->gp_mapped[mapped]);
+    EXPECT_EQ(host, r_info->gp_map[mapped]);
+    EXPECT_EQ(glue(exit_start, unmapped, mapped, host), exit_glue);
+}
+
+/**
+ * Checks that regions referencing the unmapped registers rarely keep the static mapping, as the glue would cost more.
+ */
+TEST_F(RegionAllocation, KeepsStaticMappingIfRare) {
+    std::vector<t_risc_instr> region(1, {0x1000, ADDI, IMMEDIATE, unmapped, NO_REG, unmapped, {{1}}, TRACE_NONE});
+
+    uint8_t *entry_start;
+    std::vector<uint8_t> entry_glue = emitted_by([&] {
+        begin_region_allocation(region.data(), (int) region.size(), r_info);
+    }, &entry_start);
+    EXPECT_FALSE(region_allocation_active());
+    EXPECT_FALSE(r_info->gp_mapped[unmapped]);
+    EXPECT_TRUE(entry_glue.empty());
+}
+
+/**
+ * Checks that fused instructions count their registers, although their optype holds the index of the pattern,
+ * which may equal FLOAT.
+ */
+TEST_F(RegionAllocation, CountsFusedInstructions) {
+    std::vector<t_risc_instr> region(8, {0x1000, PATTERN_EMIT, FLOAT, unmapped, NO_REG, unmapped, {{1}}, TRACE_NONE});
+
+    begin_region_allocation(region.data(), (int) region.size(), r_info);
+    EXPECT_TRUE(region_allocation_active());
+    EXPECT_TRUE(r_info->gp_mapped[unmapped]);
+    end_region_allocation(r_info);
+}